@@ -0,0 +1,106 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// local
+#include "bench.h"
+
+
+namespace
+{
+
+std::atomic<std::uint64_t> counter{0};
+
+
+void* allocate(std::size_t size) noexcept
+{
+  counter.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(0 == size ? 1 : size);
+}
+
+
+void* allocate_or_throw(std::size_t size)
+{
+  auto ptr = allocate(size);
+  if (!ptr)
+    throw std::bad_alloc{};
+  return ptr;
+}
+
+} // namespace
+
+
+std::uint64_t bench::allocations() noexcept
+{
+  return counter.load(std::memory_order_relaxed);
+}
+
+
+void* operator new(std::size_t size)
+{
+  return allocate_or_throw(size);
+}
+
+
+void* operator new[](std::size_t size)
+{
+  return allocate_or_throw(size);
+}
+
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return allocate(size);
+}
+
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return allocate(size);
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
@@ -0,0 +1,225 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+#ifndef ASYNC_PROMISE_BENCH_H
+#define ASYNC_PROMISE_BENCH_H
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+// async_promise
+#include <async_promise.hpp>
+
+
+namespace bench
+{
+
+/**
+ * @brief Counter of all heap allocations of the program, see allocations.cpp.
+ * @return Number of allocations since the program start.
+ */
+std::uint64_t allocations() noexcept;
+
+
+/**
+ * @brief Get the value of a --name=value command line argument.
+ * @param argc - Number of arguments.
+ * @param argv - Arguments.
+ * @param name - Argument name without the dashes.
+ * @param value - Default value.
+ * @return Argument value or the default value if the argument is missing.
+ */
+template<typename T>
+T argument(int argc, char** argv, const std::string& name, T value)
+{
+  auto prefix = "--" + name + "=";
+  for (auto i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (0 == arg.find(prefix))
+      std::istringstream{arg.substr(prefix.size())} >> value;
+  }
+
+  return value;
+}
+
+
+/**
+ * @brief Get the number of threads of the process.
+ * @return Number of threads, or zero if it is unknown on this platform.
+ */
+inline std::size_t thread_count()
+{
+  std::ifstream status{"/proc/self/status"};
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (0 == line.find("Threads:"))
+      return static_cast<std::size_t>(std::strtoull(line.c_str() + 8, nullptr, 10));
+  }
+
+  return 0;
+}
+
+
+/**
+ * @brief Benchmark settings from the command line.
+ */
+struct settings final
+{
+  std::string filter;                              //!< Run only benchmarks whose name contains the filter.
+  std::chrono::milliseconds min_time{200};         //!< Minimum measured time per benchmark.
+  std::size_t max_width = 4096;                    //!< Largest fan-out width.
+
+  /**
+   * @brief Parse the command line: [--min-time=ms] [--max-width=n] [filter].
+   * @param argc - Number of arguments.
+   * @param argv - Arguments.
+   * @return Options.
+   */
+  static settings parse(int argc, char** argv)
+  {
+    settings result;
+    result.min_time = std::chrono::milliseconds{argument(argc, argv, "min-time", result.min_time.count())};
+    result.max_width = argument(argc, argv, "max-width", result.max_width);
+    for (auto i = 1; i < argc; ++i)
+    {
+      if (0 != std::string{argv[i]}.find("--"))
+        result.filter = argv[i];
+    }
+
+    return result;
+  }
+};
+
+
+/**
+ * @brief Runs benchmarks and prints one line per benchmark with the time, the allocations and,
+ *        if the library is compiled with ASYNC_PROMISE_INSTRUMENTATION, the threads per operation.
+ */
+class runner final
+{
+  public:
+    explicit runner(settings options)
+      : m_options{std::move(options)}
+    {
+      std::cout << std::left << std::setw(40) << "benchmark" << std::right
+                << std::setw(12) << "iterations" << std::setw(14) << "ns/op" << std::setw(14) << "allocs/op";
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      // The library counts the threads it creates only when instrumented
+      std::cout << std::setw(14) << "threads/op";
+#endif
+      std::cout << std::endl;
+    }
+
+    const settings& options() const noexcept
+    {
+      return m_options;
+    }
+
+    /**
+     * @brief Measure a function. The number of iterations grows until they take the minimum time.
+     * @param name - Benchmark name.
+     * @param func - Function performing one operation.
+     */
+    template<typename Func>
+    void run(const std::string& name, Func&& func)
+    {
+      if (std::string::npos == name.find(m_options.filter))
+        return;
+
+      func();
+
+      std::uint64_t iterations = 1;
+      for (;;)
+      {
+        auto allocations = bench::allocations();
+        auto threads = async::get_runtime_stats().threads_created;
+        auto start = clock::now();
+        for (std::uint64_t i = 0; i < iterations; ++i)
+          func();
+        auto time = clock::now() - start;
+
+        if (time >= m_options.min_time || iterations >= max_iterations)
+        {
+          report(name, iterations, time, bench::allocations() - allocations,
+                 async::get_runtime_stats().threads_created - threads);
+          return;
+        }
+
+        auto ns = std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), 1);
+        auto target = std::chrono::duration_cast<std::chrono::nanoseconds>(m_options.min_time).count();
+        auto next = static_cast<std::uint64_t>(static_cast<double>(iterations) * target / ns * 1.2);
+        iterations = std::min(std::max(next, iterations * 2), max_iterations);
+      }
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::uint64_t max_iterations = 1000000000;
+
+    static void report(const std::string& name, std::uint64_t iterations, clock::duration time,
+                       std::uint64_t allocations, std::uint64_t threads)
+    {
+      auto count = static_cast<double>(iterations);
+      std::cout << std::left << std::setw(40) << name << std::right << std::setw(12) << iterations
+                << std::fixed << std::setprecision(1)
+                << std::setw(14) << std::chrono::duration<double, std::nano>{time}.count() / count
+                << std::setprecision(2) << std::setw(14) << allocations / count;
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      std::cout << std::setw(14) << threads / count;
+#else
+      static_cast<void>(threads);
+#endif
+      std::cout << std::endl;
+    }
+
+    const settings m_options;
+};
+
+
+/**
+ * @brief Keep a value from being optimised away.
+ * @param value - Value.
+ */
+template<typename T>
+void keep(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+} // namespace bench
+
+#endif // ASYNC_PROMISE_BENCH_H
@@ -0,0 +1,258 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// async_promise
+#include <async_promise.hpp>
+#include <async_promise_metrics.hpp>
+
+// local
+#include "bench.h"
+
+
+namespace
+{
+
+using clock = std::chrono::steady_clock;
+
+
+/**
+ * @brief Load benchmark settings from the command line.
+ */
+struct config final
+{
+  std::string executor;   //!< "async" or "pool".
+  std::size_t threads;    //!< Thread pool size.
+  double qps;             //!< Requests issued per second.
+  double duration;        //!< Seconds to issue requests for.
+  std::size_t fanout;     //!< Backend calls per request in the all() stage.
+  std::size_t hedge;      //!< Replicas raced per request in the race() stage.
+  std::size_t limit;      //!< Maximum backend calls of a request at once, zero for no limit.
+  std::string latency;    //!< Backend latency distribution: "fixed", "exponential" or "lognormal".
+  double mean;            //!< Mean backend latency in milliseconds.
+  double sigma;           //!< Shape of the lognormal distribution.
+  double error_rate;      //!< Probability of a backend call to fail.
+
+  static config parse(int argc, char** argv)
+  {
+    config result;
+    result.executor = bench::argument<std::string>(argc, argv, "executor", "async");
+    result.threads = bench::argument<std::size_t>(argc, argv, "threads", std::max(std::thread::hardware_concurrency(), 1u));
+    result.qps = bench::argument(argc, argv, "qps", 500.0);
+    result.duration = bench::argument(argc, argv, "duration", 5.0);
+    result.fanout = bench::argument<std::size_t>(argc, argv, "fanout", 8);
+    result.hedge = bench::argument<std::size_t>(argc, argv, "hedge", 2);
+    result.limit = bench::argument<std::size_t>(argc, argv, "limit", 0);
+    result.latency = bench::argument<std::string>(argc, argv, "latency", "exponential");
+    result.mean = bench::argument(argc, argv, "mean", 2.0);
+    result.sigma = bench::argument(argc, argv, "sigma", 0.5);
+    result.error_rate = bench::argument(argc, argv, "error-rate", 0.001);
+    return result;
+  }
+};
+
+
+struct backend_error : std::runtime_error
+{
+  backend_error()
+    : std::runtime_error{"Backend error"}
+  {}
+};
+
+
+/**
+ * @brief Fake backend: a call waits on a timer for a random latency and fails with the error rate.
+ */
+class backend final
+{
+  public:
+    explicit backend(const config& config)
+      : m_config(config)
+    {}
+
+    int call(int request) const
+    {
+      auto& random = generator();
+      std::this_thread::sleep_for(latency(random));
+      if (std::bernoulli_distribution{m_config.error_rate}(random))
+        throw backend_error{};
+
+      return request + 1;
+    }
+
+  private:
+    std::chrono::nanoseconds latency(std::mt19937_64& random) const
+    {
+      auto ms = m_config.mean;
+      if ("exponential" == m_config.latency)
+      {
+        ms = std::exponential_distribution<double>{1.0 / m_config.mean}(random);
+      }
+      else if ("lognormal" == m_config.latency)
+      {
+        auto mu = std::log(m_config.mean) - m_config.sigma * m_config.sigma / 2;
+        ms = std::lognormal_distribution<double>{mu, m_config.sigma}(random);
+      }
+
+      return std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(ms * 1e6)};
+    }
+
+    static std::mt19937_64& generator()
+    {
+      static std::atomic<std::uint64_t> seed{1};
+      static thread_local std::mt19937_64 generator{seed.fetch_add(1)};
+      return generator;
+    }
+
+    const config& m_config;
+};
+
+
+/**
+ * @brief Outcome of the requests.
+ */
+struct statistics final
+{
+  async::latency_histogram latency;
+  std::atomic<std::uint64_t> succeeded{0};
+  std::atomic<std::uint64_t> failed{0};
+  std::atomic<clock::rep> last{0};
+
+  void finish(clock::time_point scheduled)
+  {
+    auto now = clock::now();
+    latency.record(now - scheduled);
+    auto end = now.time_since_epoch().count();
+    auto last_end = last.load();
+    while (last_end < end && !last.compare_exchange_weak(last_end, end));
+  }
+};
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+  auto config = config::parse(argc, argv);
+  backend service{config};
+  statistics stats;
+  async::thread_pool pool{config.threads};
+  auto use_pool = "pool" == config.executor;
+  auto limiter = 0 == config.limit ? nullptr : std::make_shared<async::concurrency_limiter>(config.limit, 1, config.limit);
+
+  std::vector<std::function<int(int)>> calls(config.fanout, [&service] (int request)
+  {
+    return service.call(request);
+  });
+
+  std::vector<std::function<int(std::vector<int>)>> replicas(config.hedge, [&service] (std::vector<int> responses)
+  {
+    return service.call(static_cast<int>(responses.size()));
+  });
+
+  std::cout << "executor: " << config.executor << (use_pool ? " (" + std::to_string(config.threads) + " threads)" : "")
+            << ", qps: " << config.qps << ", duration: " << config.duration << "s"
+            << ", fanout: " << config.fanout << ", hedge: " << config.hedge
+            << ", limit: " << (0 == config.limit ? "none" : std::to_string(config.limit)) << std::endl
+            << "backend: " << config.latency << " latency with mean " << config.mean << "ms"
+            << ", error rate: " << config.error_rate << std::endl;
+
+  std::atomic<bool> running{true};
+  std::size_t peak_threads = 0;
+  std::thread sampler{[&running, &peak_threads] ()
+  {
+    while (running)
+    {
+      peak_threads = std::max(peak_threads, bench::thread_count());
+      std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    }
+  }};
+
+  auto requests = static_cast<std::size_t>(config.qps * config.duration);
+  auto interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>{1.0 / config.qps});
+  std::vector<std::future<void>> futures;
+  futures.reserve(requests);
+
+  auto start = clock::now();
+  for (std::size_t i = 0; i < requests; ++i)
+  {
+    auto scheduled = start + interval * static_cast<clock::rep>(i);
+    std::this_thread::sleep_until(scheduled);
+
+    auto all = async::make_promise([i] () { return static_cast<int>(i); })
+               .then([] (int request) { return request; })
+               .all(calls);
+    if (use_pool)
+      all = all.on(pool);
+    if (limiter)
+      all = all.limit(limiter);
+
+    auto race = all.race(replicas);
+    if (use_pool)
+      race = race.on(pool);
+
+    auto chain = race.then([&stats, scheduled] (int)
+                 {
+                   stats.finish(scheduled);
+                   ++stats.succeeded;
+                 })
+                 .fail([&stats, scheduled] (std::exception_ptr)
+                 {
+                   stats.finish(scheduled);
+                   ++stats.failed;
+                 });
+
+    futures.push_back(use_pool ? chain.run(pool) : chain.run());
+  }
+
+  for (auto& future : futures)
+    future.get();
+
+  running = false;
+  sampler.join();
+
+  auto elapsed = std::chrono::duration<double>{clock::duration{stats.last.load()} - start.time_since_epoch()}.count();
+  auto latency = stats.latency.snapshot();
+  auto ms = [] (std::chrono::nanoseconds value) { return std::chrono::duration<double, std::milli>{value}.count(); };
+
+  std::cout << "requests: " << requests << ", succeeded: " << stats.succeeded << ", failed: " << stats.failed << std::endl
+            << "throughput: " << (0 < elapsed ? requests / elapsed : 0.0) << " req/s" << std::endl
+            << "latency p50: " << ms(latency.percentile(50)) << "ms, p90: " << ms(latency.percentile(90))
+            << "ms, p99: " << ms(latency.percentile(99)) << "ms, p99.9: " << ms(latency.percentile(99.9))
+            << "ms, max: " << ms(latency.max()) << "ms" << std::endl
+            << "peak threads: " << (0 == peak_threads ? std::string{"unknown"} : std::to_string(peak_threads)) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,189 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// async_promise
+#include <async_promise.hpp>
+
+// local
+#include "bench.h"
+
+
+namespace
+{
+
+int zero()
+{
+  return 0;
+}
+
+
+int identity(int value)
+{
+  return value;
+}
+
+
+int recover(std::exception_ptr)
+{
+  return 0;
+}
+
+
+async::promise<int> then_chain(std::size_t stages)
+{
+  auto chain = async::make_resolved_promise(0);
+  for (std::size_t i = 0; i < stages; ++i)
+    chain = chain.then(identity);
+  return chain;
+}
+
+
+template<typename Chain>
+void fan_out(bench::runner& runner, const std::string& name, Chain chain)
+{
+  async::thread_pool pool;
+  for (std::size_t width = 1; width <= runner.options().max_width; width *= 4)
+  {
+    std::vector<int(*)(int)> funcs(width, identity);
+    auto async_chain = chain(async::make_resolved_promise(0), funcs);
+    auto pool_chain = chain(async::make_resolved_promise(0), funcs).on(pool);
+
+    runner.run(name + "/async/" + std::to_string(width), [&async_chain] ()
+    {
+      bench::keep(async_chain.run(std::launch::deferred).get());
+    });
+
+    runner.run(name + "/pool/" + std::to_string(width), [&pool_chain] ()
+    {
+      bench::keep(pool_chain.run(std::launch::deferred).get());
+    });
+  }
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+  bench::runner runner{bench::settings::parse(argc, argv)};
+
+  runner.run("make_resolved_promise", [] ()
+  {
+    bench::keep(async::make_resolved_promise(0));
+  });
+
+  runner.run("make_promise", [] ()
+  {
+    bench::keep(async::make_promise(zero));
+  });
+
+  runner.run("then/build", [] ()
+  {
+    bench::keep(async::make_resolved_promise(0).then(identity));
+  });
+
+  auto resolved = async::make_resolved_promise(0);
+  runner.run("run/deferred", [&resolved] ()
+  {
+    bench::keep(resolved.run(std::launch::deferred).get());
+  });
+
+  runner.run("run/async", [&resolved] ()
+  {
+    bench::keep(resolved.run().get());
+  });
+
+  {
+    async::thread_pool pool;
+    runner.run("run/pool", [&resolved, &pool] ()
+    {
+      bench::keep(resolved.run(pool).get());
+    });
+
+    async::arena memory;
+    async::arena_allocator<int> alloc{memory};
+    runner.run("run/pool/arena", [&resolved, &pool, &alloc] ()
+    {
+      bench::keep(resolved.run(pool, alloc).get());
+    });
+  }
+
+  for (std::size_t stages : {1, 16})
+  {
+    auto chain = then_chain(stages);
+    runner.run("then/x" + std::to_string(stages), [&chain] ()
+    {
+      bench::keep(chain.run(std::launch::deferred).get());
+    });
+  }
+
+  auto fail = async::make_resolved_promise(0).fail(recover);
+  runner.run("fail/resolved", [&fail] ()
+  {
+    bench::keep(fail.run(std::launch::deferred).get());
+  });
+
+  auto finally = async::make_resolved_promise(0).finally(zero);
+  runner.run("finally/resolved", [&finally] ()
+  {
+    bench::keep(finally.run(std::launch::deferred).get());
+  });
+
+  auto rejected = async::make_rejected_promise<int>(std::runtime_error{"error"}).fail(recover);
+  runner.run("fail/rejected", [&rejected] ()
+  {
+    bench::keep(rejected.run(std::launch::deferred).get());
+  });
+
+  auto propagated = async::make_rejected_promise<int>(std::runtime_error{"error"}).then(identity).fail(recover);
+  runner.run("then/rejected", [&propagated] ()
+  {
+    bench::keep(propagated.run(std::launch::deferred).get());
+  });
+
+  fan_out(runner, "all", [] (async::promise<int> chain, const std::vector<int(*)(int)>& funcs)
+  {
+    return chain.all(funcs);
+  });
+
+  fan_out(runner, "all_settled", [] (async::promise<int> chain, const std::vector<int(*)(int)>& funcs)
+  {
+    return chain.all_settled(funcs);
+  });
+
+  fan_out(runner, "any", [] (async::promise<int> chain, const std::vector<int(*)(int)>& funcs)
+  {
+    return chain.any(funcs);
+  });
+
+  fan_out(runner, "race", [] (async::promise<int> chain, const std::vector<int(*)(int)>& funcs)
+  {
+    return chain.race(funcs);
+  });
+
+  return 0;
+}
@@ -0,0 +1,272 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// async_promise
+#include <async_promise.hpp>
+
+// local
+#include "bench.h"
+
+
+namespace
+{
+
+using clock = std::chrono::steady_clock;
+
+
+/**
+ * @brief Scalability benchmark settings from the command line.
+ */
+struct config final
+{
+  std::size_t max_cores;     //!< Largest number of cores.
+  std::size_t max_width;     //!< Largest fan-out width.
+  double work;               //!< CPU work per element in microseconds.
+  std::size_t repeats;       //!< Measured runs per point, the median is reported.
+  std::string output;        //!< CSV file, empty for the standard output.
+
+  static config parse(int argc, char** argv)
+  {
+    config result;
+    result.max_cores = bench::argument<std::size_t>(argc, argv, "max-cores", 0);
+    result.max_width = bench::argument<std::size_t>(argc, argv, "max-width", 256);
+    result.work = bench::argument(argc, argv, "work", 50.0);
+    result.repeats = bench::argument<std::size_t>(argc, argv, "repeats", 5);
+    result.output = bench::argument<std::string>(argc, argv, "output", "");
+    return result;
+  }
+};
+
+
+/**
+ * @brief Restricts the process to a subset of the CPUs it was started with.
+ *        Threads inherit the mask of the thread creating them, so the mask is set
+ *        on the main thread before the pool and the chain threads are started.
+ */
+class affinity final
+{
+  public:
+    affinity()
+    {
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (0 == sched_getaffinity(0, sizeof(set), &set))
+      {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+          if (CPU_ISSET(cpu, &set))
+            m_cpus.push_back(cpu);
+        }
+      }
+#endif
+      if (m_cpus.empty())
+      {
+        auto count = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned cpu = 0; cpu < count; ++cpu)
+          m_cpus.push_back(static_cast<int>(cpu));
+      }
+    }
+
+    ~affinity()
+    {
+      restrict(m_cpus.size());
+    }
+
+    std::size_t cpus() const noexcept
+    {
+      return m_cpus.size();
+    }
+
+    /**
+     * @brief Restrict the calling thread to the first CPUs.
+     * @param count - Number of CPUs.
+     * @return True if the mask is applied, false if affinity is not supported.
+     */
+    bool restrict(std::size_t count) const
+    {
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (std::size_t i = 0; i < count && i < m_cpus.size(); ++i)
+        CPU_SET(m_cpus[i], &set);
+      return 0 == sched_setaffinity(0, sizeof(set), &set);
+#else
+      static_cast<void>(count);
+      return false;
+#endif
+    }
+
+  private:
+    std::vector<int> m_cpus;
+};
+
+
+std::uint64_t iterations_per_element = 0;
+
+
+/**
+ * @brief CPU-bound element function. The amount of work is fixed in iterations, not in time,
+ *        so preemption makes it slower instead of shorter.
+ */
+int work(int value)
+{
+  auto x = static_cast<std::uint64_t>(value) + 1;
+  for (std::uint64_t i = 0; i < iterations_per_element; ++i)
+    x = x * 6364136223846793005ull + 1442695040888963407ull;
+  bench::keep(x);
+  return value;
+}
+
+
+/**
+ * @brief Find the number of iterations taking the given time on one core.
+ * @param us - Time in microseconds.
+ */
+void calibrate(double us)
+{
+  iterations_per_element = 1 << 16;
+  for (;;)
+  {
+    auto start = clock::now();
+    work(0);
+    auto time = std::chrono::duration<double, std::micro>{clock::now() - start}.count();
+    if (time >= 10000 || iterations_per_element >= (1ull << 40))
+    {
+      iterations_per_element = static_cast<std::uint64_t>(iterations_per_element * us / time);
+      return;
+    }
+    iterations_per_element *= 2;
+  }
+}
+
+
+/**
+ * @brief Median time of a chain run.
+ * @param chain - Chain.
+ * @param repeats - Number of measured runs.
+ * @return Time in nanoseconds.
+ */
+double measure(const async::promise<int>& chain, std::size_t repeats)
+{
+  bench::keep(chain.run(std::launch::deferred).get());
+
+  std::vector<double> times;
+  times.reserve(repeats);
+  for (std::size_t i = 0; i < repeats; ++i)
+  {
+    auto start = clock::now();
+    bench::keep(chain.run(std::launch::deferred).get());
+    times.push_back(std::chrono::duration<double, std::nano>{clock::now() - start}.count());
+  }
+
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+
+/**
+ * @brief Core counts of the sweep: powers of two and the largest count.
+ */
+std::vector<std::size_t> core_counts(std::size_t max_cores)
+{
+  std::vector<std::size_t> result;
+  for (std::size_t cores = 1; cores < max_cores; cores *= 2)
+    result.push_back(cores);
+  result.push_back(max_cores);
+  return result;
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+  auto config = config::parse(argc, argv);
+  affinity cpus;
+  auto max_cores = 0 == config.max_cores ? cpus.cpus() : std::min(config.max_cores, cpus.cpus());
+  calibrate(config.work);
+
+  std::ofstream file;
+  if (!config.output.empty())
+    file.open(config.output);
+  std::ostream& csv = config.output.empty() ? std::cout : file;
+
+  std::cerr << "cpus: " << cpus.cpus() << ", max cores: " << max_cores << ", work: " << config.work
+            << "us (" << iterations_per_element << " iterations), repeats: " << config.repeats << std::endl;
+
+  using key = std::tuple<std::string, std::string, std::size_t>;
+  std::map<key, double> baseline;
+
+  csv << "executor,combinator,width,cores,ns_per_op,speedup,efficiency" << std::endl;
+  csv << std::fixed;
+  for (auto cores : core_counts(max_cores))
+  {
+    if (!cpus.restrict(cores))
+      std::cerr << "warning: CPU affinity is not supported, only the pool size follows the core count" << std::endl;
+
+    async::thread_pool pool{cores};
+    for (std::size_t width = 1; width <= config.max_width; width *= 4)
+    {
+      std::vector<int(*)(int)> funcs(width, work);
+      auto count = [] (std::vector<int> values) { return static_cast<int>(values.size()); };
+
+      std::vector<std::tuple<std::string, std::string, async::promise<int>>> chains;
+      chains.emplace_back("async", "all", async::make_resolved_promise(0).all(funcs).then(count));
+      chains.emplace_back("async", "race", async::make_resolved_promise(0).race(funcs));
+      chains.emplace_back("pool", "all", async::make_resolved_promise(0).all(funcs).on(pool).then(count));
+      chains.emplace_back("pool", "race", async::make_resolved_promise(0).race(funcs).on(pool));
+
+      for (const auto& chain : chains)
+      {
+        auto ns = measure(std::get<2>(chain), config.repeats);
+        auto& base = baseline[key{std::get<0>(chain), std::get<1>(chain), width}];
+        if (1 == cores)
+          base = ns;
+        auto speedup = base / ns;
+
+        csv << std::get<0>(chain) << ',' << std::get<1>(chain) << ',' << width << ',' << cores << ','
+            << std::setprecision(0) << ns << ',' << std::setprecision(3) << speedup << ','
+            << speedup / static_cast<double>(cores) << std::endl;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -18,14 +18,49 @@
 #ifndef ASYNC_PROMISE_H
 #define ASYNC_PROMISE_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <functional>
 #include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define ASYNC_PROMISE_PTHREAD
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// With ASYNC_PROMISE_COMPILED defined the non-template parts of the library and the promises of common
+// result types are compiled once into the async_promise library instead of in every translation unit
+#ifdef ASYNC_PROMISE_COMPILED
+#define ASYNC_PROMISE_DECL
+#ifdef ASYNC_PROMISE_SOURCE
+#define ASYNC_PROMISE_DEFINITIONS
+#endif
+#else
+#define ASYNC_PROMISE_DECL inline
+#define ASYNC_PROMISE_DEFINITIONS
+#endif
+
 
 namespace async
 {
@@ -53,8 +88,9 @@ struct aggregate_error final : public std::exception
  */
 enum class settle_type
 {
-  resolved, //!< Function completed successfully.
-  rejected, //!< Function completed with an error.
+  resolved,  //!< Function completed successfully.
+  rejected,  //!< Function completed with an error.
+  timed_out, //!< Function did not complete before the deadline.
 };
 
 
@@ -84,6 +120,16 @@ struct settled final
     , error{std::move(error)}
   {}
 
+  /**
+   * @brief Constructor of rejected or timed out object.
+   * @param type - Either @ref settle_type::rejected or @ref settle_type::timed_out.
+   * @param error - Function call error.
+   */
+  settled(settle_type type, std::exception_ptr error)
+    : type{type}
+    , error{std::move(error)}
+  {}
+
   settled(const settled& other)
     : type{other.type}
   {
@@ -167,6 +213,11 @@ struct settled<void> final
     , error{std::move(error)}
   {}
 
+  settled(settle_type type, std::exception_ptr error)
+    : type{type}
+    , error{std::move(error)}
+  {}
+
   void swap(settled& other) noexcept
   {
     std::swap(*this, other);
@@ -184,2548 +235,5204 @@ struct settled<void> final
 };
 
 
-namespace internal
-{
-
-#if __cplusplus < 201703L
-
-template<std::size_t... indexes>
-struct index_sequence
+/**
+ * @brief Retry policy of @ref async::promise::retry call.
+ *        A delay before an attempt grows exponentially and is randomly shortened by the jitter fraction.
+ */
+struct retry_policy final
 {
-  static std::size_t size()
-  {
-    return sizeof...(indexes);
-  }
-};
-
+  /**
+   * @brief Maximum number of attempts including the first one.
+   */
+  std::size_t max_attempts = 3;
 
-template<std::size_t index, std::size_t... indexes>
-struct make_index_sequence_helper;
+  /**
+   * @brief Delay before the second attempt.
+   */
+  std::chrono::milliseconds initial_delay{100};
 
+  /**
+   * @brief Upper bound of a delay between attempts.
+   */
+  std::chrono::milliseconds max_delay{10000};
 
-template<size_t... indexes>
-struct make_index_sequence_helper<0, indexes...>
-{
-  using type = index_sequence<indexes...>;
-};
+  /**
+   * @brief Factor the delay is multiplied by for each next attempt.
+   */
+  double multiplier = 2.0;
 
+  /**
+   * @brief Fraction of a delay that is randomized, from 0 (no jitter) to 1 (full jitter).
+   */
+  double jitter = 0.5;
 
-template<std::size_t index, std::size_t... indexes>
-struct make_index_sequence_helper
-{
-  using type = typename make_index_sequence_helper<index - 1, index - 1, indexes...>::type;
+  /**
+   * @brief Predicate that decides whether an error is retried. All errors are retried if empty.
+   */
+  std::function<bool(const std::exception_ptr&)> retry_on;
 };
 
 
-template<std::size_t length>
-struct make_index_sequence : public make_index_sequence_helper<length>::type{};
-
-
-template<typename Func, typename Tuple, std::size_t... I>
-auto apply(Func&& func, Tuple&& tuple, index_sequence<I...>) -> decltype(func(std::get<I>(std::forward<Tuple>(tuple))...))
+/**
+ * @brief Adaptive limit of functions that fan-out stages run at once.
+ *        The limit grows additively while the latency of functions is stable and shrinks
+ *        multiplicatively when the latency grows or functions are rejected (AIMD).
+ *        A limiter can be shared by any number of stages and chains.
+ */
+class concurrency_limiter final
 {
-  return func(std::get<I>(std::forward<Tuple>(tuple))...);
-}
-
+  public:
+    using clock = std::chrono::steady_clock;
 
-template<typename Func, typename Tuple,
-         typename Seq = make_index_sequence<std::tuple_size<typename std::decay<Tuple>::type>::value>>
-auto apply(Func&& func, Tuple&& tuple) -> decltype(apply(std::forward<Func>(func), std::forward<Tuple>(tuple), Seq{}))
-{
-  return apply(std::forward<Func>(func), std::forward<Tuple>(tuple), Seq{});
-}
+    /**
+     * @brief Constructor.
+     * @param initial_limit - Initial number of functions allowed to run at once.
+     * @param min_limit - Lower bound of the limit.
+     * @param max_limit - Upper bound of the limit.
+     * @param backoff_ratio - Factor the limit is multiplied by on latency growth or rejection.
+     * @param latency_tolerance - Ratio to the baseline latency above which the latency is considered as grown.
+     */
+    explicit concurrency_limiter(std::size_t initial_limit = 8, std::size_t min_limit = 1,
+                                 std::size_t max_limit = 1024, double backoff_ratio = 0.9,
+                                 double latency_tolerance = 2.0)
+      : m_min_limit{static_cast<double>(std::max<std::size_t>(min_limit, 1))}
+      , m_max_limit{static_cast<double>(std::max(max_limit, std::max<std::size_t>(min_limit, 1)))}
+      , m_limit{std::min(std::max(static_cast<double>(initial_limit), m_min_limit), m_max_limit)}
+      , m_backoff_ratio{backoff_ratio}
+      , m_latency_tolerance{latency_tolerance}
+    {}
 
+    concurrency_limiter(const concurrency_limiter&) = delete;
+    concurrency_limiter& operator=(const concurrency_limiter&) = delete;
 
-template<typename Func, typename... Args>
-struct is_invocable
-    : std::is_constructible<std::function<void(Args...)>
-    , std::reference_wrapper<typename std::remove_reference<Func>::type>>
-{};
+    /**
+     * @brief Wait until a function is allowed to run and take its place.
+     */
+    void acquire()
+    {
+      std::unique_lock<std::mutex> lock{m_mutex};
+      m_cv.wait(lock, [this] { return m_in_flight < static_cast<std::size_t>(m_limit); });
+      ++m_in_flight;
+    }
 
-#else
-using std::apply;
-using std::is_invocable;
-#endif
+    /**
+     * @brief Wait until a function is allowed to run and take its place, but no longer than the timeout.
+     * @param timeout - Maximum wait duration.
+     * @return True if the place is taken.
+     */
+    template<typename Rep, typename Period>
+    bool try_acquire_for(const std::chrono::duration<Rep, Period>& timeout)
+    {
+      std::unique_lock<std::mutex> lock{m_mutex};
+      if (!m_cv.wait_for(lock, timeout, [this] { return m_in_flight < static_cast<std::size_t>(m_limit); }))
+        return false;
 
+      ++m_in_flight;
+      return true;
+    }
 
-template<typename Result>
-struct task
-{
-  task() = default;
-  task(const task&) = default;
-  task(task&&) = default;
-  task& operator=(const task&) = default;
-  task& operator=(task&&) = default;
-  virtual ~task() = default;
+    /**
+     * @brief Give the place back and adjust the limit.
+     * @param latency - Duration of the function call.
+     * @param resolved - Whether the function completed successfully.
+     */
+    void release(clock::duration latency, bool resolved)
+    {
+      {
+        std::lock_guard<std::mutex> lock{m_mutex};
 
-  virtual Result run() = 0;
-};
+        auto saturated = static_cast<std::size_t>(m_limit) <= m_in_flight;
+        --m_in_flight;
 
+        auto now = clock::now();
+        auto sample = std::chrono::duration<double>(latency).count();
+        if (resolved && 0.0 == m_baseline)
+          m_baseline = sample;
 
-template<typename T>
-using task_ptr = std::shared_ptr<task<T>>;
+        if (!resolved || m_baseline * m_latency_tolerance < sample)
+        {
+          // Back off at most once per latency interval: calls started before the previous backoff
+          // have already been accounted for.
+          if (m_last_backoff <= now - latency)
+          {
+            m_limit = std::max(m_min_limit, m_limit * m_backoff_ratio);
+            m_last_backoff = now;
+          }
+        }
+        else if (saturated)
+        {
+          m_limit = std::min(m_max_limit, m_limit + 1.0 / m_limit);
+        }
 
+        if (resolved)
+          m_baseline += (sample - m_baseline) * baseline_smoothing;
+      }
 
-struct promise_helper
-{
-  static void resolve(std::promise<void>& promise)
-  {
-    try
-    {
-      promise.set_value();
+      m_cv.notify_all();
     }
-    catch(...)
-    {}
-  }
 
-  template<typename T, typename Value>
-  static void resolve(std::promise<T>& promise, Value&& val)
-  {
-    try
+    /**
+     * @brief Current number of functions allowed to run at once.
+     */
+    std::size_t limit() const
     {
-      promise.set_value(std::forward<Value>(val));
+      std::lock_guard<std::mutex> lock{m_mutex};
+      return static_cast<std::size_t>(m_limit);
     }
-    catch(...)
-    {}
-  }
 
-  template<typename T>
-  static void reject(std::promise<T>& promise, std::exception_ptr err)
-  {
-    try
+    /**
+     * @brief Current number of running functions.
+     */
+    std::size_t in_flight() const
     {
-      promise.set_exception(std::move(err));
+      std::lock_guard<std::mutex> lock{m_mutex};
+      return m_in_flight;
     }
-    catch(...)
-    {}
-  }
+
+  private:
+    static constexpr double baseline_smoothing = 0.05;
+
+    const double m_min_limit;
+    const double m_max_limit;
+    double m_limit;
+    const double m_backoff_ratio;
+    const double m_latency_tolerance;
+    double m_baseline = 0.0;
+    std::size_t m_in_flight = 0;
+    clock::time_point m_last_backoff;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
 };
 
 
-struct vector_helper
+/**
+ * @brief Token bucket rate limiter for @ref async::promise::throttle stages.
+ *        Tokens are refilled at a constant rate up to the burst size. Implemented as the generic cell
+ *        rate algorithm, so sharing one limiter among all chains hitting a backend costs an atomic
+ *        compare-and-swap per token and callers are served in the order of their requests.
+ */
+class rate_limiter final
 {
-  template<typename T>
-  static std::vector<T> create_vector(std::size_t reserve_size)
-  {
-    std::vector<T> v;
-    v.reserve(reserve_size);
-    return v;
-  }
+  public:
+    using clock = std::chrono::steady_clock;
 
-  template<typename T>
-  static void reserve(T&, std::size_t)
-  {}
+    /**
+     * @brief Constructor. A rate so low that the time between tokens does not fit into the clock
+     *        is clamped to the longest time the clock can hold.
+     * @param rate - Number of tokens refilled per second, positive and finite.
+     * @param burst - Maximum number of tokens available at once.
+     * @throw std::invalid_argument if the rate is not positive or not finite.
+     */
+    explicit rate_limiter(double rate, std::size_t burst = 1)
+      : m_interval{interval(rate)}
+      , m_tolerance{tolerance(m_interval, burst)}
+      , m_tat{clock::now().time_since_epoch().count()}
+    {}
 
-  template<typename T>
-  static void reserve(std::vector<T>& v, std::size_t n)
-  {
-    v.reserve(n);
-  }
-};
+    rate_limiter(const rate_limiter&) = delete;
+    rate_limiter& operator=(const rate_limiter&) = delete;
 
+    /**
+     * @brief Take a token, possibly ahead of time.
+     * @return Time point when the taken token becomes available.
+     */
+    clock::time_point reserve()
+    {
+      auto now = clock::now().time_since_epoch().count();
+      auto tat = m_tat.load(std::memory_order_relaxed);
+      clock::rep start;
+      do
+      {
+        start = std::max(tat, now);
+      }
+      while (!m_tat.compare_exchange_weak(tat, add(start, m_interval), std::memory_order_relaxed));
 
-template<typename T>
-struct class_method_call_helper
-{
-  template<typename Method, typename Class, typename Tuple>
-  static T call(Method&& method, Class* obj, Tuple&& tpl)
-  {
-    using tuple_t = typename std::decay<Tuple>::type;
-    using impl_t = impl<Method, Class, Tuple, 0 == std::tuple_size<tuple_t>::value, std::tuple_size<tuple_t>::value>;
-    return impl_t::call(std::forward<Method>(method), obj, std::forward<Tuple>(tpl));
-  }
+      return clock::time_point{clock::duration{std::max(now, start - m_tolerance)}};
+    }
 
-  template<typename Method, typename Class, typename Tuple, bool Enough, int TotalArgs, int... N>
-  struct impl
-  {
-    static T call(Method&& method, Class* obj, Tuple&& tpl)
+    /**
+     * @brief Take a token if it is available right now.
+     * @return True if the token is taken.
+     */
+    bool try_acquire()
     {
-      using impl_t = impl<Method, Class, Tuple, TotalArgs == 1 + sizeof...(N), TotalArgs, N..., sizeof...(N)>;
-      return impl_t::call(std::forward<Method>(method), obj, std::forward<Tuple>(tpl));
+      auto now = clock::now().time_since_epoch().count();
+      auto tat = m_tat.load(std::memory_order_relaxed);
+      clock::rep start;
+      do
+      {
+        start = std::max(tat, now);
+        if (now < start - m_tolerance)
+          return false;
+      }
+      while (!m_tat.compare_exchange_weak(tat, add(start, m_interval), std::memory_order_relaxed));
+
+      return true;
     }
-  };
 
-  template<typename Method, typename Class, typename Tuple, int TotalArgs, int... N>
-  struct impl<Method, Class, Tuple, true, TotalArgs, N...>
-  {
-    static T call(Method&& method, Class* obj, Tuple&& tpl)
+  private:
+    static clock::rep interval(double rate)
     {
-      return (obj->*method)(std::get<N>(std::forward<Tuple>(tpl))...);
-    }
-  };
-};
+      if (!std::isfinite(rate) || rate <= 0.0)
+        throw std::invalid_argument{"Rate must be positive and finite"};
 
+      auto interval = std::chrono::duration<double, clock::period>{std::chrono::duration<double>{1.0 / rate}}.count();
+      if (!(interval < static_cast<double>(std::numeric_limits<clock::rep>::max())))
+        return std::numeric_limits<clock::rep>::max();
 
-template<typename Derived>
-class iterable_base
-{
-  protected:
-    void async_run()
-    {
-      auto futures = vector_helper::create_vector<std::future<void>>(iterable_size());
-      async_run(futures);
+      return static_cast<clock::rep>(interval);
     }
 
-    std::size_t iterable_size() const
+    static clock::rep tolerance(clock::rep interval, std::size_t burst)
     {
-      return static_cast<const Derived*>(this)->iterable_size();
+      auto tokens = std::max<std::size_t>(burst, 1) - 1;
+      if (0 == interval || 0 == tokens)
+        return 0;
+
+      if (static_cast<std::size_t>(std::numeric_limits<clock::rep>::max() / interval) < tokens)
+        return std::numeric_limits<clock::rep>::max();
+
+      return interval * static_cast<clock::rep>(tokens);
     }
 
-  private:
-    void async_run(std::vector<std::future<void>>& futures)
+    // Tokens reserved ahead with a clamped interval saturate instead of overflowing the clock
+    static clock::rep add(clock::rep time, clock::rep interval) noexcept
     {
-      static_cast<Derived*>(this)->async_run(futures);
+      return time < std::numeric_limits<clock::rep>::max() - interval ? time + interval : std::numeric_limits<clock::rep>::max();
     }
+
+    const clock::rep m_interval;
+    const clock::rep m_tolerance;
+    std::atomic<clock::rep> m_tat;
 };
 
 
-template<typename Result, typename Method, typename Class, typename... Args>
-class initial_class_task final : public task<Result>
+/**
+ * @brief Kind of a stage of a chain.
+ */
+enum class stage_kind
 {
-  public:
-    template<typename Method_, typename... Args_>
-    initial_class_task(Method_&& method, Class* obj, Args_&&... args)
-      : m_method{std::forward<Method_>(method)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
-    {}
-
-    Result run() final
-    {
-      return class_method_call_helper<Result>::call(m_method, m_obj, m_args);
-    }
-
-  private:
-    Method m_method;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+  initial,     //!< Initial function, resolved or rejected value.
+  then,        //!< @ref async::promise::then stage.
+  fail,        //!< @ref async::promise::fail stage.
+  finally,     //!< @ref async::promise::finally stage.
+  all,         //!< @ref async::promise::all stage or @ref async::make_promise_all.
+  all_settled, //!< @ref async::promise::all_settled stage or @ref async::make_promise_all_settled.
+  any,         //!< @ref async::promise::any stage or @ref async::make_promise_any.
+  race,        //!< @ref async::promise::race stage or @ref async::make_promise_race.
+  delay,       //!< @ref async::promise::delay stage.
+  throttle,    //!< @ref async::promise::throttle stage.
+  retry,       //!< @ref async::promise::retry stage.
+  some,        //!< @ref async::promise::some stage or @ref async::make_promise_some.
 };
 
 
-template<typename Method, typename Class, typename... Args>
-class initial_class_task<void, Method, Class, Args...> final : public task<void>
+/**
+ * @brief Get the name of a stage kind.
+ * @param kind - Stage kind.
+ * @return Name of the stage kind, the same as the name of the corresponding promise method.
+ */
+static const char* stage_kind_name(stage_kind kind)
 {
-  public:
-    template<typename Method_, typename... Args_>
-    initial_class_task(Method_&& method, Class* obj, Args_&&... args)
-      : m_method{std::forward<Method_>(method)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+  switch (kind)
+  {
+    case stage_kind::initial:
+      return "initial";
+    case stage_kind::then:
+      return "then";
+    case stage_kind::fail:
+      return "fail";
+    case stage_kind::finally:
+      return "finally";
+    case stage_kind::all:
+      return "all";
+    case stage_kind::all_settled:
+      return "all_settled";
+    case stage_kind::any:
+      return "any";
+    case stage_kind::race:
+      return "race";
+    case stage_kind::delay:
+      return "delay";
+    case stage_kind::throttle:
+      return "throttle";
+    case stage_kind::retry:
+      return "retry";
+    case stage_kind::some:
+      return "some";
+  }
 
-    void run() final
-    {
-      class_method_call_helper<void>::call(m_method, m_obj, m_args);
-    }
+  return "stage";
+}
 
-  private:
-    Method m_method;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+
+/**
+ * @brief Event passed to an @ref observer.
+ */
+struct stage_event final
+{
+  using clock = std::chrono::steady_clock;
+
+  const void* stage;        //!< Identity of the stage, the same for all runs of a chain.
+  const void* parent;       //!< Stage that ran the stage or started the function, nullptr if none.
+  std::uint64_t chain;      //!< Number of the chain run the event belongs to, unique in the process.
+  const char* name;         //!< Name of the stage, see @ref async::promise::name, empty if not set.
+  stage_kind kind;          //!< Kind of the stage.
+  std::uint64_t element;    //!< Identity of the function for spawn and settle events, zero for other events.
+  std::thread::id thread;   //!< Thread the event happened in.
+  clock::time_point start;  //!< Start of the stage, the spawn or the function call.
+  clock::duration duration; //!< Duration of the stage, the spawn or the function call, zero on start.
+  clock::duration wait;     //!< Time from the spawn to the function call, zero for other events.
+  settle_type outcome;      //!< Outcome of the stage or the function call, resolved for other events.
 };
 
 
-template<typename Result, typename Func, typename... Args>
-class initial_func_task final : public task<Result>
+/**
+ * @brief Observer of chain execution, see @ref async::set_observer.
+ *        Stage events are reported by every stage of a chain: a stage starts when its previous
+ *        stage settles, so the duration covers the stage itself only. Spawn and settle events are
+ *        reported for each function of a fan-out stage: a spawn covers starting the function
+ *        in a thread and a settle covers the function call. The callbacks are called concurrently
+ *        from the threads running the chains and must not throw.
+ *        Events are reported only if the library is compiled with ASYNC_PROMISE_INSTRUMENTATION defined,
+ *        otherwise the hooks compile to nothing.
+ */
+class observer
 {
   public:
-    template<typename Func_, typename... Args_>
-    explicit initial_func_task(Func_&& func, Args_&&... args)
-      : m_func{std::forward<Func_>(func)}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+    virtual ~observer() = default;
 
-    Result run() final
-    {
-      return apply(m_func, m_args);
-    }
+    /**
+     * @brief Called when a stage starts.
+     * @param event - Stage event.
+     */
+    virtual void on_stage_start(const stage_event& /*event*/) {}
 
-  private:
-    Func m_func;
-    std::tuple<Args...> m_args;
-};
+    /**
+     * @brief Called when a stage settles.
+     * @param event - Stage event.
+     */
+    virtual void on_stage_end(const stage_event& /*event*/) {}
 
+    /**
+     * @brief Called when a fan-out stage has started a function.
+     * @param event - Stage event.
+     */
+    virtual void on_spawn(const stage_event& /*event*/) {}
 
-template<typename Func, typename... Args>
-class initial_func_task<void, Func, Args...> final : public task<void>
-{
-  public:
-    template<typename Func_, typename... Args_>
-    explicit initial_func_task(Func_&& func, Args_&&... args)
-      : m_func{std::forward<Func_>(func)}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+    /**
+     * @brief Called when a function started by a fan-out stage settles.
+     * @param event - Stage event.
+     */
+    virtual void on_settle(const stage_event& /*event*/) {}
+};
 
-    void run() final
-    {
-      apply(m_func, m_args);
-    }
 
-  private:
-    Func m_func;
-    std::tuple<Args...> m_args;
+/**
+ * @brief Process-wide runtime statistics, see @ref async::get_runtime_stats.
+ *        Counted only if the library is compiled with ASYNC_PROMISE_INSTRUMENTATION defined.
+ */
+struct runtime_stats final
+{
+  std::uint64_t threads_created;      //!< Threads started by std::async for chains and fan-out functions and by thread pools.
+  std::uint64_t tasks_run;            //!< Stages run.
+  std::uint64_t elements_launched;    //!< Functions started by fan-out stages.
+  std::uint64_t waits;                //!< Waits of stages that blocked on a future or a timer.
+  std::chrono::nanoseconds wait_time; //!< Total duration of the blocking waits.
+  std::uint64_t errors_swallowed;     //!< Errors swallowed when settling a promise that was already settled.
+  std::uint64_t chains_in_flight;     //!< Chains running right now.
 };
 
 
-template<typename Result, typename PriorResult>
-class next_task : public task<Result>
+/**
+ * @brief State of a running chain, see @ref async::get_chains.
+ */
+struct chain_info final
+{
+  std::uint64_t id;                //!< Chain number in the order chains were started.
+  std::thread::id thread;          //!< Thread running the chain, the one that started it for a chain with waiting stages.
+  std::chrono::nanoseconds age;    //!< Time since the chain was started.
+  std::vector<std::string> stages; //!< Stage names from the first stage to the last one, unnamed stages have the name of their kind.
+  std::size_t current;             //!< Index of the innermost running stage in stages, or the size of stages if no stage is running.
+  std::uint64_t outstanding;       //!< Fan-out functions launched and not finished yet.
+  std::uint64_t allocations;       //!< Heap allocations made by the chain, see @ref async::set_allocation_tracking.
+  std::uint64_t allocated_bytes;   //!< Bytes allocated by the chain.
+};
+
+
+/**
+ * @brief Number and size of heap allocations.
+ */
+struct allocation_stats final
+{
+  std::uint64_t allocations; //!< Number of allocations.
+  std::uint64_t bytes;       //!< Allocated bytes.
+};
+
+
+/**
+ * @brief Heap allocations made by the stages of one kind, see @ref async::get_allocation_stats.
+ */
+struct stage_allocations final
+{
+  stage_kind kind;          //!< Stage kind.
+  allocation_stats library; //!< Allocations of the library: building the stages, spawning and joining functions, results.
+  allocation_stats user;    //!< Allocations made while the functions of the stages ran.
+};
+
+
+/**
+ * @brief Error thrown by a promise whose function is rejected by a full @ref thread_pool queue.
+ */
+struct overload_error final : public std::exception
+{
+  /**
+   * @brief Returns the explanatory string.
+   * @return Pointer to a null-terminated string with explanatory information.
+   */
+  const char* what() const noexcept final
+  {
+    return "Thread pool queue is full";
+  }
+};
+
+
+/**
+ * @brief Error of a function that did not complete before the deadline of @ref async::promise::all_settled_within.
+ */
+struct timeout_error final : public std::exception
+{
+  /**
+   * @brief Returns the explanatory string.
+   * @return Pointer to a null-terminated string with explanatory information.
+   */
+  const char* what() const noexcept final
+  {
+    return "Function timed out";
+  }
+};
+
+
+/**
+ * @brief Behaviour of a @ref thread_pool when its queue is full.
+ */
+enum class overflow_policy
+{
+  block,
+  reject,
+  run_inline,
+};
+
+
+/**
+ * @brief Options of threads started by the library, see @ref thread_pool and @ref async::set_thread_options.
+ */
+struct thread_options final
+{
+  /**
+   * @brief Thread name prefix. Threads are named "<name>-<index>", truncated to 15 characters on Linux.
+   *        Threads are not named if empty. Threads are named on Linux and macOS only.
+   */
+  std::string name;
+
+  /**
+   * @brief Stack size in bytes, rounded up to the minimum and to the page size. The platform default if zero.
+   *        Applied on POSIX platforms only.
+   */
+  std::size_t stack_size = 0;
+
+  /**
+   * @brief Function called with the thread index in each new thread before it runs anything, for example
+   *        to set the CPU affinity or the scheduling class. Must not throw.
+   */
+  std::function<void(std::size_t)> setup;
+};
+
+
+namespace internal
+{
+
+static constexpr std::size_t cache_line_size = 64;
+
+
+enum class counter : std::size_t
+{
+  threads_created,
+  tasks_run,
+  elements_launched,
+  waits,
+  wait_time,
+  errors_swallowed,
+  chains_started,
+  chains_finished,
+  count,
+};
+
+
+class runtime_counters final
+{
+  public:
+    static void add(counter id, std::uint64_t value = 1) noexcept
+    {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      instance().m_stripes[stripe_index()].values[static_cast<std::size_t>(id)].fetch_add(value, std::memory_order_relaxed);
+#else
+      static_cast<void>(id);
+      static_cast<void>(value);
+#endif
+    }
+
+    static std::uint64_t get(counter id) noexcept
+    {
+      std::uint64_t result = 0;
+      for (const auto& stripe : instance().m_stripes)
+        result += stripe.values[static_cast<std::size_t>(id)].load(std::memory_order_relaxed);
+      return result;
+    }
+
+  private:
+    static constexpr std::size_t stripe_count = 16;
+
+    struct stripe
+    {
+      std::atomic<std::uint64_t> values[static_cast<std::size_t>(counter::count)];
+      char padding[cache_line_size];
+    };
+
+    static runtime_counters& instance() noexcept
+    {
+      static runtime_counters instance;
+      return instance;
+    }
+
+    static std::size_t stripe_index() noexcept
+    {
+      static std::atomic<std::size_t> next{0};
+      static thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % stripe_count;
+      return index;
+    }
+
+    stripe m_stripes[stripe_count];
+};
+
+
+class job final
+{
+  public:
+    job() = default;
+
+    template<typename Func>
+    explicit job(Func&& func)
+    {
+      emplace<typename std::decay<Func>::type>(std::forward<Func>(func));
+    }
+
+    job(job&& other) noexcept
+    {
+      take(other);
+    }
+
+    job& operator=(job&& other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        take(other);
+      }
+      return *this;
+    }
+
+    job(const job&) = delete;
+    job& operator=(const job&) = delete;
+
+    ~job()
+    {
+      reset();
+    }
+
+    void operator()()
+    {
+      m_impl->call();
+    }
+
+    explicit operator bool() const noexcept
+    {
+      return nullptr != m_impl;
+    }
+
+    template<typename Func>
+    Func& get() noexcept
+    {
+      return static_cast<impl<Func>*>(m_impl)->func;
+    }
+
+  private:
+    // Fits a packaged task or a promise with a bound function and a couple of shared pointers,
+    // so submitting them does not allocate
+    static constexpr std::size_t buffer_size = 8 * sizeof(void*);
+
+    struct impl_base
+    {
+      virtual ~impl_base() = default;
+      virtual void call() = 0;
+      virtual impl_base* move_to(void* buffer) noexcept = 0;
+    };
+
+    template<typename Func>
+    struct impl final : public impl_base
+    {
+      template<typename F>
+      explicit impl(F&& f)
+        : func{std::forward<F>(f)}
+      {}
+
+      void call() final
+      {
+        func();
+      }
+
+      impl_base* move_to(void* buffer) noexcept final
+      {
+        return new (buffer) impl{std::move(func)};
+      }
+
+      Func func;
+    };
+
+    template<typename Func>
+    struct fits_buffer
+      : std::integral_constant<bool, sizeof(impl<Func>) <= buffer_size
+                                     && alignof(impl<Func>) <= alignof(std::max_align_t)
+                                     && std::is_nothrow_move_constructible<Func>::value>
+    {};
+
+    template<typename Func, typename F>
+    typename std::enable_if<fits_buffer<Func>::value>::type emplace(F&& func)
+    {
+      m_impl = new (&m_buffer) impl<Func>{std::forward<F>(func)};
+    }
+
+    template<typename Func, typename F>
+    typename std::enable_if<!fits_buffer<Func>::value>::type emplace(F&& func)
+    {
+      m_impl = new impl<Func>{std::forward<F>(func)};
+    }
+
+    bool stored_inline() const noexcept
+    {
+      return static_cast<const void*>(m_impl) == static_cast<const void*>(&m_buffer);
+    }
+
+    void take(job& other) noexcept
+    {
+      if (!other.stored_inline())
+      {
+        m_impl = other.m_impl;
+        other.m_impl = nullptr;
+        return;
+      }
+
+      m_impl = other.m_impl->move_to(&m_buffer);
+      other.reset();
+    }
+
+    void reset() noexcept
+    {
+      if (stored_inline())
+        m_impl->~impl_base();
+      else
+        delete m_impl;
+      m_impl = nullptr;
+    }
+
+    impl_base* m_impl = nullptr;
+    typename std::aligned_storage<buffer_size, alignof(std::max_align_t)>::type m_buffer;
+};
+
+
+class native_thread final
+{
+  public:
+    native_thread() = default;
+
+    native_thread(const thread_options& options, std::size_t index, job func);
+
+    native_thread(native_thread&& other) noexcept
+    {
+      swap(other);
+    }
+
+    native_thread& operator=(native_thread&& other) noexcept
+    {
+      if (joinable())
+        std::terminate();
+
+      swap(other);
+      return *this;
+    }
+
+    native_thread(const native_thread&) = delete;
+    native_thread& operator=(const native_thread&) = delete;
+
+    ~native_thread()
+    {
+      if (joinable())
+        std::terminate();
+    }
+
+    bool joinable() const noexcept
+    {
+#ifdef ASYNC_PROMISE_PTHREAD
+      return m_joinable;
+#else
+      return m_thread.joinable();
+#endif
+    }
+
+    void join();
+
+    void detach();
+
+  private:
+    struct start_data
+    {
+      std::string name;
+      std::function<void(std::size_t)> setup;
+      std::size_t index;
+      job func;
+    };
+
+    void swap(native_thread& other) noexcept
+    {
+#ifdef ASYNC_PROMISE_PTHREAD
+      std::swap(m_handle, other.m_handle);
+      std::swap(m_joinable, other.m_joinable);
+#else
+      std::swap(m_thread, other.m_thread);
+#endif
+    }
+
+    static void run(start_data& data);
+
+#ifdef ASYNC_PROMISE_PTHREAD
+    static void* start(void* arg);
+
+    static std::size_t stack_size(std::size_t size);
+
+    pthread_t m_handle{};
+    bool m_joinable = false;
+#else
+    std::thread m_thread;
+#endif
+};
+
+
+#ifdef ASYNC_PROMISE_DEFINITIONS
+
+ASYNC_PROMISE_DECL native_thread::native_thread(const thread_options& options, std::size_t index, job func)
+{
+  auto name = options.name.empty() ? std::string{} : options.name + '-' + std::to_string(index);
+#ifdef ASYNC_PROMISE_PTHREAD
+  std::unique_ptr<start_data> data{new start_data{std::move(name), options.setup, index, std::move(func)}};
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  if (0 != options.stack_size)
+    pthread_attr_setstacksize(&attr, stack_size(options.stack_size));
+
+  auto err = pthread_create(&m_handle, &attr, &native_thread::start, data.get());
+  pthread_attr_destroy(&attr);
+  if (0 != err)
+    throw std::system_error{err, std::generic_category(), "pthread_create"};
+
+  data.release();
+  m_joinable = true;
+#else
+  auto run = [] (start_data& data) { native_thread::run(data); };
+  m_thread = std::thread{std::bind(run, start_data{std::move(name), options.setup, index, std::move(func)})};
+#endif
+}
+
+
+ASYNC_PROMISE_DECL void native_thread::join()
+{
+#ifdef ASYNC_PROMISE_PTHREAD
+  if (!m_joinable)
+    throw std::system_error{std::make_error_code(std::errc::invalid_argument), "pthread_join"};
+
+  auto err = pthread_join(m_handle, nullptr);
+  if (0 != err)
+    throw std::system_error{err, std::generic_category(), "pthread_join"};
+
+  m_joinable = false;
+#else
+  m_thread.join();
+#endif
+}
+
+
+ASYNC_PROMISE_DECL void native_thread::detach()
+{
+#ifdef ASYNC_PROMISE_PTHREAD
+  if (!m_joinable)
+    throw std::system_error{std::make_error_code(std::errc::invalid_argument), "pthread_detach"};
+
+  pthread_detach(m_handle);
+  m_joinable = false;
+#else
+  m_thread.detach();
+#endif
+}
+
+
+ASYNC_PROMISE_DECL void native_thread::run(start_data& data)
+{
+#if defined(__linux__)
+  if (!data.name.empty())
+    pthread_setname_np(pthread_self(), data.name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+  if (!data.name.empty())
+    pthread_setname_np(data.name.c_str());
+#endif
+
+  if (data.setup)
+    data.setup(data.index);
+
+  data.func();
+}
+
+#ifdef ASYNC_PROMISE_PTHREAD
+
+ASYNC_PROMISE_DECL void* native_thread::start(void* arg)
+{
+  std::unique_ptr<start_data> data{static_cast<start_data*>(arg)};
+  run(*data);
+  return nullptr;
+}
+
+
+ASYNC_PROMISE_DECL std::size_t native_thread::stack_size(std::size_t size)
+{
+  auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  size = std::max(size, static_cast<std::size_t>(PTHREAD_STACK_MIN));
+  return (size + page - 1) / page * page;
+}
+
+#endif
+
+#endif
+
+
+struct thread_helper
+{
+  static std::atomic<const thread_options*>& options() noexcept
+  {
+    static std::atomic<const thread_options*> options{nullptr};
+    return options;
+  }
+
+  template<typename Result, typename Bound>
+  static std::future<Result> spawn(const thread_options& options, Bound bound)
+  {
+    std::packaged_task<Result()> task{std::move(bound)};
+    auto future = task.get_future();
+    start(options, std::move(task));
+    return future;
+  }
+
+  // The function must not throw, nothing catches its exception
+  template<typename Func>
+  static void start(const thread_options& options, Func func)
+  {
+    native_thread{options, next_index().fetch_add(1, std::memory_order_relaxed), job{std::move(func)}}.detach();
+  }
+
+  static std::atomic<std::size_t>& next_index() noexcept
+  {
+    static std::atomic<std::size_t> index{0};
+    return index;
+  }
+};
+
+
+template<typename Result, typename Bound>
+struct promise_call final
+{
+  void operator()()
+  {
+    try
+    {
+      set(std::is_void<Result>{});
+    }
+    catch(...)
+    {
+      promise.set_exception(std::current_exception());
+    }
+  }
+
+  void set(std::false_type)
+  {
+    promise.set_value(bound());
+  }
+
+  void set(std::true_type)
+  {
+    bound();
+    promise.set_value();
+  }
+
+  std::promise<Result> promise;
+  Bound bound;
+};
+
+
+template<typename T>
+class mpmc_queue final
+{
+  public:
+    explicit mpmc_queue(std::size_t capacity)
+      : m_mask{round_up(capacity) - 1}
+      , m_cells{new cell[m_mask + 1]}
+    {
+      for (std::size_t i = 0; i <= m_mask; ++i)
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    bool try_push(T& value)
+    {
+      cell* target;
+      auto pos = m_enqueue_pos.value.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        target = &m_cells[pos & m_mask];
+        auto seq = target->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+        if (0 == diff)
+        {
+          if (m_enqueue_pos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+        }
+        else if (diff < 0)
+        {
+          return false;
+        }
+        else
+        {
+          pos = m_enqueue_pos.value.load(std::memory_order_relaxed);
+        }
+      }
+
+      target->value = std::move(value);
+      target->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool try_pop(T& value)
+    {
+      cell* target;
+      auto pos = m_dequeue_pos.value.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        target = &m_cells[pos & m_mask];
+        auto seq = target->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+        if (0 == diff)
+        {
+          if (m_dequeue_pos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+        }
+        else if (diff < 0)
+        {
+          return false;
+        }
+        else
+        {
+          pos = m_dequeue_pos.value.load(std::memory_order_relaxed);
+        }
+      }
+
+      value = std::move(target->value);
+      target->sequence.store(pos + m_mask + 1, std::memory_order_release);
+      return true;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+      return m_mask + 1;
+    }
+
+    std::size_t size() const noexcept
+    {
+      auto dequeue_pos = m_dequeue_pos.value.load(std::memory_order_relaxed);
+      auto enqueue_pos = m_enqueue_pos.value.load(std::memory_order_relaxed);
+      return enqueue_pos > dequeue_pos ? std::min(enqueue_pos - dequeue_pos, capacity()) : 0;
+    }
+
+  private:
+    struct cell
+    {
+      std::atomic<std::size_t> sequence;
+      T value;
+    };
+
+    struct padded_index
+    {
+      std::atomic<std::size_t> value{0};
+      char padding[cache_line_size - sizeof(std::atomic<std::size_t>)];
+    };
+
+    static std::size_t round_up(std::size_t capacity)
+    {
+      std::size_t result = 2;
+      while (result < capacity)
+        result <<= 1;
+      return result;
+    }
+
+    const std::size_t m_mask;
+    const std::unique_ptr<cell[]> m_cells;
+    char m_padding[cache_line_size];
+    padded_index m_enqueue_pos;
+    padded_index m_dequeue_pos;
+};
+
+} // namespace internal
+
+
+/**
+ * @brief Fixed set of worker threads for fan-out stages of a chain, see @ref async::promise::on.
+ *        Functions are submitted through a bounded lock-free queue, so a burst of fan-outs neither
+ *        grows memory without limit nor contends on a lock. What happens when the queue is full is
+ *        set by the @ref overflow_policy. A worker waiting for nested functions runs queued functions
+ *        meanwhile, so nested fan-outs on the same pool do not deadlock.
+ */
+class thread_pool final
+{
+  public:
+    /**
+     * @brief Constructor.
+     * @param threads - Number of worker threads.
+     * @param queue_size - Maximum number of queued functions, rounded up to a power of two.
+     * @param policy - Behaviour when the queue is full.
+     * @param options - Options of the worker threads. Threads are named "ap-worker-<index>" by default.
+     */
+    explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency(),
+                         std::size_t queue_size = 1024,
+                         overflow_policy policy = overflow_policy::block,
+                         thread_options options = default_options());
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /**
+     * @brief Destructor. Runs the queued functions and joins the worker threads.
+     *        Must not be called from a worker thread.
+     */
+    ~thread_pool();
+
+    /**
+     * @brief Submit a function for execution.
+     * @param func - Function to call.
+     * @param args - Function arguments.
+     * @return Future with the result of the function or @ref overload_error
+     *         if the queue is full and the policy is @ref overflow_policy::reject.
+     */
+    template<typename Func, typename... Args,
+             typename Result = typename std::result_of<typename std::decay<Func>::type(typename std::decay<Args>::type...)>::type>
+    std::future<Result> submit(Func&& func, Args&&... args)
+    {
+      std::packaged_task<Result()> task{std::bind(std::forward<Func>(func), std::forward<Args>(args)...)};
+      auto future = task.get_future();
+      internal::job job{std::move(task)};
+      if (!post(job))
+      {
+        std::promise<Result> promise;
+        promise.set_exception(std::make_exception_ptr(overload_error{}));
+        return promise.get_future();
+      }
+
+      return future;
+    }
+
+    /**
+     * @brief Submit a function for execution. The shared state of the future is allocated with
+     *        the allocator and small functions are queued without allocating, so with a recycling
+     *        allocator such as @ref arena_allocator the submission does not allocate.
+     * @param alloc - Allocator of the shared state.
+     * @param func - Function to call.
+     * @param args - Function arguments.
+     * @return Future with the result of the function or @ref overload_error
+     *         if the queue is full and the policy is @ref overflow_policy::reject.
+     */
+    template<typename Alloc, typename Func, typename... Args,
+             typename Result = typename std::result_of<typename std::decay<Func>::type(typename std::decay<Args>::type...)>::type>
+    std::future<Result> submit(std::allocator_arg_t, const Alloc& alloc, Func&& func, Args&&... args)
+    {
+      using bound_type = decltype(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+      using call_type = internal::promise_call<Result, bound_type>;
+
+      std::promise<Result> promise{std::allocator_arg, alloc};
+      auto future = promise.get_future();
+      internal::job job{call_type{std::move(promise), std::bind(std::forward<Func>(func), std::forward<Args>(args)...)}};
+      if (!post(job))
+        job.get<call_type>().promise.set_exception(std::make_exception_ptr(overload_error{}));
+
+      return future;
+    }
+
+    /**
+     * @brief Submit a function for execution without a future. Small functions are queued without allocating.
+     * @param func - Function to call. It must not throw.
+     * @return False if the queue is full and the policy is @ref overflow_policy::reject.
+     */
+    template<typename Func>
+    bool dispatch(Func&& func)
+    {
+      internal::job job{std::forward<Func>(func)};
+      return post(job);
+    }
+
+    /**
+     * @brief Submit a function for execution without a future if the queue has space. Unlike @ref dispatch,
+     *        a full queue neither blocks the caller nor runs the function inline whatever the overflow policy.
+     * @param func - Function to call. It must not throw.
+     * @return False if the queue is full.
+     */
+    template<typename Func>
+    bool try_dispatch(Func&& func)
+    {
+      internal::job job{std::forward<Func>(func)};
+      if (!m_queue.try_push(job))
+        return false;
+
+      notify_work();
+      return true;
+    }
+
+    /**
+     * @brief Run one queued function in the calling thread. A function run this way may wait and
+     *        run another one in turn, so the nesting is bounded to keep the stack from growing without a limit.
+     * @return True if a function was run, false if the queue is empty or the calling thread
+     *         already runs the maximum number of nested functions.
+     */
+    bool run_one();
+
+    /**
+     * @brief Get the number of worker threads.
+     * @return Number of worker threads.
+     */
+    std::size_t size() const noexcept
+    {
+      return m_threads.size();
+    }
+
+    /**
+     * @brief Get the approximate number of queued functions.
+     * @return Number of queued functions.
+     */
+    std::size_t queue_size() const noexcept
+    {
+      return m_queue.size();
+    }
+
+    /**
+     * @brief Get the maximum number of queued functions.
+     * @return Queue capacity.
+     */
+    std::size_t queue_capacity() const noexcept
+    {
+      return m_queue.capacity();
+    }
+
+    /**
+     * @brief Get the approximate number of worker threads that are not sleeping,
+     *        i.e. running or looking for a function.
+     * @return Number of active worker threads.
+     */
+    std::size_t active() const noexcept
+    {
+      auto sleeping = m_sleeping.load(std::memory_order_relaxed);
+      return sleeping < m_threads.size() ? m_threads.size() - sleeping : 0;
+    }
+
+    /**
+     * @brief Get the thread pool of the calling thread.
+     * @return Thread pool or nullptr if the calling thread is not a worker thread.
+     */
+    static thread_pool* current() noexcept;
+
+  private:
+    static constexpr std::size_t max_nesting = 16;
+
+    static thread_options default_options()
+    {
+      thread_options options;
+      options.name = "ap-worker";
+      return options;
+    }
+
+    bool post(internal::job& job);
+    bool run_next();
+    void work();
+    void stop();
+    void notify_work();
+    void notify_space();
+    static void execute(internal::job& job);
+    static thread_pool*& current_pool() noexcept;
+    static std::size_t& nesting() noexcept;
+
+    internal::mpmc_queue<internal::job> m_queue;
+    const overflow_policy m_policy;
+    std::vector<internal::native_thread> m_threads;
+    std::atomic<std::size_t> m_sleeping{0};
+    std::atomic<std::size_t> m_blocked{0};
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_space_cv;
+};
+
+
+#ifdef ASYNC_PROMISE_DEFINITIONS
+
+ASYNC_PROMISE_DECL thread_pool::thread_pool(std::size_t threads, std::size_t queue_size, overflow_policy policy,
+                                            thread_options options)
+  : m_queue{queue_size}
+  , m_policy{policy}
+{
+  threads = std::max<std::size_t>(threads, 1);
+  m_threads.reserve(threads);
+  try
+  {
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+      m_threads.emplace_back(options, i, internal::job{std::bind(&thread_pool::work, this)});
+      internal::runtime_counters::add(internal::counter::threads_created);
+    }
+  }
+  catch(...)
+  {
+    stop();
+    throw;
+  }
+}
+
+
+ASYNC_PROMISE_DECL thread_pool::~thread_pool()
+{
+  stop();
+}
+
+
+ASYNC_PROMISE_DECL bool thread_pool::run_one()
+{
+  return max_nesting > nesting() && run_next();
+}
+
+
+ASYNC_PROMISE_DECL thread_pool* thread_pool::current() noexcept
+{
+  return current_pool();
+}
+
+
+ASYNC_PROMISE_DECL bool thread_pool::post(internal::job& job)
+{
+  if (m_queue.try_push(job))
+  {
+    notify_work();
+    return true;
+  }
+
+  switch (m_policy)
+  {
+    case overflow_policy::reject:
+      return false;
+    case overflow_policy::run_inline:
+      execute(job);
+      return true;
+    case overflow_policy::block:
+      break;
+  }
+
+  while (!m_queue.try_push(job))
+  {
+    // A worker makes space itself whatever the nesting, the queue could stay full while it waits otherwise
+    if (current() == this && run_next())
+      continue;
+
+    // Every pop is followed by notify_space, which locks the mutex if it sees the blocked count,
+    // so the queue cannot free a cell between the failed push and the wait unnoticed
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_blocked.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_queue.try_push(job))
+    {
+      m_space_cv.wait(lock);
+      m_blocked.fetch_sub(1);
+      continue;
+    }
+
+    m_blocked.fetch_sub(1);
+    break;
+  }
+
+  notify_work();
+  return true;
+}
+
+
+ASYNC_PROMISE_DECL bool thread_pool::run_next()
+{
+  internal::job job;
+  if (!m_queue.try_pop(job))
+    return false;
+
+  notify_space();
+  auto& depth = nesting();
+  ++depth;
+  execute(job);
+  --depth;
+  return true;
+}
+
+
+ASYNC_PROMISE_DECL void thread_pool::work()
+{
+  current_pool() = this;
+  for (;;)
+  {
+    if (run_one())
+      continue;
+
+    std::this_thread::yield();
+    if (run_one())
+      continue;
+
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_sleeping.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    internal::job job;
+    if (m_queue.try_pop(job))
+    {
+      m_sleeping.fetch_sub(1);
+      lock.unlock();
+      notify_space();
+      execute(job);
+      continue;
+    }
+
+    if (m_stop)
+    {
+      m_sleeping.fetch_sub(1);
+      return;
+    }
+
+    m_work_cv.wait(lock);
+    m_sleeping.fetch_sub(1);
+  }
+}
+
+
+ASYNC_PROMISE_DECL void thread_pool::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_stop = true;
+  }
+  m_work_cv.notify_all();
+  for (auto& thread : m_threads)
+    thread.join();
+}
+
+
+ASYNC_PROMISE_DECL void thread_pool::notify_work()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (0 == m_sleeping.load(std::memory_order_relaxed))
+    return;
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_work_cv.notify_one();
+}
+
+
+ASYNC_PROMISE_DECL void thread_pool::notify_space()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (0 == m_blocked.load(std::memory_order_relaxed))
+    return;
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_space_cv.notify_all();
+}
+
+
+ASYNC_PROMISE_DECL void thread_pool::execute(internal::job& job)
+{
+  try
+  {
+    job();
+  }
+  catch(...)
+  {}
+  job = internal::job{};
+}
+
+
+ASYNC_PROMISE_DECL thread_pool*& thread_pool::current_pool() noexcept
+{
+  static thread_local thread_pool* pool = nullptr;
+  return pool;
+}
+
+
+ASYNC_PROMISE_DECL std::size_t& thread_pool::nesting() noexcept
+{
+  static thread_local std::size_t depth = 0;
+  return depth;
+}
+
+#endif
+
+
+/**
+ * @brief Thread-safe recycling pool of fixed-size memory blocks, see @ref arena_allocator.
+ *        Freed blocks are kept for reuse, so once the arena has grown to the peak number
+ *        of blocks in use it no longer allocates. Larger requests are passed to the global
+ *        operator new. The arena must outlive the blocks it gave out.
+ */
+class arena final
+{
+  public:
+    /**
+     * @brief Constructor.
+     * @param block_size - Size of a block in bytes.
+     * @param reserve - Number of blocks to allocate upfront.
+     */
+    explicit arena(std::size_t block_size = 256, std::size_t reserve = 0)
+      : m_block_size{std::max(block_size, sizeof(node))}
+    {
+      for (std::size_t i = 0; i < reserve; ++i)
+        push(::operator new(m_block_size));
+    }
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    ~arena()
+    {
+      while (m_free)
+      {
+        auto next = m_free->next;
+        ::operator delete(m_free);
+        m_free = next;
+      }
+    }
+
+    /**
+     * @brief Allocate memory.
+     * @param size - Size in bytes.
+     * @return Block if the size fits a block, otherwise memory from the global operator new.
+     */
+    void* allocate(std::size_t size)
+    {
+      if (size > m_block_size)
+        return ::operator new(size);
+
+      {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (m_free)
+        {
+          auto block = m_free;
+          m_free = block->next;
+          return block;
+        }
+      }
+
+      return ::operator new(m_block_size);
+    }
+
+    /**
+     * @brief Free memory allocated by the arena.
+     * @param ptr - Memory.
+     * @param size - Size in bytes passed to @ref allocate.
+     */
+    void deallocate(void* ptr, std::size_t size) noexcept
+    {
+      if (size > m_block_size)
+        ::operator delete(ptr);
+      else
+        push(ptr);
+    }
+
+    /**
+     * @brief Get the size of a block.
+     * @return Size in bytes.
+     */
+    std::size_t block_size() const noexcept
+    {
+      return m_block_size;
+    }
+
+  private:
+    struct node
+    {
+      node* next;
+    };
+
+    void push(void* ptr) noexcept
+    {
+      auto block = static_cast<node*>(ptr);
+      std::lock_guard<std::mutex> lock{m_mutex};
+      block->next = m_free;
+      m_free = block;
+    }
+
+    const std::size_t m_block_size;
+    std::mutex m_mutex;
+    node* m_free = nullptr;
+};
+
+
+/**
+ * @brief Allocator taking memory from an @ref arena, e.g. for the shared states of futures
+ *        of @ref promise::run(thread_pool&, const Alloc&) const.
+ */
+template<typename T>
+class arena_allocator
+{
+  public:
+    using value_type = T;
+
+    static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned types are not supported");
+
+    /**
+     * @brief Constructor.
+     * @param memory - Arena. It must outlive the allocator and its copies.
+     */
+    explicit arena_allocator(arena& memory) noexcept
+      : m_arena{&memory}
+    {}
+
+    template<typename U>
+    arena_allocator(const arena_allocator<U>& other) noexcept
+      : m_arena{other.memory()}
+    {}
+
+    T* allocate(std::size_t count)
+    {
+      return static_cast<T*>(m_arena->allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t count) noexcept
+    {
+      m_arena->deallocate(ptr, count * sizeof(T));
+    }
+
+    arena* memory() const noexcept
+    {
+      return m_arena;
+    }
+
+  private:
+    arena* m_arena;
+};
+
+
+template<typename T, typename U>
+bool operator==(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) noexcept
+{
+  return lhs.memory() == rhs.memory();
+}
+
+
+template<typename T, typename U>
+bool operator!=(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) noexcept
+{
+  return !(lhs == rhs);
+}
+
+
+namespace internal
+{
+
+#if __cplusplus < 201703L
+
+template<std::size_t... indexes>
+struct index_sequence
+{
+  static std::size_t size()
+  {
+    return sizeof...(indexes);
+  }
+};
+
+
+template<std::size_t index, std::size_t... indexes>
+struct make_index_sequence_helper;
+
+
+template<size_t... indexes>
+struct make_index_sequence_helper<0, indexes...>
+{
+  using type = index_sequence<indexes...>;
+};
+
+
+template<std::size_t index, std::size_t... indexes>
+struct make_index_sequence_helper
+{
+  using type = typename make_index_sequence_helper<index - 1, index - 1, indexes...>::type;
+};
+
+
+template<std::size_t length>
+struct make_index_sequence : public make_index_sequence_helper<length>::type{};
+
+
+template<typename Func, typename Tuple, std::size_t... I>
+auto apply(Func&& func, Tuple&& tuple, index_sequence<I...>) -> decltype(func(std::get<I>(std::forward<Tuple>(tuple))...))
+{
+  return func(std::get<I>(std::forward<Tuple>(tuple))...);
+}
+
+
+template<typename Func, typename Tuple,
+         typename Seq = make_index_sequence<std::tuple_size<typename std::decay<Tuple>::type>::value>>
+auto apply(Func&& func, Tuple&& tuple) -> decltype(apply(std::forward<Func>(func), std::forward<Tuple>(tuple), Seq{}))
+{
+  return apply(std::forward<Func>(func), std::forward<Tuple>(tuple), Seq{});
+}
+
+
+template<typename Func, typename... Args>
+struct is_invocable
+    : std::is_constructible<std::function<void(Args...)>
+    , std::reference_wrapper<typename std::remove_reference<Func>::type>>
+{};
+
+#else
+using std::apply;
+using std::is_invocable;
+#endif
+
+
+template<typename T>
+struct resolve_helper
+{
+  template<typename Func>
+  static T call(Func& func, bool& resolved)
+  {
+    T result = func();
+    resolved = true;
+    return result;
+  }
+};
+
+
+template<>
+struct resolve_helper<void>
+{
+  template<typename Func>
+  static void call(Func& func, bool& resolved)
+  {
+    func();
+    resolved = true;
+  }
+};
+
+
+struct launch_options
+{
+  std::shared_ptr<concurrency_limiter> limiter;
+  thread_pool* pool = nullptr;
+};
+
+
+class task_base;
+
+
+// Outcome of advancing a waiting stage in a run of a chain by a chain_driver
+enum class wait_step
+{
+  settled, // The result of the stage is set
+  wait,    // The stage is advanced again at the resume time
+  restart, // The earlier waiting stages are advanced again, then the stage at the resume time
+};
+
+
+/**
+ * State of a stage that waits on the timer service in one run of a chain by a chain_driver.
+ */
+class wait_state
+{
+  public:
+    explicit wait_state(const task_base& stage) noexcept
+      : stage{stage}
+    {}
+
+    wait_state(const wait_state&) = delete;
+    wait_state& operator=(const wait_state&) = delete;
+
+    virtual ~wait_state() = default;
+
+    virtual void reset()
+    {
+      resume_at = std::chrono::steady_clock::time_point{};
+      attempt = 1;
+      waited = false;
+      settled = false;
+    }
+
+    const task_base& stage;
+    std::chrono::steady_clock::time_point resume_at;
+    std::size_t attempt = 1;
+    bool waited = false;
+    bool settled = false;
+};
+
+
+class task_base
+{
+  public:
+    task_base() = default;
+    task_base(const task_base&) = default;
+    task_base(task_base&&) = default;
+    task_base& operator=(const task_base&) = default;
+    task_base& operator=(task_base&&) = default;
+    virtual ~task_base() = default;
+
+    void limit(std::shared_ptr<concurrency_limiter> limiter)
+    {
+      m_launch.limiter = std::move(limiter);
+    }
+
+    void on(thread_pool& pool)
+    {
+      m_launch.pool = &pool;
+    }
+
+    void kind(stage_kind kind) noexcept
+    {
+      m_kind = kind;
+    }
+
+    stage_kind kind() const noexcept
+    {
+      return m_kind;
+    }
+
+    void name(std::string name)
+    {
+      m_name = std::move(name);
+    }
+
+    const std::string& name() const noexcept
+    {
+      return m_name;
+    }
+
+    bool chained() const noexcept
+    {
+      return m_chained;
+    }
+
+    virtual const task_base* prior() const noexcept
+    {
+      return nullptr;
+    }
+
+    const launch_options& options() const noexcept
+    {
+      return m_launch;
+    }
+
+    // True if the stage or one of its prior stages waits on the timer service
+    bool waits() const noexcept
+    {
+      return m_waits;
+    }
+
+    // State of the stage in a run of a chain by a chain_driver, nullptr if the stage does not wait
+    virtual std::unique_ptr<wait_state> make_wait() const
+    {
+      return nullptr;
+    }
+
+    // Runs the prior stages and starts the wait of a waiting stage in a run of a chain by a chain_driver
+    virtual wait_step advance(wait_state&) const
+    {
+      return wait_step::settled;
+    }
+
+    using copier = std::shared_ptr<task_base> (*)(const task_base&);
+
+    void copy_with(copier copy) noexcept
+    {
+      m_copy = copy;
+    }
+
+    // A copy of the stage that shares its prior stages, nullptr if the stage is not copyable
+    std::shared_ptr<task_base> copy() const
+    {
+      return m_copy ? m_copy(*this) : nullptr;
+    }
+
+  protected:
+    launch_options m_launch;
+    std::string m_name;
+    stage_kind m_kind = stage_kind::initial;
+    bool m_chained = false;
+    bool m_waits = false;
+    copier m_copy = nullptr;
+};
+
+
+struct chain_record final
+{
+  explicit chain_record(const task_base* last)
+    : last{last}
+  {}
+
+  chain_record(const chain_record&) = delete;
+  chain_record& operator=(const chain_record&) = delete;
+
+  const task_base* const last;
+  std::uint64_t id = 0;
+  std::thread::id thread;
+  std::chrono::steady_clock::time_point start;
+  std::atomic<const task_base*> stage{nullptr};
+  std::atomic<std::uint64_t> outstanding{0};
+  std::atomic<std::uint64_t> allocations{0};
+  std::atomic<std::uint64_t> allocated_bytes{0};
+  bool linked = false;
+  chain_record* prev = nullptr;
+  chain_record* next = nullptr;
+};
+
+
+/**
+ * Intrusive list of the running chains. Chains are linked only while the registry is enabled,
+ * so a disabled registry costs one relaxed load per chain.
+ */
+class chain_registry final
 {
   public:
-    explicit next_task(task_ptr<PriorResult> prior_task)
-      : m_prior_task{std::move(prior_task)}
-    {}
+    chain_registry(const chain_registry&) = delete;
+    chain_registry& operator=(const chain_registry&) = delete;
 
-  protected:
-    task_ptr<PriorResult> m_prior_task;
+    static chain_registry& instance() noexcept
+    {
+      static chain_registry instance;
+      return instance;
+    }
+
+    void enable(bool enabled) noexcept
+    {
+      m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool enabled() const noexcept
+    {
+      return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    static std::uint64_t next_id() noexcept
+    {
+      static std::atomic<std::uint64_t> id{0};
+      return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void add(chain_record& record)
+    {
+      record.thread = std::this_thread::get_id();
+      record.start = std::chrono::steady_clock::now();
+      record.linked = true;
+      std::lock_guard<std::mutex> lock{m_mutex};
+      record.prev = m_head.prev;
+      record.next = &m_head;
+      m_head.prev->next = &record;
+      m_head.prev = &record;
+    }
+
+    void remove(chain_record& record)
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      record.prev->next = record.next;
+      record.next->prev = record.prev;
+    }
+
+    std::vector<chain_info> snapshot() const
+    {
+      std::vector<chain_info> result;
+      std::lock_guard<std::mutex> lock{m_mutex};
+      auto now = std::chrono::steady_clock::now();
+      for (auto record = m_head.next; record != &m_head; record = record->next)
+      {
+        chain_info info{};
+        info.id = record->id;
+        info.thread = record->thread;
+        info.age = std::chrono::duration_cast<std::chrono::nanoseconds>(now - record->start);
+        info.outstanding = record->outstanding.load(std::memory_order_relaxed);
+        info.allocations = record->allocations.load(std::memory_order_relaxed);
+        info.allocated_bytes = record->allocated_bytes.load(std::memory_order_relaxed);
+
+        auto current = record->stage.load(std::memory_order_relaxed);
+        auto found = false;
+        for (auto stage = record->last; stage; stage = stage->prior())
+        {
+          found = found || stage == current;
+          info.current += found ? 0 : 1;
+          info.stages.push_back(stage->name().empty() ? stage_kind_name(stage->kind()) : stage->name());
+        }
+
+        std::reverse(info.stages.begin(), info.stages.end());
+        info.current = found ? info.stages.size() - 1 - info.current : info.stages.size();
+        result.push_back(std::move(info));
+      }
+
+      std::stable_sort(result.begin(), result.end(), [] (const chain_info& a, const chain_info& b)
+      {
+        return a.age > b.age;
+      });
+
+      return result;
+    }
+
+  private:
+    chain_registry()
+      : m_head{nullptr}
+    {
+      m_head.prev = m_head.next = &m_head;
+    }
+
+    mutable std::mutex m_mutex;
+    chain_record m_head;
+    std::atomic<bool> m_enabled{false};
 };
 
 
-template<typename Result, typename PriorResult, typename Method, typename Class>
-class then_class_task final : public next_task<Result, PriorResult>
+class chain_scope final
 {
   public:
-    template<typename Method_>
-    then_class_task(task_ptr<PriorResult> prior_task, Method_&& method, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_method{std::forward<Method_>(method)}
-      , m_obj{obj}
-    {}
+    explicit chain_scope(const task_base& last)
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      : m_record{&last}
+#endif
+    {
+      runtime_counters::add(counter::chains_started);
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      m_record.id = chain_registry::next_id();
+      current() = &m_record;
+      if (chain_registry::instance().enabled())
+        chain_registry::instance().add(m_record);
+#else
+      static_cast<void>(last);
+#endif
+    }
+
+    chain_scope(const chain_scope&) = delete;
+    chain_scope& operator=(const chain_scope&) = delete;
+
+    ~chain_scope()
+    {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      current() = m_parent;
+      if (m_record.linked)
+        chain_registry::instance().remove(m_record);
+#endif
+      runtime_counters::add(counter::chains_finished);
+    }
+
+    static chain_record*& current() noexcept
+    {
+      static thread_local chain_record* record = nullptr;
+      return record;
+    }
+
+    static chain_record* linked() noexcept
+    {
+      auto record = current();
+      return record && record->linked ? record : nullptr;
+    }
+
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+  private:
+    chain_record m_record;
+    chain_record* const m_parent = current();
+#endif
+};
+
+
+/**
+ * Chain run by a chain_driver, whose steps may run on different threads. The chain is counted
+ * and registered once for the whole run and made current on the thread of each step by a step_scope.
+ */
+class driven_chain final
+{
+  public:
+    explicit driven_chain(const task_base& last)
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      : m_record{&last}
+#endif
+    {
+      runtime_counters::add(counter::chains_started);
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      m_record.id = chain_registry::next_id();
+      if (chain_registry::instance().enabled())
+        chain_registry::instance().add(m_record);
+#else
+      static_cast<void>(last);
+#endif
+    }
+
+    driven_chain(const driven_chain&) = delete;
+    driven_chain& operator=(const driven_chain&) = delete;
+
+    ~driven_chain()
+    {
+      finish();
+    }
+
+    void finish() noexcept
+    {
+      if (m_finished)
+        return;
+
+      m_finished = true;
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      if (m_record.linked)
+        chain_registry::instance().remove(m_record);
+#endif
+      runtime_counters::add(counter::chains_finished);
+    }
+
+    class step_scope final
+    {
+      public:
+        explicit step_scope(driven_chain& chain) noexcept
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+          : m_parent{chain_scope::current()}
+        {
+          chain_scope::current() = &chain.m_record;
+        }
+#else
+        {
+          static_cast<void>(chain);
+        }
+#endif
+
+        step_scope(const step_scope&) = delete;
+        step_scope& operator=(const step_scope&) = delete;
+
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+        ~step_scope()
+        {
+          chain_scope::current() = m_parent;
+        }
+
+      private:
+        chain_record* const m_parent;
+#endif
+    };
+
+  private:
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    chain_record m_record;
+#endif
+    bool m_finished = false;
+};
+
+
+enum class allocation_origin : std::size_t
+{
+  library,
+  user,
+  count,
+};
+
+
+/**
+ * Allocation counters per stage kind and origin, striped over cache lines like @ref runtime_counters.
+ * The thread-local context names the stage kind and origin that allocations on the thread are counted to,
+ * allocations outside a context are not counted.
+ */
+class allocation_counters final
+{
+  public:
+    static constexpr std::size_t kind_count = static_cast<std::size_t>(stage_kind::some) + 1;
+
+    struct context_type
+    {
+      bool active;
+      stage_kind kind;
+      allocation_origin origin;
+    };
+
+    static void enable(bool enabled) noexcept
+    {
+      instance().m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool enabled() noexcept
+    {
+      return instance().m_enabled.load(std::memory_order_relaxed);
+    }
+
+    static context_type& context() noexcept
+    {
+      static thread_local context_type context{false, stage_kind::initial, allocation_origin::library};
+      return context;
+    }
+
+    static void record(std::size_t bytes) noexcept
+    {
+      auto& counters = instance();
+      if (!counters.m_enabled.load(std::memory_order_relaxed))
+        return;
+
+      const auto& current = context();
+      if (!current.active)
+        return;
+
+      auto& value = counters.m_stripes[stripe_index()].values[static_cast<std::size_t>(current.kind)][static_cast<std::size_t>(current.origin)];
+      value.allocations.fetch_add(1, std::memory_order_relaxed);
+      value.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+      auto chain = chain_scope::linked();
+      if (chain)
+      {
+        chain->allocations.fetch_add(1, std::memory_order_relaxed);
+        chain->allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+      }
+    }
+
+    static allocation_stats get(stage_kind kind, allocation_origin origin) noexcept
+    {
+      allocation_stats result{};
+      for (const auto& stripe : instance().m_stripes)
+      {
+        const auto& value = stripe.values[static_cast<std::size_t>(kind)][static_cast<std::size_t>(origin)];
+        result.allocations += value.allocations.load(std::memory_order_relaxed);
+        result.bytes += value.bytes.load(std::memory_order_relaxed);
+      }
+      return result;
+    }
+
+    static allocation_origin origin(stage_kind kind) noexcept
+    {
+      switch (kind)
+      {
+        case stage_kind::all:
+        case stage_kind::all_settled:
+        case stage_kind::any:
+        case stage_kind::race:
+        case stage_kind::some:
+        case stage_kind::delay:
+        case stage_kind::throttle:
+          return allocation_origin::library;
+        default:
+          return allocation_origin::user;
+      }
+    }
+
+  private:
+    static constexpr std::size_t stripe_count = 16;
+
+    struct value_type
+    {
+      std::atomic<std::uint64_t> allocations;
+      std::atomic<std::uint64_t> bytes;
+    };
+
+    struct stripe
+    {
+      value_type values[kind_count][static_cast<std::size_t>(allocation_origin::count)];
+      char padding[cache_line_size];
+    };
+
+    static allocation_counters& instance() noexcept
+    {
+      static allocation_counters instance;
+      return instance;
+    }
+
+    static std::size_t stripe_index() noexcept
+    {
+      static std::atomic<std::size_t> next{0};
+      static thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % stripe_count;
+      return index;
+    }
+
+    stripe m_stripes[stripe_count];
+    std::atomic<bool> m_enabled{false};
+};
+
+
+class allocation_scope final
+{
+  public:
+    allocation_scope(stage_kind kind, allocation_origin origin) noexcept
+      : m_previous{allocation_counters::context()}
+    {
+      allocation_counters::context() = allocation_counters::context_type{true, kind, origin};
+    }
+
+    allocation_scope(const allocation_scope&) = delete;
+    allocation_scope& operator=(const allocation_scope&) = delete;
+
+    ~allocation_scope()
+    {
+      allocation_counters::context() = m_previous;
+    }
+
+  private:
+    const allocation_counters::context_type m_previous;
+};
+
+
+struct observer_helper
+{
+  static std::atomic<observer*>& instance() noexcept
+  {
+    static std::atomic<observer*> instance{nullptr};
+    return instance;
+  }
+
+  static observer* get() noexcept
+  {
+    return instance().load(std::memory_order_acquire);
+  }
+
+  static std::uint64_t next_element() noexcept
+  {
+    static std::atomic<std::uint64_t> element{0};
+    return element.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  static stage_event event(const task_base& stage, stage_event::clock::time_point start)
+  {
+    stage_event event{};
+    auto chain = chain_scope::current();
+    event.stage = &stage;
+    event.parent = nullptr;
+    event.chain = chain ? chain->id : 0;
+    event.name = stage.name().c_str();
+    event.kind = stage.kind();
+    event.element = 0;
+    event.thread = std::this_thread::get_id();
+    event.start = start;
+    event.duration = stage_event::clock::duration::zero();
+    event.wait = stage_event::clock::duration::zero();
+    event.outcome = settle_type::resolved;
+    return event;
+  }
+};
+
+
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+class stage_scope final
+{
+  public:
+    explicit stage_scope(const task_base& stage)
+      : m_observer{observer_helper::get()}
+      , m_stage{stage}
+      , m_parent{current()}
+      , m_chain{chain_scope::linked()}
+      , m_chain_stage{m_chain ? m_chain->stage.exchange(&stage, std::memory_order_relaxed) : nullptr}
+    {
+      current() = this;
+      if (!stage.chained())
+        start();
+    }
+
+    stage_scope(const stage_scope&) = delete;
+    stage_scope& operator=(const stage_scope&) = delete;
+
+    ~stage_scope()
+    {
+      current() = m_parent;
+      if (m_chain)
+        m_chain->stage.store(m_chain_stage, std::memory_order_relaxed);
+
+      if (!m_observer)
+        return;
+
+      start();
+      auto event = make_event();
+      event.duration = stage_event::clock::now() - m_start;
+      event.outcome = m_resolved ? settle_type::resolved : settle_type::rejected;
+      m_observer->on_stage_end(event);
+    }
+
+    void start()
+    {
+      if (!m_observer || m_started)
+        return;
+
+      m_started = true;
+      m_start = stage_event::clock::now();
+      m_observer->on_stage_start(make_event());
+    }
+
+    bool& resolved() noexcept
+    {
+      return m_resolved;
+    }
+
+    static stage_scope*& current() noexcept
+    {
+      static thread_local stage_scope* scope = nullptr;
+      return scope;
+    }
 
-    Result run() final
+  private:
+    stage_event make_event() const
     {
-      return (m_obj->*m_method)(this->m_prior_task->run());
+      auto event = observer_helper::event(m_stage, m_start);
+      event.parent = m_parent ? &m_parent->m_stage : nullptr;
+      return event;
     }
 
-  private:
-    Method m_method;
-    Class* const m_obj;
+    observer* const m_observer;
+    const task_base& m_stage;
+    stage_scope* const m_parent;
+    chain_record* const m_chain;
+    const task_base* const m_chain_stage;
+    stage_event::clock::time_point m_start;
+    bool m_started = false;
+    bool m_resolved = false;
 };
 
 
-template<typename Result, typename PriorResult, typename Method, typename Class>
-class then_class_task_void final : public next_task<Result, PriorResult>
+class stage_start_guard final
 {
-public:
-    template<typename Method_>
-    then_class_task_void(task_ptr<PriorResult> prior_task, Method_&& method, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_method{std::forward<Method_>(method)}
-      , m_obj{obj}
-    {}
+  public:
+    stage_start_guard() = default;
+    stage_start_guard(const stage_start_guard&) = delete;
+    stage_start_guard& operator=(const stage_start_guard&) = delete;
 
-    Result run() final
+    ~stage_start_guard()
     {
-      this->m_prior_task->run();
-      return (m_obj->*m_method)();
+      auto scope = stage_scope::current();
+      if (scope)
+        scope->start();
     }
-
-private:
-    Method m_method;
-    Class* const m_obj;
 };
 
 
-template<typename Result, typename PriorResult, typename Func>
-class then_func_task final : public next_task<Result, PriorResult>
+class element_scope final
 {
   public:
-    template<typename Func_>
-    then_func_task(task_ptr<PriorResult> prior_task, Func_&& func)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_func{std::forward<Func_>(func)}
-    {}
+    element_scope(observer& observer, const stage_event& spawn)
+      : m_observer{observer}
+      , m_event{spawn}
+    {
+      m_event.start = stage_event::clock::now();
+      m_event.thread = std::this_thread::get_id();
+      m_event.wait = m_event.start - spawn.start;
+    }
+
+    element_scope(const element_scope&) = delete;
+    element_scope& operator=(const element_scope&) = delete;
+
+    ~element_scope()
+    {
+      m_event.duration = stage_event::clock::now() - m_event.start;
+      m_event.outcome = m_resolved ? settle_type::resolved : settle_type::rejected;
+      m_observer.on_settle(m_event);
+    }
 
-    Result run() final
+    bool& resolved() noexcept
     {
-      return m_func(this->m_prior_task->run());
+      return m_resolved;
     }
 
   private:
-    Func m_func;
+    observer& m_observer;
+    stage_event m_event;
+    bool m_resolved = false;
 };
 
 
-template<typename Result, typename PriorResult, typename Func>
-class then_func_task_void final : public next_task<Result, PriorResult>
+template<typename Bound>
+class observed_call final
 {
   public:
-    template<typename Func_>
-    then_func_task_void(task_ptr<PriorResult> prior_task, Func_&& func)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_func{std::forward<Func_>(func)}
+    observed_call(observer& observer, const stage_event& spawn, Bound bound)
+      : m_observer{&observer}
+      , m_spawn{spawn}
+      , m_bound{std::move(bound)}
     {}
 
-    Result run() final
+    auto operator()() -> decltype(std::declval<Bound&>()())
     {
-      this->m_prior_task->run();
-      return m_func();
+      element_scope scope{*m_observer, m_spawn};
+      return resolve_helper<decltype(m_bound())>::call(m_bound, scope.resolved());
     }
 
   private:
-    Func m_func;
+    observer* m_observer;
+    stage_event m_spawn;
+    Bound m_bound;
 };
 
 
-template<typename Result, typename PriorResult, typename Method, typename Class>
-class fail_class_task final : public next_task<Result, PriorResult>
+template<typename Bound>
+class tracked_call final
 {
   public:
-    template<typename Method_>
-    fail_class_task(task_ptr<PriorResult> prior_task, Method_&& method, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_method{std::forward<Method_>(method)}
-      , m_obj{obj}
-    {}
+    tracked_call(chain_record* chain, stage_kind kind, Bound bound)
+      : m_chain{chain}
+      , m_kind{kind}
+      , m_bound{std::move(bound)}
+    {
+      if (chain)
+        chain->outstanding.fetch_add(1, std::memory_order_relaxed);
+    }
 
-    Result run() final
+    tracked_call(const tracked_call&) = delete;
+    tracked_call& operator=(const tracked_call&) = delete;
+
+    tracked_call(tracked_call&& other)
+      : m_chain{other.m_chain}
+      , m_kind{other.m_kind}
+      , m_bound{std::move(other.m_bound)}
     {
-      try
-      {
-        return this->m_prior_task->run();
-      }
-      catch(...)
-      {
-        return (m_obj->*m_method)(std::current_exception());
-      }
+      other.m_chain = nullptr;
+    }
+
+    ~tracked_call()
+    {
+      finish();
+    }
+
+    auto operator()() -> decltype(std::declval<Bound&>()())
+    {
+      call_guard guard{*this};
+      return m_bound();
     }
 
   private:
-    Method m_method;
-    Class* const m_obj;
-};
+    class call_guard final
+    {
+      public:
+        explicit call_guard(tracked_call& call) noexcept
+          : m_call{call}
+          , m_chain{chain_scope::current()}
+          , m_allocations{call.m_kind, allocation_origin::user}
+        {
+          chain_scope::current() = call.m_chain;
+        }
 
+        call_guard(const call_guard&) = delete;
+        call_guard& operator=(const call_guard&) = delete;
 
-template<typename Result, typename PriorResult, typename Method, typename Class>
-class fail_class_task_void final : public next_task<Result, PriorResult>
-{
-  public:
-    template<typename Method_>
-    fail_class_task_void(task_ptr<PriorResult> prior_task, Method_&& method, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_method{std::forward<Method_>(method)}
-      , m_obj{obj}
-    {}
+        ~call_guard()
+        {
+          chain_scope::current() = m_chain;
+          m_call.finish();
+        }
 
-    Result run() final
+      private:
+        tracked_call& m_call;
+        chain_record* const m_chain;
+        allocation_scope m_allocations;
+    };
+
+    void finish() noexcept
     {
-      try
-      {
-        return this->m_prior_task->run();
-      }
-      catch(...)
-      {
-        return (m_obj->*m_method)();
-      }
+      if (m_chain)
+        m_chain->outstanding.fetch_sub(1, std::memory_order_relaxed);
+      m_chain = nullptr;
     }
 
-  private:
-    Method m_method;
-    Class* const m_obj;
+    chain_record* m_chain;
+    stage_kind m_kind;
+    Bound m_bound;
 };
 
 
-template<typename Result, typename PriorResult, typename Func>
-class fail_func_task final : public next_task<Result, PriorResult>
+/**
+ * Counts the allocations of a detached function to its stage kind. The function may outlive its chain,
+ * so it runs outside of any chain and is not counted to the chain that launched it.
+ */
+template<typename Func>
+class detached_call final
 {
   public:
-    template<typename Method_>
-    fail_func_task(task_ptr<PriorResult> prior_task, Method_&& func)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_func{std::forward<Method_>(func)}
+    detached_call(stage_kind kind, Func func)
+      : m_kind{kind}
+      , m_func{std::move(func)}
     {}
 
-    Result run() final
+    void operator()()
     {
-      try
-      {
-        return this->m_prior_task->run();
-      }
-      catch(...)
-      {
-        return m_func(std::current_exception());
-      }
+      call_guard guard{m_kind};
+      m_func();
     }
 
   private:
+    class call_guard final
+    {
+      public:
+        explicit call_guard(stage_kind kind) noexcept
+          : m_chain{chain_scope::current()}
+          , m_allocations{kind, allocation_origin::user}
+        {
+          chain_scope::current() = nullptr;
+        }
+
+        call_guard(const call_guard&) = delete;
+        call_guard& operator=(const call_guard&) = delete;
+
+        ~call_guard()
+        {
+          chain_scope::current() = m_chain;
+        }
+
+      private:
+        chain_record* const m_chain;
+        allocation_scope m_allocations;
+    };
+
+    stage_kind m_kind;
     Func m_func;
 };
+#endif
 
 
-template<typename Result, typename PriorResult, typename Func>
-class fail_func_task_void final : public next_task<Result, PriorResult>
+template<typename Result>
+class task : public task_base
 {
   public:
-    template<typename Func_>
-    fail_func_task_void(task_ptr<PriorResult> prior_task, Func_&& func)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_func{std::forward<Func_>(func)}
-    {}
-
-    Result run() final
-    {
-      try
-      {
-        return this->m_prior_task->run();
-      }
-      catch(...)
-      {
-        return m_func();
-      }
+    Result run()
+    {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      runtime_counters::add(counter::tasks_run);
+      allocation_scope allocations{this->kind(), allocation_counters::origin(this->kind())};
+      stage_scope scope{*this};
+      auto run = [this] () -> Result { return run_stage(); };
+      return resolve_helper<Result>::call(run, scope.resolved());
+#else
+      return run_stage();
+#endif
     }
 
-  private:
-    Func m_func;
+  protected:
+    virtual Result run_stage() = 0;
 };
 
 
-template<typename Result, typename PriorResult, typename Method, typename Class>
-class finally_class_task final : public next_task<Result, PriorResult>
+template<typename T>
+using task_ptr = std::shared_ptr<task<T>>;
+
+
+struct task_helper
 {
-  public:
-    template<typename Method_>
-    finally_class_task(task_ptr<PriorResult> prior_task, Method_&& method, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_method{std::forward<Method_>(method)}
-      , m_obj{obj}
-    {}
+  template<typename Task, typename... Args>
+  static std::shared_ptr<Task> make(stage_kind kind, Args&&... args)
+  {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    allocation_scope allocations{kind, allocation_origin::library};
+#endif
+    auto task = std::make_shared<Task>(std::forward<Args>(args)...);
+    task->kind(kind);
+    task->copy_with(copier<Task>(std::is_copy_constructible<Task>{}));
+    return task;
+  }
+
+  // Configuring a stage shared by other promises would change them too, so the stage is copied.
+  // A stage holding a move-only function cannot be copied and is configured in place
+  template<typename T>
+  static std::shared_ptr<task<T>> configurable(const std::shared_ptr<task<T>>& task)
+  {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    allocation_scope allocations{task->kind(), allocation_origin::library};
+#endif
+    auto copy = task->copy();
+    return copy ? std::static_pointer_cast<internal::task<T>>(copy) : task;
+  }
+
+  template<typename Task>
+  static std::shared_ptr<task_base> copy(const task_base& task)
+  {
+    return std::make_shared<Task>(static_cast<const Task&>(task));
+  }
+
+  template<typename Task>
+  static task_base::copier copier(std::true_type) noexcept
+  {
+    return &task_helper::copy<Task>;
+  }
+
+  template<typename Task>
+  static task_base::copier copier(std::false_type) noexcept
+  {
+    return nullptr;
+  }
+};
 
-    Result run() final
+
+struct promise_helper
+{
+  static void resolve(std::promise<void>& promise)
+  {
+    try
     {
-      try
-      {
-        this->m_prior_task->run();
-      }
-      catch(...)
-      {}
+      promise.set_value();
+    }
+    catch(...)
+    {
+      runtime_counters::add(counter::errors_swallowed);
+    }
+  }
 
-      return (m_obj->*m_method)();
+  template<typename T, typename Value>
+  static void resolve(std::promise<T>& promise, Value&& val)
+  {
+    try
+    {
+      promise.set_value(std::forward<Value>(val));
+    }
+    catch(...)
+    {
+      runtime_counters::add(counter::errors_swallowed);
     }
+  }
 
-  private:
-    Method m_method;
-    Class* const m_obj;
+  template<typename Func>
+  static void resolve_with(std::promise<void>& promise, Func&& func)
+  {
+    func();
+    resolve(promise);
+  }
+
+  template<typename T, typename Func>
+  static void resolve_with(std::promise<T>& promise, Func&& func)
+  {
+    resolve(promise, func());
+  }
+
+  template<typename T>
+  static void reject(std::promise<T>& promise, std::exception_ptr err)
+  {
+    try
+    {
+      promise.set_exception(std::move(err));
+    }
+    catch(...)
+    {
+      runtime_counters::add(counter::errors_swallowed);
+    }
+  }
 };
 
 
-template<typename Result, typename PriorResult, typename Func>
-class finally_func_task final : public next_task<Result, PriorResult>
+struct vector_helper
+{
+  template<typename T>
+  static void reserve(T&, std::size_t)
+  {}
+
+  template<typename T>
+  static void reserve(std::vector<T>& v, std::size_t n)
+  {
+    v.reserve(n);
+  }
+};
+
+
+struct timer_node final
+{
+  std::uint64_t expires = 0;
+  std::function<void()> callback;
+  timer_node* prev = nullptr;
+  timer_node* next = nullptr;
+  std::shared_ptr<timer_node> self;
+};
+
+
+using timer_handle = std::shared_ptr<timer_node>;
+
+
+/**
+ * Hierarchical timing wheel: four levels of 256 slots with a tick of one millisecond.
+ * Insertion and removal are O(1), expired slots are cascaded down a level lazily.
+ * Not thread-safe, guarded by @ref timer_service.
+ */
+class timer_wheel final
 {
   public:
-    template<typename Func_>
-    finally_func_task(task_ptr<PriorResult> prior_task, Func_&& func)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_func{std::forward<Func_>(func)}
-    {}
+    static constexpr unsigned slot_bits = 8;
+    static constexpr std::size_t slot_count = std::size_t{1} << slot_bits;
+    static constexpr std::size_t slot_mask = slot_count - 1;
+    static constexpr std::size_t level_count = 4;
+
+    timer_wheel();
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    ~timer_wheel();
 
-    Result run() final
+    std::uint64_t current() const
     {
-      try
-      {
-        this->m_prior_task->run();
-      }
-      catch(...)
-      {}
+      return m_current;
+    }
 
-      return m_func();
+    bool empty() const
+    {
+      return 0 == m_size;
+    }
+
+    void reset(std::uint64_t tick)
+    {
+      if (empty())
+        m_current = tick;
+    }
+
+    void add(const timer_handle& node)
+    {
+      if (node->expires <= m_current)
+        node->expires = m_current + 1;
+
+      node->self = node;
+      link(node.get());
+      ++m_size;
+    }
+
+    bool remove(const timer_handle& node)
+    {
+      if (!node->self)
+        return false;
+
+      unlink(node.get());
+      node->self.reset();
+      --m_size;
+      return true;
     }
 
+    void advance(std::vector<timer_handle>& expired);
+
+    std::uint64_t next_tick() const;
+
   private:
-    Func m_func;
+    void link(timer_node* node);
+
+    static timer_node* unlink(timer_node* node)
+    {
+      node->prev->next = node->next;
+      node->next->prev = node->prev;
+      node->prev = node->next = nullptr;
+      return node;
+    }
+
+    void cascade(timer_node& head);
+
+    timer_node m_slots[level_count][slot_count];
+    std::uint64_t m_current = 0;
+    std::size_t m_size = 0;
 };
 
 
-template<typename Result, typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class all_class_task final : public next_task<Result, PriorResult>
+#ifdef ASYNC_PROMISE_DEFINITIONS
+
+ASYNC_PROMISE_DECL timer_wheel::timer_wheel()
+{
+  for (auto& level : m_slots)
+    for (auto& slot : level)
+      slot.prev = slot.next = &slot;
+}
+
+
+ASYNC_PROMISE_DECL timer_wheel::~timer_wheel()
+{
+  for (auto& level : m_slots)
+    for (auto& slot : level)
+      while (slot.next != &slot)
+        unlink(slot.next)->self.reset();
+}
+
+
+ASYNC_PROMISE_DECL void timer_wheel::advance(std::vector<timer_handle>& expired)
+{
+  auto tick = ++m_current;
+
+  auto level = std::size_t{0};
+  while (level + 1 < level_count && 0 == (tick & ((std::uint64_t{1} << (slot_bits * (level + 1))) - 1)))
+    ++level;
+
+  for (; 0 < level; --level)
+    cascade(m_slots[level][(tick >> (slot_bits * level)) & slot_mask]);
+
+  auto& slot = m_slots[0][tick & slot_mask];
+  while (slot.next != &slot)
+  {
+    auto node = unlink(slot.next);
+    expired.push_back(std::move(node->self));
+    --m_size;
+  }
+}
+
+
+ASYNC_PROMISE_DECL std::uint64_t timer_wheel::next_tick() const
 {
-  public:
-    all_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
+  auto tick = m_current + 1;
+  auto boundary = ((m_current >> slot_bits) + 1) << slot_bits;
+  for (; tick < boundary; ++tick)
+  {
+    const auto& slot = m_slots[0][tick & slot_mask];
+    if (slot.next != &slot)
+      return tick;
+  }
 
-    Result run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<typename Result::value_type>>(m_methods.size());
-      auto rv = this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj, rv));
+  return boundary;
+}
 
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
-      for (auto& future : futures)
-        result.push_back(future.get());
 
-      return result;
-    }
+ASYNC_PROMISE_DECL void timer_wheel::link(timer_node* node)
+{
+  auto delta = node->expires - m_current;
+  auto level = std::size_t{0};
+  while (level + 1 < level_count && delta >= (std::uint64_t{1} << (slot_bits * (level + 1))))
+    ++level;
+
+  auto index = delta < (std::uint64_t{1} << (slot_bits * level_count))
+      ? (node->expires >> (slot_bits * level)) & slot_mask
+      : ((m_current >> (slot_bits * level)) + slot_mask) & slot_mask;
+
+  auto& head = m_slots[level][index];
+  node->prev = head.prev;
+  node->next = &head;
+  head.prev->next = node;
+  head.prev = node;
+}
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-};
 
+ASYNC_PROMISE_DECL void timer_wheel::cascade(timer_node& head)
+{
+  while (head.next != &head)
+    link(unlink(head.next));
+}
+
+#endif
 
-template<typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class all_class_task<void, PriorResult, Container, Method, Alloc, Class> final
-    : public next_task<void, PriorResult>
+
+/**
+ * Process-wide timer service. A single lazily started thread drives the @ref timer_wheel
+ * and invokes expired callbacks outside the lock, so callbacks must be short.
+ */
+class timer_service final
 {
   public:
-    all_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<void, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
+    using clock = std::chrono::steady_clock;
+
+    static timer_service& instance();
+
+    timer_service(const timer_service&) = delete;
+    timer_service& operator=(const timer_service&) = delete;
+
+    ~timer_service();
 
-    void run() final
+    template<typename Rep, typename Period>
+    timer_handle schedule(std::chrono::duration<Rep, Period> delay, std::function<void()> callback)
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_methods.size());
-      auto rv = this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj, rv));
-      for (auto& future : futures)
-        future.get();
+      return schedule_at(clock::now() + delay, std::move(callback));
     }
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-};
+    timer_handle schedule_at(clock::time_point time, std::function<void()> callback);
 
+    bool cancel(const timer_handle& node);
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Method, typename Alloc, typename Class>
-class all_class_task_void final : public next_task<Result, PriorResult>
-{
-  public:
-    all_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
+  private:
+    timer_service()
+      : m_epoch{clock::now()}
     {}
 
-    Result run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<typename Result::value_type>>(m_methods.size());
-      this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj));
-
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
-      for (auto& future : futures)
-        result.push_back(future.get());
+    std::uint64_t to_tick(clock::time_point time, bool round_up = false) const;
 
-      return result;
-    }
+    void process();
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    const clock::time_point m_epoch;
+    timer_wheel m_wheel;
+    std::uint64_t m_wakeup = UINT64_MAX;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    native_thread m_thread;
 };
 
 
-template<typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class all_class_task_void<void, PriorResult, Container, Method, Alloc, Class> final
-    : public next_task<void, PriorResult>
+#ifdef ASYNC_PROMISE_DEFINITIONS
+
+ASYNC_PROMISE_DECL timer_service& timer_service::instance()
 {
-  public:
-    all_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<void, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
+  static timer_service service;
+  return service;
+}
 
-    void run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_methods.size());
-      this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj));
-      for (auto& future : futures)
-        future.get();
-    }
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-};
+ASYNC_PROMISE_DECL timer_service::~timer_service()
+{
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_stop = true;
+  }
+
+  m_cv.notify_one();
+  if (m_thread.joinable())
+    m_thread.join();
+}
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class all_func_task final : public next_task<Result, PriorResult>
+ASYNC_PROMISE_DECL timer_handle timer_service::schedule_at(clock::time_point time, std::function<void()> callback)
 {
-  public:
-    all_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+  auto node = std::make_shared<timer_node>();
+  node->callback = std::move(callback);
 
-    Result run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<typename Result::value_type>>(m_funcs.size());
-      auto rv = this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func), rv));
+  std::unique_lock<std::mutex> lock{m_mutex};
+  if (!m_thread.joinable())
+  {
+    thread_options options;
+    options.name = "ap-timer";
+    m_thread = native_thread{options, 0, job{std::bind(&timer_service::process, this)}};
+  }
 
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
-      for (auto& future : futures)
-        result.push_back(future.get());
+  m_wheel.reset(to_tick(clock::now()));
+  node->expires = to_tick(time, true);
+  m_wheel.add(node);
 
-      return result;
-    }
+  if (node->expires < m_wakeup)
+  {
+    m_wakeup = node->expires;
+    lock.unlock();
+    m_cv.notify_one();
+  }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
+  return node;
+}
 
 
-template<typename PriorResult, template<typename, typename> class Container, typename Func, typename Alloc>
-class all_func_task<void, PriorResult, Container, Func, Alloc> final : public next_task<void, PriorResult>
+ASYNC_PROMISE_DECL bool timer_service::cancel(const timer_handle& node)
 {
-  public:
-    all_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<void, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return node && m_wheel.remove(node);
+}
 
-    void run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_funcs.size());
-      auto rv = this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func), rv));
-      for (auto& future : futures)
-        future.get();
-    }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
+ASYNC_PROMISE_DECL std::uint64_t timer_service::to_tick(clock::time_point time, bool round_up) const
+{
+  if (time <= m_epoch)
+    return 0;
+
+  auto elapsed = time - m_epoch;
+  auto tick = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+  if (round_up && tick < elapsed)
+    tick += std::chrono::milliseconds{1};
+
+  return static_cast<std::uint64_t>(tick.count());
+}
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class all_func_task_void final : public next_task<Result, PriorResult>
+ASYNC_PROMISE_DECL void timer_service::process()
 {
-  public:
-    all_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+  std::vector<timer_handle> expired;
+  std::unique_lock<std::mutex> lock{m_mutex};
 
-    Result run() final
+  while (!m_stop)
+  {
+    auto now = to_tick(clock::now());
+    while (!m_wheel.empty() && m_wheel.current() < now)
+      m_wheel.advance(expired);
+
+    if (!expired.empty())
     {
-      auto futures = vector_helper::create_vector<std::future<typename Result::value_type>>(m_funcs.size());
-      this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func)));
+      lock.unlock();
+      for (auto& node : expired)
+      {
+        try
+        {
+          node->callback();
+        }
+        catch(...)
+        {}
 
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
-      for (auto& future : futures)
-        result.push_back(future.get());
+        node->callback = nullptr;
+      }
+      expired.clear();
+      lock.lock();
+      continue;
+    }
 
-      return result;
+    if (m_wheel.empty())
+    {
+      m_wakeup = UINT64_MAX;
+      m_cv.wait(lock);
     }
+    else
+    {
+      m_wakeup = m_wheel.next_tick();
+      m_cv.wait_until(lock, m_epoch + std::chrono::milliseconds{static_cast<std::chrono::milliseconds::rep>(m_wakeup)});
+    }
+  }
+}
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
+#endif
 
 
-template<typename PriorResult, template<typename, typename> class Container, typename Func, typename Alloc>
-class all_func_task_void<void, PriorResult, Container, Func, Alloc> final : public next_task<void, PriorResult>
+struct retry_helper
 {
-  public:
-    all_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<void, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+  static timer_service::clock::duration backoff(const retry_policy& policy, std::size_t attempt)
+  {
+    using duration = std::chrono::duration<double, std::milli>;
+
+    auto delay = duration{policy.initial_delay};
+    for (std::size_t i = 1; i < attempt && delay < duration{policy.max_delay}; ++i)
+      delay *= policy.multiplier;
 
-    void run() final
+    if (delay > duration{policy.max_delay})
+      delay = duration{policy.max_delay};
+
+    if (0.0 < policy.jitter)
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_funcs.size());
-      this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func)));
-      for (auto& future : futures)
-        future.get();
+      std::uniform_real_distribution<double> distribution{0.0, std::min(policy.jitter, 1.0)};
+      delay *= 1.0 - distribution(engine());
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
+    return std::chrono::duration_cast<timer_service::clock::duration>(delay);
+  }
+
+  static std::minstd_rand& engine()
+  {
+    static thread_local std::minstd_rand engine{static_cast<std::minstd_rand::result_type>(
+        std::hash<std::thread::id>{}(std::this_thread::get_id())
+        ^ static_cast<std::size_t>(timer_service::clock::now().time_since_epoch().count()))};
+    return engine;
+  }
 };
 
 
-template<typename Result, typename PriorResult, typename MethodResult,
-template<typename, typename> class Container, typename Method, typename Alloc, typename Class>
-class all_settled_class_task final : public next_task<Result, PriorResult>
+class limiter_guard final
 {
   public:
-    all_settled_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
+    explicit limiter_guard(concurrency_limiter* limiter)
+      : m_limiter{limiter}
+      , m_start{concurrency_limiter::clock::now()}
     {}
 
-    Result run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<MethodResult>>(m_methods.size());
-      auto rv = this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj, rv));
-
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
+    limiter_guard(const limiter_guard&) = delete;
+    limiter_guard& operator=(const limiter_guard&) = delete;
 
-      for (auto& future : futures)
-      {
-        try
-        {
-          result.emplace_back(future.get());
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+    ~limiter_guard()
+    {
+      m_limiter->release(concurrency_limiter::clock::now() - m_start, m_resolved);
+    }
 
-      return result;
+    template<typename Func>
+    auto call(Func& func) -> decltype(func())
+    {
+      return resolve_helper<decltype(func())>::call(func, m_resolved);
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    concurrency_limiter* const m_limiter;
+    const concurrency_limiter::clock::time_point m_start;
+    bool m_resolved = false;
 };
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Method, typename Alloc, typename Class>
-class all_settled_class_task<Result, PriorResult, void, Container, Method, Alloc, Class> final
-    : public next_task<Result, PriorResult>
+template<typename Bound>
+class limited_call final
 {
   public:
-    all_settled_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
+    limited_call(concurrency_limiter* limiter, Bound bound)
+      : m_limiter{limiter}
+      , m_bound{std::move(bound)}
     {}
 
-    Result run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_methods.size());
-      auto rv = this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj, rv));
+    limited_call(const limited_call&) = delete;
+    limited_call& operator=(const limited_call&) = delete;
 
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
+    limited_call(limited_call&& other)
+      : m_limiter{other.m_limiter}
+      , m_bound{std::move(other.m_bound)}
+    {
+      other.m_limiter = nullptr;
+    }
 
-      for (auto& future : futures)
-      {
-        try
-        {
-          future.get();
-          result.emplace_back();
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+    ~limited_call()
+    {
+      if (m_limiter)
+        m_limiter->release(concurrency_limiter::clock::duration::zero(), false);
+    }
 
-      return result;
+    auto operator()() -> decltype(std::declval<Bound&>()())
+    {
+      limiter_guard guard{m_limiter};
+      m_limiter = nullptr;
+      return guard.call(m_bound);
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    concurrency_limiter* m_limiter;
+    Bound m_bound;
 };
 
 
-template<typename Result, typename PriorResult, typename MethodResult,
-         template<typename, typename> class Container, typename Method, typename Alloc, typename Class>
-class all_settled_class_task_void final : public next_task<Result, PriorResult>
+// Calls a function or a method of an object with the stored arguments passed as rvalues, like std::async
+// does. Unlike with std::bind, a function taking its arguments by rvalue reference can be launched
+template<typename Func, typename... Args>
+class bound_call final
 {
   public:
-    all_settled_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
+    using result_type = typename std::result_of<Func(Args...)>::type;
+
+    template<typename Func_, typename... Args_>
+    explicit bound_call(Func_&& func, Args_&&... args)
+      : m_func{std::forward<Func_>(func)}
+      , m_args{std::forward<Args_>(args)...}
     {}
 
-    Result run() final
+    result_type operator()()
     {
-      auto futures = vector_helper::create_vector<std::future<MethodResult>>(m_methods.size());
-      this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj));
+      return call(make_index_sequence<sizeof...(Args)>{});
+    }
 
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
+  private:
+    template<std::size_t... I>
+    result_type call(index_sequence<I...>)
+    {
+      return invoke(std::move(m_func), std::move(std::get<I>(m_args))...);
+    }
 
-      for (auto& future : futures)
-      {
-        try
-        {
-          result.emplace_back(future.get());
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+    template<typename Func_, typename... Args_>
+    static auto invoke(Func_&& func, Args_&&... args) -> decltype(std::forward<Func_>(func)(std::forward<Args_>(args)...))
+    {
+      return std::forward<Func_>(func)(std::forward<Args_>(args)...);
+    }
 
-      return result;
+    template<typename Method, typename Class, typename Object, typename... Args_>
+    static auto invoke(Method Class::* method, Object* obj, Args_&&... args) -> decltype((obj->*method)(std::forward<Args_>(args)...))
+    {
+      return (obj->*method)(std::forward<Args_>(args)...);
     }
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    Func m_func;
+    std::tuple<Args...> m_args;
 };
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Method, typename Alloc, typename Class>
-class all_settled_class_task_void<Result, PriorResult, void, Container, Method, Alloc, Class> final
-    : public next_task<Result, PriorResult>
+template<typename Func, typename... Args>
+using bound_call_type = bound_call<typename std::decay<Func>::type, typename std::decay<Args>::type...>;
+
+
+// Passes the call to a sink that stores its result, so the launch needs no future
+template<typename Sink, typename Bound>
+struct sink_call final
 {
-  public:
-    all_settled_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
+  void operator()()
+  {
+    sink(bound);
+  }
 
-    Result run() final
-    {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_methods.size());
-      this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, std::move(method), m_obj));
+  Sink sink;
+  Bound bound;
+};
 
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
 
-      for (auto& future : futures)
-      {
-        try
-        {
-          future.get();
-          result.emplace_back();
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+struct launch_helper
+{
+  template<typename Func, typename... Args, typename Bound = bound_call_type<Func, Args...>>
+  static std::future<typename Bound::result_type> launch(const task_base& stage, Func&& func, Args&&... args)
+  {
+    Bound bound{std::forward<Func>(func), std::forward<Args>(args)...};
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    auto chain = chain_scope::linked();
+    auto tracked = chain || allocation_counters::enabled();
+    auto observer = observer_helper::get();
+    if (tracked)
+      return launch_observed(observer, stage, tracked_call<Bound>{chain, stage.kind(), std::move(bound)});
+
+    if (observer)
+      return launch_observed(observer, stage, std::move(bound));
+#endif
+    return launch_limited(stage.options(), std::move(bound));
+  }
 
-      return result;
-    }
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+  template<typename Bound, typename Result = decltype(std::declval<Bound&>()())>
+  static std::future<Result> launch_observed(observer* observer, const task_base& stage, Bound bound)
+  {
+    if (!observer)
+      return launch_limited(stage.options(), std::move(bound));
+
+    auto event = observer_helper::event(stage, stage_event::clock::now());
+    event.parent = &stage;
+    event.element = observer_helper::next_element();
+    auto future = launch_limited(stage.options(), observed_call<Bound>{*observer, event, std::move(bound)});
+    event.duration = stage_event::clock::now() - event.start;
+    observer->on_spawn(event);
+    return future;
+  }
+#endif
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-};
+  template<typename Bound, typename Result = decltype(std::declval<Bound&>()())>
+  static std::future<Result> launch_limited(const launch_options& options, Bound bound)
+  {
+    auto limiter = options.limiter.get();
+    if (!limiter)
+      return spawn(options.pool, std::move(bound));
 
+    acquire(*limiter);
+    return spawn(options.pool, limited_call<Bound>{limiter, std::move(bound)});
+  }
 
-template<typename Result, typename PriorResult, typename FuncResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class all_settled_func_task final : public next_task<Result, PriorResult>
-{
-  public:
-    all_settled_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+  static void acquire(concurrency_limiter& limiter)
+  {
+    // A pool worker that blocks here could wait for functions queued behind it in the same pool
+    auto pool = thread_pool::current();
+    if (!pool)
+    {
+      limiter.acquire();
+      return;
+    }
 
-    Result run() final
+    while (!limiter.try_acquire_for(std::chrono::seconds::zero()))
     {
-      auto futures = vector_helper::create_vector<std::future<FuncResult>>(m_funcs.size());
-      auto rv = this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func), rv));
+      if (!pool->run_one() && limiter.try_acquire_for(std::chrono::milliseconds{1}))
+        return;
+    }
+  }
 
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
+  // Same as acquire, but gives up once the deadline passed
+  static bool acquire_until(concurrency_limiter& limiter, concurrency_limiter::clock::time_point deadline)
+  {
+    auto pool = thread_pool::current();
+    while (!limiter.try_acquire_for(std::chrono::seconds::zero()))
+    {
+      auto now = concurrency_limiter::clock::now();
+      if (deadline <= now)
+        return false;
 
-      for (auto& future : futures)
-      {
-        try
-        {
-          result.emplace_back(future.get());
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+      if (!pool)
+        return limiter.try_acquire_for(deadline - now);
 
-      return result;
+      if (!pool->run_one() && limiter.try_acquire_for(std::min<concurrency_limiter::clock::duration>(deadline - now, std::chrono::milliseconds{1})))
+        return true;
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
+    return true;
+  }
 
+  // Same as launch, but the result goes to the sink instead of a future. The sink must not throw
+  template<typename Sink, typename Func, typename... Args>
+  static void launch_into(const task_base& stage, Sink sink, Func&& func, Args&&... args)
+  {
+    into(std::false_type{}, stage, std::move(sink), std::forward<Func>(func), std::forward<Args>(args)...);
+  }
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class all_settled_func_task<Result, PriorResult, void, Container, Func, Alloc> final
-    : public next_task<Result, PriorResult>
-{
-  public:
-    all_settled_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+  // Same as launch_into, but the function runs on the calling thread
+  template<typename Sink, typename Func, typename... Args>
+  static void run_into(const task_base& stage, Sink sink, Func&& func, Args&&... args)
+  {
+    into(std::true_type{}, stage, std::move(sink), std::forward<Func>(func), std::forward<Args>(args)...);
+  }
 
-    Result run() final
+  template<typename Caller, typename Sink, typename Func, typename... Args>
+  static void into(Caller caller, const task_base& stage, Sink sink, Func&& func, Args&&... args)
+  {
+    bound_call_type<Func, Args...> bound{std::forward<Func>(func), std::forward<Args>(args)...};
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    auto chain = chain_scope::linked();
+    auto observer = observer_helper::get();
+    if (chain || allocation_counters::enabled())
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_funcs.size());
-      auto rv = this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func), rv));
-
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
-
-      for (auto& future : futures)
-      {
-        try
-        {
-          future.get();
-          result.emplace_back();
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+      post_observed(caller, observer, stage, std::move(sink), tracked_call<decltype(bound)>{chain, stage.kind(), std::move(bound)});
+      return;
+    }
 
-      return result;
+    if (observer)
+    {
+      post_observed(caller, observer, stage, std::move(sink), std::move(bound));
+      return;
     }
+#endif
+    post_limited(caller, stage.options(), std::move(sink), std::move(bound));
+  }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+  template<typename Caller, typename Sink, typename Bound>
+  static void post_observed(Caller caller, observer* observer, const task_base& stage, Sink sink, Bound bound)
+  {
+    if (!observer)
+    {
+      post_limited(caller, stage.options(), std::move(sink), std::move(bound));
+      return;
+    }
 
+    auto event = observer_helper::event(stage, stage_event::clock::now());
+    event.parent = &stage;
+    event.element = observer_helper::next_element();
+    if (Caller::value)
+    {
+      // Nothing is spawned for a function run on the calling thread
+      event.duration = stage_event::clock::duration::zero();
+      observer->on_spawn(event);
+      post_limited(caller, stage.options(), std::move(sink), observed_call<Bound>{*observer, event, std::move(bound)});
+      return;
+    }
 
-template<typename Result, typename PriorResult, typename FuncResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class all_settled_func_task_void final : public next_task<Result, PriorResult>
-{
-  public:
-    all_settled_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+    post_limited(caller, stage.options(), std::move(sink), observed_call<Bound>{*observer, event, std::move(bound)});
+    event.duration = stage_event::clock::now() - event.start;
+    observer->on_spawn(event);
+  }
+#endif
 
-    Result run() final
+  template<typename Caller, typename Sink, typename Bound>
+  static void post_limited(Caller caller, const launch_options& options, Sink sink, Bound bound)
+  {
+    runtime_counters::add(counter::elements_launched);
+    auto limiter = options.limiter.get();
+    if (!limiter)
     {
-      auto futures = vector_helper::create_vector<std::future<FuncResult>>(m_funcs.size());
-      this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func)));
+      execute(caller, options.pool, sink_call<Sink, Bound>{std::move(sink), std::move(bound)});
+      return;
+    }
 
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
+    acquire(*limiter);
+    execute(caller, options.pool, sink_call<Sink, limited_call<Bound>>{std::move(sink), limited_call<Bound>{limiter, std::move(bound)}});
+  }
 
-      for (auto& future : futures)
-      {
-        try
-        {
-          result.emplace_back(future.get());
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+  template<typename Func>
+  static void execute(std::false_type, thread_pool* pool, Func func)
+  {
+    post(pool, std::move(func));
+  }
 
-      return result;
-    }
+  template<typename Func>
+  static void execute(std::true_type, thread_pool*, Func func)
+  {
+    func();
+  }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
+  template<typename Bound, typename Result = decltype(std::declval<Bound&>()())>
+  static std::future<Result> spawn(thread_pool* pool, Bound bound)
+  {
+    runtime_counters::add(counter::elements_launched);
+    if (pool)
+      return pool->submit(std::move(bound));
 
+    runtime_counters::add(counter::threads_created);
+    auto options = thread_helper::options().load(std::memory_order_acquire);
+    if (options)
+      return thread_helper::spawn<Result>(*options, std::move(bound));
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class all_settled_func_task_void<Result, PriorResult, void, Container, Func, Alloc> final
-    : public next_task<Result, PriorResult>
-{
-  public:
-    all_settled_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+    return std::async(std::launch::async, std::move(bound));
+  }
 
-    Result run() final
+  // Nobody waits for a detached function, so it may outlive its stage and chain. Its allocations are counted
+  // to the stage kind, but it is not reported to an observer and not counted to the chain
+  template<typename Func>
+  static void detach(const task_base& stage, Func func)
+  {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    if (allocation_counters::enabled())
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_funcs.size());
-      this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, std::move(func)));
-
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
+      detach_limited(stage.options(), detached_call<Func>{stage.kind(), std::move(func)});
+      return;
+    }
+#endif
+    detach_limited(stage.options(), std::move(func));
+  }
 
-      for (auto& future : futures)
-      {
-        try
-        {
-          future.get();
-          result.emplace_back();
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+  // A function that could not take a place of the limiter before the deadline is not launched
+  template<typename Func>
+  static bool detach_until(const task_base& stage, concurrency_limiter::clock::time_point deadline, Func func)
+  {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    if (allocation_counters::enabled())
+      return detach_limited_until(stage.options(), deadline, detached_call<Func>{stage.kind(), std::move(func)});
+#endif
+    return detach_limited_until(stage.options(), deadline, std::move(func));
+  }
 
-      return result;
+  template<typename Func>
+  static void detach_limited(const launch_options& options, Func func)
+  {
+    runtime_counters::add(counter::elements_launched);
+    auto limiter = options.limiter.get();
+    if (!limiter)
+    {
+      post(options.pool, std::move(func));
+      return;
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
+    acquire(*limiter);
+    post(options.pool, limited_call<Func>{limiter, std::move(func)});
+  }
 
+  template<typename Func>
+  static bool detach_limited_until(const launch_options& options, concurrency_limiter::clock::time_point deadline, Func func)
+  {
+    auto limiter = options.limiter.get();
+    if (limiter && !acquire_until(*limiter, deadline))
+      return false;
 
-template<typename Derived, typename Result, typename PriorResult>
-class any_task_base : public iterable_base<Derived>, public next_task<Result, PriorResult>
-{
-  public:
-    any_task_base(task_ptr<PriorResult> prior_task)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-    {}
+    runtime_counters::add(counter::elements_launched);
+    if (!limiter)
+      post(options.pool, std::move(func));
+    else
+      post(options.pool, limited_call<Func>{limiter, std::move(func)});
 
-    Result run() final
-    {
-      auto future = m_promise.get_future();
-      m_errors.reserve(this->iterable_size());
-      this->async_run();
-      return future.get();
-    }
+    return true;
+  }
 
-  protected:
-    void process_error(std::exception_ptr err)
+  // The function must not throw. Throws an overload_error if the pool rejected the function
+  template<typename Func>
+  static void post(thread_pool* pool, Func func)
+  {
+    if (pool)
     {
-      std::lock_guard<std::mutex> lock{m_mutex};
-
-      m_errors.push_back(std::move(err));
-      if (m_errors.size() < this->iterable_size())
-        return;
-
-      promise_helper::reject(m_promise, std::make_exception_ptr(aggregate_error{std::move(m_errors)}));
+      if (!pool->dispatch(std::move(func)))
+        throw overload_error{};
+      return;
     }
 
-    std::promise<Result> m_promise;
-
-  private:
-    std::vector<std::exception_ptr> m_errors;
-    std::mutex m_mutex;
+    runtime_counters::add(counter::threads_created);
+    auto options = thread_helper::options().load(std::memory_order_acquire);
+    thread_helper::start(options ? *options : thread_options{}, std::move(func));
+  }
 };
 
 
-template<typename Result, typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class any_class_task final
-    : public any_task_base<any_class_task<Result, PriorResult, Container, Method, Alloc, Class>, Result, PriorResult>
+struct future_helper
 {
-  public:
-    any_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : any_task_base<any_class_task, Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
-
-    void async_run(std::vector<std::future<void>>& futures)
-    {
-      auto arg = this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &any_class_task::call, this, std::move(method), arg));
-    }
+  template<typename T>
+  static void wait(const std::future<T>& future)
+  {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+    if (std::future_status::ready == future.wait_for(std::chrono::seconds::zero()))
+      return;
+
+    auto start = std::chrono::steady_clock::now();
+    wait_ready(future);
+    auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    runtime_counters::add(counter::waits);
+    runtime_counters::add(counter::wait_time, static_cast<std::uint64_t>(time.count()));
+#else
+    wait_ready(future);
+#endif
+  }
 
-    void call(Method method, PriorResult arg)
+  template<typename T>
+  static void wait_ready(const std::future<T>& future)
+  {
+    auto pool = thread_pool::current();
+    if (pool)
     {
-      try
-      {
-        promise_helper::resolve(this->m_promise, (m_obj->*method)(std::move(arg)));
-      }
-      catch(...)
+      while (std::future_status::ready != future.wait_for(std::chrono::seconds::zero()))
       {
-        this->process_error(std::current_exception());
+        if (!pool->run_one())
+          future.wait_for(std::chrono::milliseconds{1});
       }
     }
 
-    std::size_t iterable_size() const
-    {
-      return m_methods.size();
-    }
+    future.wait();
+  }
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* m_obj;
+  template<typename T>
+  static T get(std::future<T>& future)
+  {
+    wait(future);
+    return future.get();
+  }
 };
 
 
-template<typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class any_class_task<void, PriorResult, Container, Method, Alloc, Class> final
-    : public any_task_base<any_class_task<void, PriorResult, Container, Method, Alloc, Class>, void, PriorResult>
+template<typename T>
+class future_list final
 {
   public:
-    any_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : any_task_base<any_class_task, void, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
+    using iterator = typename std::vector<std::future<T>>::iterator;
 
-    void async_run(std::vector<std::future<void>>& futures)
+    explicit future_list(std::size_t size)
     {
-      auto arg = this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &any_class_task::call, this, std::move(method), arg));
+      m_futures.reserve(size);
     }
 
-    void call(Method method, PriorResult arg)
+    future_list(const future_list&) = delete;
+    future_list& operator=(const future_list&) = delete;
+
+    ~future_list()
     {
-      try
-      {
-        (m_obj->*method)(std::move(arg));
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
+      for (const auto& future : m_futures)
       {
-        this->process_error(std::current_exception());
+        if (future.valid())
+          future_helper::wait(future);
       }
     }
 
-    std::size_t iterable_size() const
+    void push_back(std::future<T>&& future)
+    {
+      m_futures.push_back(std::move(future));
+    }
+
+    iterator begin() noexcept
+    {
+      return m_futures.begin();
+    }
+
+    iterator end() noexcept
     {
-      return m_methods.size();
+      return m_futures.end();
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* m_obj;
+    std::vector<std::future<T>> m_futures;
 };
 
 
-template<typename Result, typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class any_class_task_void final
-    : public any_task_base<any_class_task_void<Result, PriorResult, Container, Method, Alloc, Class>, Result, PriorResult>
+/**
+ * Counter of outstanding functions of a fan-out stage. The waiter is woken once, when the
+ * last function counted down, instead of once per function.
+ */
+class countdown_latch final
 {
   public:
-    any_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : any_task_base<any_class_task_void, Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
+    explicit countdown_latch(std::size_t count)
+      : m_count{count}
+      , m_ready{0 == count}
     {}
 
-    void async_run(std::vector<std::future<void>>& futures)
-    {
-      this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &any_class_task_void::call, this, std::move(method)));
-    }
+    countdown_latch(const countdown_latch&) = delete;
+    countdown_latch& operator=(const countdown_latch&) = delete;
 
-    void call(Method method)
+    void count_down()
     {
-      try
-      {
-        promise_helper::resolve(this->m_promise, (m_obj->*method)());
-      }
-      catch(...)
-      {
-        this->process_error(std::current_exception());
-      }
+      if (1 != m_count.fetch_sub(1, std::memory_order_acq_rel))
+        return;
+
+      // Notified under the lock, so the waiter cannot destroy the latch before the notification
+      std::lock_guard<std::mutex> lock{m_mutex};
+      m_ready = true;
+      m_cv.notify_one();
     }
 
-    std::size_t iterable_size() const
+    void wait()
     {
-      return m_methods.size();
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      if (ready())
+        return;
+
+      auto start = std::chrono::steady_clock::now();
+      wait_ready();
+      auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+      runtime_counters::add(counter::waits);
+      runtime_counters::add(counter::wait_time, static_cast<std::uint64_t>(time.count()));
+#else
+      wait_ready();
+#endif
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* m_obj;
-};
-
-
-template<typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class any_class_task_void<void, PriorResult, Container, Method, Alloc, Class> final
-    : public any_task_base<any_class_task_void<void, PriorResult, Container, Method, Alloc, Class>, void, PriorResult>
-{
-  public:
-    any_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : any_task_base<any_class_task_void, void, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
-
-    void async_run(std::vector<std::future<void>>& futures)
+    bool ready()
     {
-      this->m_prior_task->run();
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &any_class_task_void::call, this, std::move(method)));
+      std::lock_guard<std::mutex> lock{m_mutex};
+      return m_ready;
     }
 
-    void call(Method method)
+    void wait_ready()
     {
-      try
-      {
-        (m_obj->*method)();
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
+      auto pool = thread_pool::current();
+      std::unique_lock<std::mutex> lock{m_mutex};
+      if (pool)
       {
-        this->process_error(std::current_exception());
+        while (!m_ready)
+        {
+          lock.unlock();
+          auto ran = pool->run_one();
+          lock.lock();
+          if (!ran)
+            m_cv.wait_for(lock, std::chrono::milliseconds{1}, [this] { return m_ready; });
+        }
       }
-    }
 
-    std::size_t iterable_size() const
-    {
-      return m_methods.size();
+      m_cv.wait(lock, [this] { return m_ready; });
     }
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* m_obj;
+    std::atomic<std::size_t> m_count;
+    bool m_ready;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
 };
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class any_func_task final
-    : public any_task_base<any_func_task<Result, PriorResult, Container, Func, Alloc>, Result, PriorResult>
+/**
+ * Result of a function of a fan-out stage, written by the function and read by the waiter.
+ * A reference result of a chain stage is kept as a reference.
+ */
+template<typename T>
+class join_slot final
 {
   public:
-    any_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : any_task_base<any_func_task, Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+    using value_type = typename std::conditional<std::is_reference<T>::value,
+                                                 std::reference_wrapper<typename std::remove_reference<T>::type>, T>::type;
 
-    void async_run(std::vector<std::future<void>>& futures)
+    join_slot() = default;
+    join_slot(const join_slot&) = delete;
+    join_slot& operator=(const join_slot&) = delete;
+
+    ~join_slot()
     {
-      auto arg = this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &any_func_task::call, this, std::move(func), arg));
+      if (m_resolved)
+        value().~value_type();
     }
 
-    void call(Func func, PriorResult arg)
+    // Returns true if the function resolved
+    template<typename Func>
+    bool settle(Func& func)
     {
       try
       {
-        promise_helper::resolve(this->m_promise, func(std::move(arg)));
+        ::new(&m_storage) value_type(func());
+        m_resolved = true;
       }
       catch(...)
       {
-        this->process_error(std::current_exception());
+        m_error = std::current_exception();
       }
+
+      return m_resolved;
     }
 
-    std::size_t iterable_size() const
+    void reject(std::exception_ptr err)
     {
-      return m_funcs.size();
+      m_error = std::move(err);
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
-
+    void reset()
+    {
+      if (m_resolved)
+        value().~value_type();
 
-template<typename PriorResult, template<typename, typename> class Container, typename Func, typename Alloc>
-class any_func_task<void, PriorResult, Container, Func, Alloc> final
-    : public any_task_base<any_func_task<void, PriorResult, Container, Func, Alloc>, void, PriorResult>
-{
-  public:
-    any_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : any_task_base<any_func_task, void, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+      m_resolved = false;
+      m_error = nullptr;
+    }
 
-    void async_run(std::vector<std::future<void>>& futures)
+    const std::exception_ptr& error() const noexcept
     {
-      auto arg = this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &any_func_task::call, this, std::move(func), arg));
+      return m_error;
     }
 
-    void call(Func func, PriorResult arg)
+    T take()
     {
-      try
-      {
-        func(std::move(arg));
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
-      {
-        this->process_error(std::current_exception());
-      }
+      if (!m_resolved)
+        std::rethrow_exception(m_error);
+
+      return std::move(value());
     }
 
-    std::size_t iterable_size() const
+    settled<T> take_settled()
     {
-      return m_funcs.size();
+      if (!m_resolved)
+        return settled<T>{std::move(m_error)};
+
+      return settled<T>{std::move(value())};
     }
 
   private:
-    Container<Func, Alloc> m_funcs;
+    value_type& value() noexcept
+    {
+      return *reinterpret_cast<value_type*>(&m_storage);
+    }
+
+    typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type m_storage;
+    std::exception_ptr m_error;
+    bool m_resolved = false;
 };
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class any_func_task_void final
-    : public any_task_base<any_func_task_void<Result, PriorResult, Container, Func, Alloc>, Result, PriorResult>
+template<>
+class join_slot<void> final
 {
   public:
-    any_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : any_task_base<any_func_task_void, Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
-
-    void async_run(std::vector<std::future<void>>& futures)
-    {
-      this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &any_func_task_void::call, this, std::move(func)));
-    }
-
-    void call(Func func)
+    template<typename Func>
+    bool settle(Func& func)
     {
       try
       {
-        promise_helper::resolve(this->m_promise, func());
+        func();
       }
       catch(...)
       {
-        this->process_error(std::current_exception());
+        m_error = std::current_exception();
       }
+
+      return !m_error;
     }
 
-    std::size_t iterable_size() const
+    void reject(std::exception_ptr err)
     {
-      return m_funcs.size();
+      m_error = std::move(err);
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-};
-
-
-template<typename PriorResult, template<typename, typename> class Container, typename Func, typename Alloc>
-class any_func_task_void<void, PriorResult, Container, Func, Alloc> final
-    : public any_task_base<any_func_task_void<void, PriorResult, Container, Func, Alloc>, void, PriorResult>
-{
-  public:
-    any_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : any_task_base<any_func_task_void, void, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+    void reset()
+    {
+      m_error = nullptr;
+    }
 
-    void async_run(std::vector<std::future<void>>& futures)
+    const std::exception_ptr& error() const noexcept
     {
-      this->m_prior_task->run();
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &any_func_task_void::call, this, std::move(func)));
+      return m_error;
     }
 
-    void call(Func func)
+    void take()
     {
-      try
-      {
-        func();
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
-      {
-        this->process_error(std::current_exception());
-      }
+      if (m_error)
+        std::rethrow_exception(m_error);
     }
 
-    std::size_t iterable_size() const
+    settled<void> take_settled()
     {
-      return m_funcs.size();
+      if (m_error)
+        return settled<void>{std::move(m_error)};
+
+      return settled<void>{};
     }
 
   private:
-    Container<Func, Alloc> m_funcs;
+    std::exception_ptr m_error;
 };
 
 
-template<typename Derived, typename Result, typename PriorResult>
-class race_task_base : public iterable_base<Derived>, public next_task<Result, PriorResult>
+/**
+ * Slots of a @ref fan_out_join. Each slot starts on its own cache line, so functions that
+ * complete at once do not invalidate the lines of their neighbours as adjacent small results
+ * of a plain vector would. The waiter compacts them into the result container once at the end.
+ */
+template<typename T>
+class padded_slots final
 {
   public:
-    race_task_base(task_ptr<PriorResult> prior_task)
-      : next_task<Result, PriorResult>{std::move(prior_task)}
-    {}
+    static constexpr std::size_t stride = (sizeof(join_slot<T>) + cache_line_size - 1) / cache_line_size * cache_line_size;
 
-    Result run() final
+    explicit padded_slots(std::size_t size)
+      : m_buffer{new char[size * stride + cache_line_size]}
+      , m_size{size}
     {
-      auto future = m_promise.get_future();
-      this->async_run();
-      return future.get();
-    }
-
-  protected:
-    std::promise<Result> m_promise;
-};
+      static_assert(alignof(join_slot<T>) <= cache_line_size, "Slot alignment exceeds cache line size");
 
+      auto address = reinterpret_cast<std::uintptr_t>(m_buffer.get());
+      m_slots = m_buffer.get() + (cache_line_size - address % cache_line_size) % cache_line_size;
+      for (std::size_t i = 0; i < size; ++i)
+        ::new(m_slots + i * stride) join_slot<T>{};
+    }
 
-template<typename Result, typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class race_class_task final
-    : public race_task_base<race_class_task<Result, PriorResult, Container, Method, Alloc, Class>, Result, PriorResult>
-{
-  public:
-    race_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : race_task_base<race_class_task, Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
+    padded_slots(const padded_slots&) = delete;
+    padded_slots& operator=(const padded_slots&) = delete;
 
-    void async_run(std::vector<std::future<void>>& futures)
+    ~padded_slots()
     {
-      auto arg = this->m_prior_task->run();
-      for (auto method : this->m_methods)
-        futures.push_back(std::async(std::launch::async, &race_class_task::call, this, std::move(method), arg));
+      for (std::size_t i = 0; i < m_size; ++i)
+        (*this)[i].~join_slot();
     }
 
-    void call(Method method, PriorResult arg)
+    std::size_t size() const noexcept
     {
-      try
-      {
-        promise_helper::resolve(this->m_promise, (m_obj->*method)(std::move(arg)));
-      }
-      catch(...)
-      {
-        promise_helper::reject(this->m_promise, std::current_exception());
-      }
+      return m_size;
     }
 
-    std::size_t iterable_size() const
+    join_slot<T>& operator[](std::size_t index) noexcept
     {
-      return m_methods.size();
+      return *reinterpret_cast<join_slot<T>*>(m_slots + index * stride);
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    std::unique_ptr<char[]> m_buffer;
+    char* m_slots;
+    const std::size_t m_size;
 };
 
 
-template<typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class race_class_task<void, PriorResult, Container, Method, Alloc, Class> final
-    : public race_task_base<race_class_task<void, PriorResult, Container, Method, Alloc, Class>, void, PriorResult>
+/**
+ * Join of the functions of an @ref all_task or an @ref all_settled_task. Each function writes
+ * into its preallocated slot and counts down the latch, the stage waits for the latch only.
+ */
+template<typename T>
+class fan_out_join final
 {
   public:
-    race_class_task(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : race_task_base<race_class_task, void, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
+    class sink final
+    {
+      public:
+        sink(fan_out_join* join, std::size_t index) noexcept
+          : m_join{join}
+          , m_index{index}
+        {}
+
+        template<typename Func>
+        void operator()(Func& func)
+        {
+          m_join->m_slots[m_index].settle(func);
+          m_join->m_latch.count_down();
+        }
+
+      private:
+        fan_out_join* m_join;
+        std::size_t m_index;
+    };
+
+    explicit fan_out_join(std::size_t size)
+      : m_slots{size}
+      , m_latch{size}
     {}
 
-    void async_run(std::vector<std::future<void>>& futures)
+    fan_out_join(const fan_out_join&) = delete;
+    fan_out_join& operator=(const fan_out_join&) = delete;
+
+    // The functions use the join, so it must not go away before they finished
+    ~fan_out_join()
+    {
+      m_latch.wait();
+    }
+
+    sink at(std::size_t index) noexcept
+    {
+      return sink{this, index};
+    }
+
+    void reject(std::size_t index, std::exception_ptr err)
     {
-      auto arg = this->m_prior_task->run();
-      for (auto method : this->m_methods)
-        futures.push_back(std::async(std::launch::async, &race_class_task::call, this, std::move(method), arg));
+      m_slots[index].reject(std::move(err));
+      m_latch.count_down();
     }
 
-    void call(Method method, PriorResult arg)
+    void wait()
     {
-      try
-      {
-        (m_obj->*method)(std::move(arg));
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
-      {
-        promise_helper::reject(this->m_promise, std::current_exception());
-      }
+      m_latch.wait();
+    }
+
+    std::size_t size() const noexcept
+    {
+      return m_slots.size();
     }
 
-    std::size_t iterable_size() const
+    join_slot<T>& operator[](std::size_t index) noexcept
     {
-      return m_methods.size();
+      return m_slots[index];
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    padded_slots<T> m_slots;
+    countdown_latch m_latch;
 };
 
 
-template<typename Result, typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class race_class_task_void final
-    : public race_task_base<race_class_task_void<Result, PriorResult, Container, Method, Alloc, Class>, Result, PriorResult>
+/**
+ * Settled result of a waiting stage in a run of a chain by a @ref chain_driver.
+ */
+template<typename T>
+class wait_slot final : public wait_state
 {
   public:
-    race_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : race_task_base<race_class_task_void, Result, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
+    explicit wait_slot(const task_base& stage) noexcept
+      : wait_state{stage}
     {}
 
-    void async_run(std::vector<std::future<void>>& futures)
-    {
-      this->m_prior_task->run();
-      for (auto method : this->m_methods)
-        futures.push_back(std::async(std::launch::async, &race_class_task_void::call, this, std::move(method)));
-    }
-
-    void call(Method method)
+    void reset() final
     {
-      try
-      {
-        promise_helper::resolve(this->m_promise, (m_obj->*method)());
-      }
-      catch(...)
-      {
-        promise_helper::reject(this->m_promise, std::current_exception());
-      }
+      wait_state::reset();
+      m_slot.reset();
     }
 
-    std::size_t iterable_size() const
+    join_slot<T>& slot() noexcept
     {
-      return m_methods.size();
+      return m_slot;
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    join_slot<T> m_slot;
 };
 
 
-template<typename PriorResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class>
-class race_class_task_void<void, PriorResult, Container, Method, Alloc, Class> final
-    : public race_task_base<race_class_task_void<void, PriorResult, Container, Method, Alloc, Class>, void, PriorResult>
+/**
+ * Waiting stages of the chain driven on the calling thread. A waiting stage found here returns its settled
+ * result instead of running its prior stages and waiting.
+ */
+class wait_scope final
 {
   public:
-    race_class_task_void(task_ptr<PriorResult> prior_task, Container<Method, Alloc> methods, Class* obj)
-      : race_task_base<race_class_task_void, void, PriorResult>{std::move(prior_task)}
-      , m_methods{std::move(methods)}
-      , m_obj{obj}
-    {}
+    using list = std::vector<std::unique_ptr<wait_state>>;
 
-    void async_run(std::vector<std::future<void>>& futures)
+    explicit wait_scope(list* waits) noexcept
+      : m_parent{current()}
     {
-      this->m_prior_task->run();
-      for (auto method : this->m_methods)
-        futures.push_back(std::async(std::launch::async, &race_class_task_void::call, this, std::move(method)));
+      current() = waits;
     }
 
-    void call(Method method)
+    wait_scope(const wait_scope&) = delete;
+    wait_scope& operator=(const wait_scope&) = delete;
+
+    ~wait_scope()
     {
-      try
-      {
-        (m_obj->*method)();
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
+      current() = m_parent;
+    }
+
+    template<typename T>
+    static join_slot<T>* find(const task_base& stage) noexcept
+    {
+      auto waits = current();
+      if (!waits)
+        return nullptr;
+
+      for (const auto& state : *waits)
       {
-        promise_helper::reject(this->m_promise, std::current_exception());
+        if (&state->stage == &stage)
+          return &static_cast<wait_slot<T>&>(*state).slot();
       }
+
+      return nullptr;
     }
 
-    std::size_t iterable_size() const
+  private:
+    static list*& current() noexcept
     {
-      return m_methods.size();
+      static thread_local list* waits = nullptr;
+      return waits;
     }
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
+    list* const m_parent;
 };
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class race_func_task final
-    : public race_task_base<race_func_task<Result, PriorResult, Container, Func, Alloc>, Result, PriorResult>
+/**
+ * Runs a chain with waiting stages without holding a thread while they wait. Each step advances
+ * the waiting stages in chain order until one has to wait and returns, the timer service posts
+ * the next step to the pool or a new thread once the wait is over. The last step runs the chain,
+ * where the waiting stages return their settled results.
+ */
+template<typename T>
+class chain_driver final : public std::enable_shared_from_this<chain_driver<T>>
 {
   public:
-    race_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : race_task_base<race_func_task, Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
-
-    void async_run(std::vector<std::future<void>>& futures)
+    chain_driver(task_ptr<T> task, std::promise<T> promise, thread_pool* pool)
+      : m_task{std::move(task)}
+      , m_promise{std::move(promise)}
+      , m_pool{pool}
+      , m_chain{*m_task}
     {
-      auto arg = this->m_prior_task->run();
-      for (auto func : this->m_funcs)
-        futures.push_back(std::async(std::launch::async, &race_func_task::call, this, std::move(func), arg));
+      for (auto stage = static_cast<const task_base*>(m_task.get()); stage; stage = stage->prior())
+      {
+        auto state = stage->make_wait();
+        if (state)
+          m_waits.push_back(std::move(state));
+      }
+
+      std::reverse(m_waits.begin(), m_waits.end());
     }
 
-    void call(Func func, PriorResult arg)
+    chain_driver(const chain_driver&) = delete;
+    chain_driver& operator=(const chain_driver&) = delete;
+
+    // The first step runs on the pool or a new thread if the pool is nullptr
+    static std::future<T> run(task_ptr<T> task, thread_pool* pool, std::promise<T> promise)
     {
+      auto future = promise.get_future();
+      auto driver = std::make_shared<chain_driver>(std::move(task), std::move(promise), pool);
       try
       {
-        promise_helper::resolve(this->m_promise, func(std::move(arg)));
+        launch_helper::post(pool, step_call{driver});
       }
       catch(...)
       {
-        promise_helper::reject(this->m_promise, std::current_exception());
+        driver->fail(std::current_exception());
       }
-    }
 
-    std::size_t iterable_size() const
-    {
-      return m_funcs.size();
+      return future;
     }
 
   private:
-    Container<Func, Alloc> m_funcs;
-};
-
+    struct step_call final
+    {
+      void operator()()
+      {
+        driver->step();
+      }
 
-template<typename PriorResult, template<typename, typename> class Container, typename Func, typename Alloc>
-class race_func_task<void, PriorResult, Container, Func, Alloc> final
-    : public race_task_base<race_func_task<void, PriorResult, Container, Func, Alloc>, void, PriorResult>
-{
-  public:
-    race_func_task(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : race_task_base<race_func_task, void, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+      std::shared_ptr<chain_driver> driver;
+    };
 
-    void async_run(std::vector<std::future<void>>& futures)
+    void step()
     {
-      auto arg = this->m_prior_task->run();
-      for (auto func : this->m_funcs)
-        futures.push_back(std::async(std::launch::async, &race_func_task::call, this, std::move(func), arg));
+      wait_scope waits{&m_waits};
+      driven_chain::step_scope chain{m_chain};
+      try
+      {
+        for (std::size_t i = 0; i < m_waits.size(); ++i)
+        {
+          auto& state = *m_waits[i];
+          if (state.settled)
+            continue;
+
+          auto step = state.stage.advance(state);
+          if (wait_step::settled == step)
+          {
+            state.settled = true;
+            continue;
+          }
+
+          if (wait_step::restart == step)
+          {
+            for (std::size_t j = 0; j < i; ++j)
+              m_waits[j]->reset();
+          }
+
+          auto self = this->shared_from_this();
+          timer_service::instance().schedule_at(state.resume_at, [self] { self->resume(); });
+          return;
+        }
+
+        join_slot<T> result;
+        auto run = [this] () -> T { return m_task->run(); };
+        result.settle(run);
+        m_chain.finish();
+        promise_helper::resolve_with(m_promise, [&result] () -> T { return result.take(); });
+      }
+      catch(...)
+      {
+        fail(std::current_exception());
+      }
     }
 
-    void call(Func func, PriorResult arg)
+    // Runs on the timer thread, so a full pool queue does not block it nor run the step inline
+    void resume() noexcept
     {
       try
       {
-        func(std::move(arg));
-        promise_helper::resolve(this->m_promise);
+        if (!m_pool || !m_pool->try_dispatch(step_call{this->shared_from_this()}))
+          launch_helper::post(nullptr, step_call{this->shared_from_this()});
       }
       catch(...)
       {
-        promise_helper::reject(this->m_promise, std::current_exception());
+        fail(std::current_exception());
       }
     }
 
-    std::size_t iterable_size() const
+    void fail(std::exception_ptr err) noexcept
     {
-      return m_funcs.size();
+      m_chain.finish();
+      promise_helper::reject(m_promise, std::move(err));
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
+    const task_ptr<T> m_task;
+    std::promise<T> m_promise;
+    thread_pool* const m_pool;
+    driven_chain m_chain;
+    wait_scope::list m_waits;
+};
+
+
+/**
+ * Blocking waits of the delay, retry and throttle stages, used only when the thread that gets
+ * the result runs the chain itself, as with std::launch::deferred. A pool worker keeps running
+ * queued functions of its pool meanwhile, see @ref future_helper.
+ */
+struct timer_helper
+{
+  static void wait(timer_service::clock::duration delay)
+  {
+    wait_until(timer_service::clock::now() + delay);
+  }
+
+  static void wait_until(timer_service::clock::time_point time)
+  {
+    auto promise = std::make_shared<std::promise<void>>();
+    auto future = promise->get_future();
+    timer_service::instance().schedule_at(time, [promise] { promise_helper::resolve(*promise); });
+    future_helper::get(future);
+  }
 };
 
 
-template<typename Result, typename PriorResult,
-         template<typename, typename> class Container, typename Func, typename Alloc>
-class race_func_task_void final
-    : public race_task_base<race_func_task_void<Result, PriorResult, Container, Func, Alloc>, Result, PriorResult>
+template<typename Method, typename Class>
+class method_call final
 {
   public:
-    race_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : race_task_base<race_func_task_void, Result, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
+    template<typename Method_>
+    method_call(Method_&& method, Class* obj)
+      : m_method{std::forward<Method_>(method)}
+      , m_obj{obj}
     {}
 
-    void async_run(std::vector<std::future<void>>& futures)
+    template<typename... Args>
+    auto operator()(Args&&... args) const -> decltype((std::declval<Class*>()->*std::declval<const Method&>())(std::forward<Args>(args)...))
     {
-      this->m_prior_task->run();
-      for (auto func : this->m_funcs)
-        futures.push_back(std::async(std::launch::async, &race_func_task_void::call, this, std::move(func)));
+      return (m_obj->*m_method)(std::forward<Args>(args)...);
     }
 
-    void call(Func func)
-    {
-      try
-      {
-        promise_helper::resolve(this->m_promise, func());
-      }
-      catch(...)
-      {
-        promise_helper::reject(this->m_promise, std::current_exception());
-      }
-    }
+  private:
+    Method m_method;
+    Class* m_obj;
+};
 
-    std::size_t iterable_size() const
-    {
-      return m_funcs.size();
-    }
 
-  private:
-    Container<Func, Alloc> m_funcs;
+struct func_binder
+{
+  template<typename Func>
+  Func operator()(Func func) const
+  {
+    return func;
+  }
 };
 
 
-template<typename PriorResult, template<typename, typename> class Container, typename Func, typename Alloc>
-class race_func_task_void<void, PriorResult, Container, Func, Alloc> final
-    : public race_task_base<race_func_task_void<void, PriorResult, Container, Func, Alloc>, void, PriorResult>
+template<typename Class>
+struct method_binder
 {
-  public:
-    race_func_task_void(task_ptr<PriorResult> prior_task, Container<Func, Alloc> funcs)
-      : race_task_base<race_func_task_void, void, PriorResult>{std::move(prior_task)}
-      , m_funcs{std::move(funcs)}
-    {}
+  template<typename Method>
+  method_call<Method, Class> operator()(Method method) const
+  {
+    return method_call<Method, Class>{std::move(method), obj};
+  }
 
-    void async_run(std::vector<std::future<void>>& futures)
+  Class* obj;
+};
+
+
+template<typename Result, typename PriorResult>
+class next_task : public task<Result>
+{
+  public:
+    explicit next_task(task_ptr<PriorResult> prior_task)
+      : m_prior_task{std::move(prior_task)}
     {
-      this->m_prior_task->run();
-      for (auto func : this->m_funcs)
-        futures.push_back(std::async(std::launch::async, &race_func_task_void::call, this, std::move(func)));
+      this->m_chained = true;
+      this->m_waits = m_prior_task->waits();
     }
 
-    void call(Func func)
+  protected:
+    PriorResult run_prior() const
     {
-      try
-      {
-        func();
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
-      {
-        promise_helper::reject(this->m_promise, std::current_exception());
-      }
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      stage_start_guard guard;
+#endif
+      return m_prior_task->run();
     }
 
-    std::size_t iterable_size() const
+    const task_base* prior() const noexcept final
     {
-      return m_funcs.size();
+      return m_prior_task.get();
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
+    task_ptr<PriorResult> m_prior_task;
 };
 
 
-template<typename Result, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class, typename... Args>
-class make_all_class_task final : public task<Result>
+/**
+ * Input of a chained stage: the result of the prior stage if its functions take it, nothing otherwise.
+ */
+template<typename Result, typename PriorResult, bool Pass>
+class prior_input : public next_task<Result, PriorResult>
 {
   public:
-    template<typename... Args_>
-    make_all_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
+    using result_type = Result;
+    using input_type = std::tuple<PriorResult>;
+
+    explicit prior_input(task_ptr<PriorResult> prior_task)
+      : next_task<Result, PriorResult>{std::move(prior_task)}
     {}
 
-    Result run() final
+  protected:
+    input_type input()
     {
-      auto futures = vector_helper::create_vector<std::future<typename Result::value_type>>(m_methods.size());
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_all_class_task::call, this, std::move(method)));
+      return input_type{this->run_prior()};
+    }
+};
 
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
-      for (auto& future : futures)
-        result.push_back(future.get());
 
-      return result;
-    }
+template<typename Result, typename PriorResult>
+class prior_input<Result, PriorResult, false> : public next_task<Result, PriorResult>
+{
+  public:
+    using result_type = Result;
+    using input_type = std::tuple<>;
 
-  private:
-    typename Result::value_type call(Method method) const
+    explicit prior_input(task_ptr<PriorResult> prior_task)
+      : next_task<Result, PriorResult>{std::move(prior_task)}
+    {}
+
+  protected:
+    input_type input()
     {
-      return class_method_call_helper<typename Result::value_type>::call(std::move(method), m_obj, m_args);
+      this->run_prior();
+      return input_type{};
     }
-
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
 };
 
 
-template<template<typename, typename> class Container, typename Method,
-         typename Alloc, typename Class, typename... Args>
-class make_all_class_task<void, Container, Method, Alloc, Class, Args...> final : public task<void>
+template<typename Result, typename... Args>
+class args_input : public task<Result>
 {
   public:
+    using result_type = Result;
+    using input_type = std::tuple<Args...>;
+
     template<typename... Args_>
-    make_all_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
+    explicit args_input(Args_&&... args)
+      : m_args{std::forward<Args_>(args)...}
     {}
 
-    void run() final
+  protected:
+    input_type& input()
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_methods.size());
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_all_class_task::call, this, std::move(method)));
-      for (auto& future : futures)
-        future.get();
+      return m_args;
     }
 
   private:
-    void call(Method method) const
-    {
-      class_method_call_helper<void>::call(std::move(method), m_obj, m_args);
-    }
-
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+    input_type m_args;
 };
 
 
-template<typename Result, template<typename, typename> class Container,
-         typename Func, typename Alloc, typename... Args>
-class make_all_func_task final : public task<Result>
+template<typename Input, typename Func>
+class call_task final : public Input
 {
   public:
-    template<typename... Args_>
-    explicit make_all_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
+    template<typename Func_, typename... Input_>
+    explicit call_task(Func_&& func, Input_&&... input)
+      : Input{std::forward<Input_>(input)...}
+      , m_func{std::forward<Func_>(func)}
     {}
 
-    Result run() final
+    typename Input::result_type run_stage() final
     {
-      auto futures = vector_helper::create_vector<std::future<typename Result::value_type>>(m_funcs.size());
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_all_func_task::call, this, std::move(func)));
-
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
-      for (auto& future : futures)
-        result.push_back(future.get());
-
-      return result;
+      return apply(m_func, this->input());
     }
 
   private:
-    typename Result::value_type call(Func func)
-    {
-      return apply(std::move(func), m_args);
-    }
-
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
+    Func m_func;
 };
 
 
-template<template<typename, typename> class Container, typename Func, typename Alloc, typename... Args>
-class make_all_func_task<void, Container, Func, Alloc, Args...> final : public task<void>
+template<typename Result, typename Func, bool Pass>
+class fail_task final : public next_task<Result, Result>
 {
   public:
-    template<typename... Args_>
-    explicit make_all_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
+    template<typename Func_>
+    fail_task(Func_&& func, task_ptr<Result> prior_task)
+      : next_task<Result, Result>{std::move(prior_task)}
+      , m_func{std::forward<Func_>(func)}
     {}
 
-    void run() final
+    Result run_stage() final
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_funcs.size());
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_all_func_task::call, this, std::move(func)));
-      for (auto& future : futures)
-        future.get();
+      try
+      {
+        return this->run_prior();
+      }
+      catch(...)
+      {
+        return recover(std::integral_constant<bool, Pass>{});
+      }
     }
 
   private:
-    void call(Func func)
+    Result recover(std::true_type)
     {
-      apply(std::move(func), m_args);
+      return m_func(std::current_exception());
     }
 
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
+    Result recover(std::false_type)
+    {
+      return m_func();
+    }
+
+    Func m_func;
 };
 
 
-template<typename Result, typename MethodResult, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class, typename... Args>
-class make_all_settled_class_task final : public task<Result>
+template<typename Result, typename PriorResult, typename Func>
+class finally_task final : public next_task<Result, PriorResult>
 {
   public:
-    template<typename... Args_>
-    explicit make_all_settled_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_args{std::forward<Args_>(args)...}
-      , m_obj{obj}
+    template<typename Func_>
+    finally_task(Func_&& func, task_ptr<PriorResult> prior_task)
+      : next_task<Result, PriorResult>{std::move(prior_task)}
+      , m_func{std::forward<Func_>(func)}
     {}
 
-    Result run() final
+    Result run_stage() final
     {
-      auto futures = vector_helper::create_vector<std::future<MethodResult>>(m_methods.size());
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_all_settled_class_task::call, this, std::move(method)));
-
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
-
-      for (auto& future : futures)
+      try
       {
-        try
-        {
-          result.emplace_back(future.get());
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
+        this->run_prior();
       }
+      catch(...)
+      {}
 
-      return result;
+      return m_func();
     }
 
   private:
-    MethodResult call(Method method)
+    Func m_func;
+};
+
+
+/**
+ * Stage that waits on the timer service after its prior stage. A chain with such a stage is run
+ * by a @ref chain_driver, which advances the stage instead of running it and blocking.
+ */
+template<typename Result>
+class waiting_task : public next_task<Result, Result>
+{
+  public:
+    explicit waiting_task(task_ptr<Result> prior_task)
+      : next_task<Result, Result>{std::move(prior_task)}
     {
-      return class_method_call_helper<MethodResult>::call(std::move(method), m_obj, m_args);
+      this->m_waits = true;
     }
 
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+    std::unique_ptr<wait_state> make_wait() const final
+    {
+      return std::unique_ptr<wait_state>{new wait_slot<Result>{*this}};
+    }
+
+  protected:
+    // Returns true if the prior stage resolved
+    bool settle_prior(join_slot<Result>& slot) const
+    {
+      auto prior = [this] () -> Result { return this->run_prior(); };
+      return slot.settle(prior);
+    }
+
+    static join_slot<Result>& slot(wait_state& state) noexcept
+    {
+      return static_cast<wait_slot<Result>&>(state).slot();
+    }
 };
 
 
-template<typename Result, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class, typename... Args>
-class make_all_settled_class_task<Result, void, Container, Method, Alloc, Class, Args...> final : public task<Result>
+template<typename Result>
+class delay_task final : public waiting_task<Result>
 {
   public:
-    template<typename... Args_>
-    explicit make_all_settled_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_args{std::forward<Args_>(args)...}
-      , m_obj{obj}
+    delay_task(task_ptr<Result> prior_task, timer_service::clock::duration delay)
+      : waiting_task<Result>{std::move(prior_task)}
+      , m_delay{delay}
     {}
 
-    Result run() final
+    Result run_stage() final
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_methods.size());
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_all_settled_class_task::call, this, std::move(method)));
+      auto slot = wait_scope::find<Result>(*this);
+      if (slot)
+        return slot->take();
 
-      Result result;
-      vector_helper::reserve(result, m_methods.size());
-
-      for (auto& future : futures)
-      {
-        try
-        {
-          future.get();
-          result.emplace_back();
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
-      }
+      join_slot<Result> result;
+      if (this->settle_prior(result))
+        timer_helper::wait(m_delay);
 
-      return result;
+      return result.take();
     }
 
-  private:
-    void call(Method method)
+    wait_step advance(wait_state& state) const final
     {
-      class_method_call_helper<void>::call(std::move(method), m_obj, m_args);
+      if (state.waited || !this->settle_prior(this->slot(state)))
+        return wait_step::settled;
+
+      state.waited = true;
+      state.resume_at = timer_service::clock::now() + m_delay;
+      return wait_step::wait;
     }
 
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+  private:
+    const timer_service::clock::duration m_delay;
 };
 
 
-template<typename Result, typename FuncResult, template<typename, typename> class Container,
-         typename Func, typename Alloc, typename... Args>
-class make_all_settled_func_task final : public task<Result>
+template<typename Result>
+class throttle_task final : public waiting_task<Result>
 {
   public:
-    template<typename... Args_>
-    explicit make_all_settled_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
+    throttle_task(task_ptr<Result> prior_task, std::shared_ptr<rate_limiter> limiter)
+      : waiting_task<Result>{std::move(prior_task)}
+      , m_limiter{std::move(limiter)}
     {}
 
-    Result run() final
+    Result run_stage() final
     {
-      auto futures = vector_helper::create_vector<std::future<FuncResult>>(m_funcs.size());
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_all_settled_func_task::call, this, std::move(func)));
-
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
+      auto slot = wait_scope::find<Result>(*this);
+      if (slot)
+        return slot->take();
 
-      for (auto& future : futures)
+      join_slot<Result> result;
+      if (this->settle_prior(result))
       {
-        try
-        {
-          result.emplace_back(future.get());
-        }
-        catch(...)
-        {
-          result.emplace_back(std::current_exception());
-        }
+        auto time = m_limiter->reserve();
+        if (rate_limiter::clock::now() < time)
+          timer_helper::wait_until(time);
       }
 
-      return result;
+      return result.take();
     }
 
-  private:
-    FuncResult call(Func func)
+    wait_step advance(wait_state& state) const final
     {
-      return apply(std::move(func), m_args);
+      if (state.waited || !this->settle_prior(this->slot(state)))
+        return wait_step::settled;
+
+      auto time = m_limiter->reserve();
+      if (time <= rate_limiter::clock::now())
+        return wait_step::settled;
+
+      state.waited = true;
+      state.resume_at = time;
+      return wait_step::wait;
     }
 
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
+  private:
+    const std::shared_ptr<rate_limiter> m_limiter;
 };
 
 
-template<typename Result, template<typename, typename> class Container,
-         typename Func, typename Alloc, typename... Args>
-class make_all_settled_func_task<Result, void, Container, Func, Alloc, Args...> final : public task<Result>
+template<typename Result>
+class retry_task final : public waiting_task<Result>
 {
   public:
-    template<typename... Args_>
-    explicit make_all_settled_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
+    retry_task(task_ptr<Result> prior_task, retry_policy policy)
+      : waiting_task<Result>{std::move(prior_task)}
+      , m_policy{std::move(policy)}
     {}
 
-    Result run() final
+    Result run_stage() final
     {
-      auto futures = vector_helper::create_vector<std::future<void>>(m_funcs.size());
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_all_settled_func_task::call, this, std::move(func)));
-
-      Result result;
-      vector_helper::reserve(result, m_funcs.size());
+      auto slot = wait_scope::find<Result>(*this);
+      if (slot)
+        return slot->take();
 
-      for (auto& future : futures)
+      for (std::size_t attempt = 1;; ++attempt)
       {
         try
         {
-          future.get();
-          result.emplace_back();
+          return this->run_prior();
         }
         catch(...)
         {
-          result.emplace_back(std::current_exception());
+          if (!retries(attempt, std::current_exception()))
+            throw;
         }
+
+        timer_helper::wait(retry_helper::backoff(m_policy, attempt));
       }
+    }
 
-      return result;
+    // The prior stages run again after the backoff, including the waiting ones
+    wait_step advance(wait_state& state) const final
+    {
+      auto& slot = this->slot(state);
+      if (this->settle_prior(slot) || !retries(state.attempt, slot.error()))
+        return wait_step::settled;
+
+      slot.reset();
+      state.resume_at = timer_service::clock::now() + retry_helper::backoff(m_policy, state.attempt++);
+      return wait_step::restart;
     }
 
   private:
-    void call(Func func)
+    bool retries(std::size_t attempt, const std::exception_ptr& err) const
     {
-      apply(std::move(func), m_args);
+      return attempt < m_policy.max_attempts && (!m_policy.retry_on || m_policy.retry_on(err));
     }
 
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
+    const retry_policy m_policy;
 };
 
 
-template<typename Derived, typename Result>
-class make_any_task_base : public iterable_base<Derived>, public task<Result>
+// Sink of a function that settles its stage itself
+struct void_sink
 {
-  public:
-    Result run() final
-    {
-      auto future = m_promise.get_future();
-      m_errors.reserve(this->iterable_size());
-      this->async_run();
-      return future.get();
-    }
+  template<typename Func>
+  void operator()(Func& func)
+  {
+    func();
+  }
+};
 
-  protected:
-    void process_error(std::exception_ptr err)
-    {
-      std::lock_guard<std::mutex> lock{m_mutex};
 
-      m_errors.push_back(std::move(err));
-      if (m_errors.size() < this->iterable_size())
-        return;
+template<typename Result>
+struct join_helper
+{
+  template<typename T>
+  static Result all(fan_out_join<T>& join)
+  {
+    Result result;
+    vector_helper::reserve(result, join.size());
+    for (std::size_t i = 0; i < join.size(); ++i)
+      result.push_back(join[i].take());
 
-      promise_helper::reject(m_promise, std::make_exception_ptr(aggregate_error{std::move(m_errors)}));
-    }
+    return result;
+  }
 
-    std::promise<Result> m_promise;
+  template<typename T>
+  static Result all_settled(fan_out_join<T>& join)
+  {
+    Result result;
+    vector_helper::reserve(result, join.size());
+    for (std::size_t i = 0; i < join.size(); ++i)
+      result.push_back(join[i].take_settled());
 
-  private:
-    std::vector<std::exception_ptr> m_errors;
-    std::mutex m_mutex;
+    return result;
+  }
+};
+
+
+template<>
+struct join_helper<void>
+{
+  template<typename T>
+  static void all(fan_out_join<T>& join)
+  {
+    for (std::size_t i = 0; i < join.size(); ++i)
+      join[i].take();
+  }
 };
 
 
-template<typename Result, template<typename, typename> class Container,
-         typename Method, typename Alloc, typename Class, typename... Args>
-class make_any_class_task final
-    : public make_any_task_base<make_any_class_task<Result, Container, Method, Alloc, Class, Args...>, Result>
+/**
+ * Common part of the fan-out stages: each function of a container is called with the input
+ * of the stage. Methods are bound to their object by the binder, so they are just another callable.
+ */
+template<typename Input, typename Elements, typename Binder>
+class fan_out_task : public Input
 {
   public:
-    template<typename... Args_>
-    explicit make_any_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
+    template<typename... Input_>
+    fan_out_task(Elements elements, Binder binder, Input_&&... input)
+      : Input{std::forward<Input_>(input)...}
+      , m_elements{std::move(elements)}
+      , m_binder{std::move(binder)}
     {}
 
-    void async_run(std::vector<std::future<void>>& futures)
+  protected:
+    using result_type = typename Input::result_type;
+    using input_type = typename Input::input_type;
+    using element_type = typename Elements::value_type;
+    using element_result = decltype(apply(std::declval<const Binder&>()(std::declval<element_type>()),
+                                          std::declval<input_type>()));
+
+    // Each function gets its own copy of the input, so it may take its arguments by rvalue reference
+    element_result call(element_type element, const input_type* input) const
     {
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_any_class_task::call, this, std::move(method)));
+      auto args = *input;
+      return apply(m_binder(std::move(element)), std::move(args));
     }
 
-    void call(Method method)
+    // The calling thread runs the first function itself instead of just waiting for the others
+    void join_all(fan_out_join<element_result>& join, const input_type& input) const
     {
+      auto it = m_elements.begin();
+      auto end = m_elements.end();
+      if (it == end)
+        return;
+
+      const auto& first = *it;
+      for (std::size_t index = 1; ++it != end; ++index)
+      {
+        // Every slot has to be counted down, even if copying the function throws
+        try
+        {
+          launch_helper::launch_into(*this, join.at(index), &fan_out_task::call, this, *it, &input);
+        }
+        catch(...)
+        {
+          join.reject(index, std::current_exception());
+        }
+      }
+
       try
       {
-        auto val = class_method_call_helper<Result>::call(std::move(method), m_obj, m_args);
-        promise_helper::resolve(this->m_promise, std::move(val));
+        launch_helper::run_into(*this, join.at(0), &fan_out_task::call, this, first, &input);
       }
       catch(...)
       {
-        this->process_error(std::current_exception());
+        join.reject(0, std::current_exception());
       }
     }
 
-    std::size_t iterable_size() const
+    Elements m_elements;
+    const Binder m_binder;
+};
+
+
+template<typename Input, typename Elements, typename Binder>
+class all_task final : public fan_out_task<Input, Elements, Binder>
+{
+  public:
+    using fan_out_task<Input, Elements, Binder>::fan_out_task;
+
+    typename Input::result_type run_stage() final
     {
-      return m_methods.size();
+      using base = fan_out_task<Input, Elements, Binder>;
+
+      const auto& input = this->input();
+      fan_out_join<typename base::element_result> join{this->m_elements.size()};
+      this->join_all(join, input);
+      join.wait();
+      return join_helper<typename Input::result_type>::all(join);
     }
+};
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+
+template<typename Input, typename Elements, typename Binder>
+class all_settled_task final : public fan_out_task<Input, Elements, Binder>
+{
+  public:
+    using fan_out_task<Input, Elements, Binder>::fan_out_task;
+
+    typename Input::result_type run_stage() final
+    {
+      using base = fan_out_task<Input, Elements, Binder>;
+
+      const auto& input = this->input();
+      fan_out_join<typename base::element_result> join{this->m_elements.size()};
+      this->join_all(join, input);
+      join.wait();
+      return join_helper<typename Input::result_type>::all_settled(join);
+    }
 };
 
 
-template<template<typename, typename> class Container, typename Method,
-         typename Alloc, typename Class, typename... Args>
-class make_any_class_task<void, Container, Method, Alloc, Class, Args...> final
-    : public make_any_task_base<make_any_class_task<void, Container, Method, Alloc, Class, Args...>, void>
+template<typename Input, typename Elements, typename Binder>
+class any_task final : public fan_out_task<Input, Elements, Binder>
 {
   public:
-    template<typename... Args_>
-    explicit make_any_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+    using fan_out_task<Input, Elements, Binder>::fan_out_task;
 
-    void async_run(std::vector<std::future<void>>& futures)
+    typename Input::result_type run_stage() final
     {
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_any_class_task::call, this, std::move(method)));
+      run_state state;
+      state.errors.reserve(this->m_elements.size());
+      auto future = state.promise.get_future();
+      {
+        future_list<void> futures{this->m_elements.size()};
+        const auto& input = this->input();
+        auto it = this->m_elements.begin();
+        auto end = this->m_elements.end();
+        if (it != end)
+        {
+          const auto& first = *it;
+          while (++it != end)
+            futures.push_back(launch_helper::launch(*this, &any_task::settle, this, *it, &input, &state));
+
+          // The stage waits for every function anyway, so the calling thread runs the first one itself
+          launch_helper::run_into(*this, void_sink{}, &any_task::settle, this, first, &input, &state);
+        }
+      }
+
+      return future_helper::get(future);
     }
 
-    void call(Method method)
+  private:
+    using base = fan_out_task<Input, Elements, Binder>;
+
+    // Kept out of the stage, so the stage can be copied
+    struct run_state
+    {
+      std::promise<typename Input::result_type> promise;
+      std::vector<std::exception_ptr> errors;
+      std::mutex mutex;
+    };
+
+    void settle(typename base::element_type element, const typename base::input_type* input, run_state* state) const
     {
       try
       {
-        class_method_call_helper<void>::call(std::move(method), m_obj, m_args);
-        promise_helper::resolve(this->m_promise);
+        promise_helper::resolve_with(state->promise, [this, &element, input] () { return this->call(std::move(element), input); });
       }
       catch(...)
       {
-        this->process_error(std::current_exception());
+        process_error(*state, std::current_exception());
       }
     }
 
-    std::size_t iterable_size() const
+    void process_error(run_state& state, std::exception_ptr err) const
     {
-      return m_methods.size();
-    }
+      std::lock_guard<std::mutex> lock{state.mutex};
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+      state.errors.push_back(std::move(err));
+      if (state.errors.size() < this->m_elements.size())
+        return;
+
+      promise_helper::reject(state.promise, std::make_exception_ptr(aggregate_error{std::move(state.errors)}));
+    }
 };
 
 
-template<typename Result, template<typename, typename> class Container,
-         typename Func, typename Alloc, typename... Args>
-class make_any_func_task final
-    : public make_any_task_base<make_any_func_task<Result, Container, Func, Alloc, Args...>, Result>
+template<typename Input, typename Elements, typename Binder>
+class race_task final : public fan_out_task<Input, Elements, Binder>
 {
   public:
-    template<typename... Args_>
-    explicit make_any_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+    using fan_out_task<Input, Elements, Binder>::fan_out_task;
 
-    void async_run(std::vector<std::future<void>>& futures)
+    typename Input::result_type run_stage() final
     {
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_any_func_task::call, this, std::move(func)));
+      std::promise<typename Input::result_type> promise;
+      auto future = promise.get_future();
+      {
+        future_list<void> futures{this->m_elements.size()};
+        const auto& input = this->input();
+        auto it = this->m_elements.begin();
+        auto end = this->m_elements.end();
+        if (it != end)
+        {
+          const auto& first = *it;
+          while (++it != end)
+            futures.push_back(launch_helper::launch(*this, &race_task::settle, this, *it, &input, &promise));
+
+          // The stage waits for every function anyway, so the calling thread runs the first one itself
+          launch_helper::run_into(*this, void_sink{}, &race_task::settle, this, first, &input, &promise);
+        }
+      }
+
+      return future_helper::get(future);
     }
 
-    void call(Func func)
+  private:
+    using base = fan_out_task<Input, Elements, Binder>;
+
+    void settle(typename base::element_type element, const typename base::input_type* input,
+                std::promise<typename Input::result_type>* promise) const
     {
       try
       {
-        promise_helper::resolve(this->m_promise, apply(std::move(func), m_args));
+        promise_helper::resolve_with(*promise, [this, &element, input] () { return this->call(std::move(element), input); });
       }
       catch(...)
       {
-        this->process_error(std::current_exception());
+        promise_helper::reject(*promise, std::current_exception());
       }
     }
+};
 
-    std::size_t iterable_size() const
-    {
-      return m_funcs.size();
-    }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
+template<template<typename, typename> class Container, typename FuncResult>
+struct some_result
+{
+  using type = Container<FuncResult, std::allocator<FuncResult>>;
+};
+
+
+template<template<typename, typename> class Container>
+struct some_result<Container, void>
+{
+  using type = void;
+};
+
+
+template<typename Result>
+struct some_storage
+{
+  void reserve(std::size_t size)
+  {
+    vector_helper::reserve(values, size);
+  }
+
+  template<typename Value>
+  void add(Value&& value)
+  {
+    values.push_back(std::forward<Value>(value));
+  }
+
+  void resolve(std::promise<Result>& promise)
+  {
+    promise_helper::resolve(promise, std::move(values));
+  }
+
+  Result values;
+};
+
+
+template<>
+struct some_storage<void>
+{
+  void reserve(std::size_t)
+  {}
+
+  void resolve(std::promise<void>& promise)
+  {
+    promise_helper::resolve(promise);
+  }
 };
 
 
-template<template<typename, typename> class Container, typename Func, typename Alloc, typename... Args>
-class make_any_func_task<void, Container, Func, Alloc, Args...> final
-    : public make_any_task_base<make_any_func_task<void, Container, Func, Alloc, Args...>, void>
+/**
+ * State of a run of a @ref some_task shared with its functions. The functions still running
+ * when the stage settles keep it alive, so the stage does not wait for them.
+ */
+template<typename Result, typename Input, typename Binder>
+class some_state final
 {
   public:
-    template<typename... Args_>
-    explicit make_any_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+    some_state(Input input, Binder binder, std::shared_ptr<concurrency_limiter> limiter, std::size_t count, std::size_t size)
+      : m_input{std::move(input)}
+      , m_binder{std::move(binder)}
+      , m_limiter{std::move(limiter)}
+      , m_count{count}
+      , m_size{size}
+    {
+      m_storage.reserve(count);
+      m_errors.reserve(size - count + 1);
+    }
 
-    void async_run(std::vector<std::future<void>>& futures)
+    std::future<Result> get_future()
     {
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_any_func_task::call, this, std::move(func)));
+      return m_promise.get_future();
     }
 
-    void call(Func func)
+    template<typename Element>
+    void call(Element& element)
     {
+      // Functions that did not start before the stage settled are skipped
+      if (m_settled.load(std::memory_order_acquire))
+        return;
+
       try
       {
-        apply(std::move(func), m_args);
-        promise_helper::resolve(this->m_promise);
+        auto func = m_binder(std::move(element));
+        auto call = [this, &func] () { return apply(func, Input{m_input}); };
+        settle(call, std::is_void<decltype(call())>{});
       }
       catch(...)
       {
-        this->process_error(std::current_exception());
+        reject(std::current_exception());
       }
     }
 
-    std::size_t iterable_size() const
+    void reject(std::exception_ptr err)
     {
-      return m_funcs.size();
+      std::lock_guard<std::mutex> lock{m_mutex};
+      if (m_settled.load(std::memory_order_relaxed))
+        return;
+
+      m_errors.push_back(std::move(err));
+      if (m_errors.size() <= m_size - m_count)
+        return;
+
+      m_settled.store(true, std::memory_order_release);
+      promise_helper::reject(m_promise, std::make_exception_ptr(aggregate_error{std::move(m_errors)}));
     }
 
   private:
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
-};
+    template<typename Call>
+    void settle(Call& call, std::false_type)
+    {
+      auto value = call();
+      std::lock_guard<std::mutex> lock{m_mutex};
+      if (m_settled.load(std::memory_order_relaxed))
+        return;
 
+      m_storage.add(std::move(value));
+      resolved();
+    }
 
-template<typename Derived, typename Result>
-class make_race_task_base : public iterable_base<Derived>, public task<Result>
-{
-  public:
-    Result run() final
+    template<typename Call>
+    void settle(Call& call, std::true_type)
     {
-      auto future = m_promise.get_future();
-      this->async_run();
-      return future.get();
+      call();
+      std::lock_guard<std::mutex> lock{m_mutex};
+      if (m_settled.load(std::memory_order_relaxed))
+        return;
+
+      resolved();
     }
 
-  protected:
+    void resolved()
+    {
+      if (++m_resolved < m_count)
+        return;
+
+      m_settled.store(true, std::memory_order_release);
+      m_storage.resolve(m_promise);
+    }
+
+    const Input m_input;
+    const Binder m_binder;
+    // Detached functions hold a plain pointer to the limiter
+    const std::shared_ptr<concurrency_limiter> m_limiter;
+    const std::size_t m_count;
+    const std::size_t m_size;
+    some_storage<Result> m_storage;
+    std::vector<std::exception_ptr> m_errors;
+    std::size_t m_resolved = 0;
+    std::atomic<bool> m_settled{false};
     std::promise<Result> m_promise;
+    std::mutex m_mutex;
+};
+
+
+template<typename State, typename Element>
+struct some_call final
+{
+  void operator()()
+  {
+    state->call(element);
+  }
+
+  std::shared_ptr<State> state;
+  Element element;
 };
 
 
-template<typename Result, template<typename, typename> class Container, typename Method,
-         typename Alloc, typename Class, typename... Args>
-class make_race_class_task final
-    : public make_race_task_base<make_race_class_task<Result, Container, Method, Alloc, Class, Args...>, Result>
+/**
+ * Settles with the first count resolved results in the order they resolved, or rejects
+ * as soon as fewer than count functions can still resolve. The functions still running
+ * then are left to finish in the background and the ones that did not start are skipped.
+ * An observer and the chain registry do not see the functions, their allocations are counted to the stage kind.
+ */
+template<typename Input, typename Elements, typename Binder>
+class some_task final : public fan_out_task<Input, Elements, Binder>
 {
   public:
-    template<typename... Args_>
-    explicit make_race_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
+    template<typename... Input_>
+    some_task(std::size_t count, Elements elements, Binder binder, Input_&&... input)
+      : fan_out_task<Input, Elements, Binder>{std::move(elements), std::move(binder), std::forward<Input_>(input)...}
+      , m_count{count}
     {}
 
-    void async_run(std::vector<std::future<void>>& futures)
+    typename Input::result_type run_stage() final
     {
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_race_class_task::call, this, std::move(method)));
-    }
+      using base = fan_out_task<Input, Elements, Binder>;
+      using state_type = some_state<typename Input::result_type, typename base::input_type, Binder>;
 
-    void call(Method method)
-    {
-      try
-      {
-        auto val = class_method_call_helper<Result>::call(std::move(method), m_obj, m_args);
-        promise_helper::resolve(this->m_promise, std::move(val));
-      }
-      catch(...)
+      auto input = this->input();
+      auto size = this->m_elements.size();
+      if (0 == m_count)
+        return typename Input::result_type();
+
+      if (size < m_count)
+        throw aggregate_error{{}};
+
+      auto state = std::make_shared<state_type>(std::move(input), this->m_binder, this->options().limiter, m_count, size);
+      auto future = state->get_future();
+
+      for (auto element : this->m_elements)
       {
-        promise_helper::reject(this->m_promise, std::current_exception());
+        try
+        {
+          launch_helper::detach(*this, some_call<state_type, typename base::element_type>{state, std::move(element)});
+        }
+        catch(...)
+        {
+          state->reject(std::current_exception());
+        }
       }
-    }
 
-    std::size_t iterable_size() const
-    {
-      return m_methods.size();
+      return future_helper::get(future);
     }
 
   private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
+    const std::size_t m_count;
 };
 
 
-template<template<typename, typename> class Container, typename Method,
-         typename Alloc, typename Class, typename... Args>
-class make_race_class_task<void, Container, Method, Alloc, Class, Args...> final
-    : public make_race_task_base<make_race_class_task<void, Container, Method, Alloc, Class, Args...>, void>
+/**
+ * State of a run of an @ref all_settled_within_task shared with its functions and the deadline
+ * timer. Every slot starts timed out and is settled by its function unless the deadline passed.
+ */
+template<typename FuncResult, typename Input, typename Binder>
+class settled_within_state final
 {
   public:
-    template<typename... Args_>
-    explicit make_race_class_task(Container<Method, Alloc> methods, Class* obj, Args_&&... args)
-      : m_methods{std::move(methods)}
-      , m_obj{obj}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+    settled_within_state(Input input, Binder binder, std::shared_ptr<concurrency_limiter> limiter, std::size_t size)
+      : m_input{std::move(input)}
+      , m_binder{std::move(binder)}
+      , m_limiter{std::move(limiter)}
+      , m_pending{size}
+    {
+      auto error = std::make_exception_ptr(timeout_error{});
+      m_slots.reserve(size);
+      for (std::size_t i = 0; i < size; ++i)
+        m_slots.emplace_back(settle_type::timed_out, error);
+    }
+
+    std::future<void> get_future()
+    {
+      return m_promise.get_future();
+    }
 
-    void async_run(std::vector<std::future<void>>& futures)
+    bool expired() const
     {
-      for (auto method : m_methods)
-        futures.push_back(std::async(std::launch::async, &make_race_class_task::call, this, std::move(method)));
+      return m_expired.load(std::memory_order_acquire);
     }
 
-    void call(Method method)
+    template<typename Element>
+    void call(std::size_t index, Element& element)
     {
+      // Functions that did not start before the deadline stay timed out
+      if (expired())
+        return;
+
       try
       {
-        class_method_call_helper<void>::call(std::move(method), m_obj, m_args);
-        promise_helper::resolve(this->m_promise);
+        auto func = m_binder(std::move(element));
+        settle(index, make(func, std::is_void<FuncResult>{}));
       }
       catch(...)
       {
-        promise_helper::reject(this->m_promise, std::current_exception());
+        reject(index, std::current_exception());
       }
     }
 
-    std::size_t iterable_size() const
+    void reject(std::size_t index, std::exception_ptr err)
     {
-      return m_methods.size();
+      settle(index, settled<FuncResult>{std::move(err)});
     }
 
-  private:
-    Container<Method, Alloc> m_methods;
-    Class* const m_obj;
-    std::tuple<Args...> m_args;
-};
+    void expire()
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      if (m_expired.load(std::memory_order_relaxed))
+        return;
 
+      m_expired.store(true, std::memory_order_release);
+      promise_helper::resolve(m_promise);
+    }
 
-template<typename Result, template<typename, typename> class Container,
-         typename Func, typename Alloc, typename... Args>
-class make_race_func_task final
-    : public make_race_task_base<make_race_func_task<Result, Container, Func, Alloc, Args...>, Result>
-{
-  public:
-    template<typename... Args_>
-    explicit make_race_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
-    {}
+    template<typename Result>
+    Result take()
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      Result result;
+      vector_helper::reserve(result, m_slots.size());
+      for (auto& slot : m_slots)
+        result.push_back(std::move(slot));
+
+      return result;
+    }
 
-    void async_run(std::vector<std::future<void>>& futures)
+  private:
+    template<typename Func>
+    settled<FuncResult> make(Func& func, std::false_type)
     {
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_race_func_task::call, this, std::move(func)));
+      return settled<FuncResult>{apply(func, Input{m_input})};
     }
 
-    void call(Func func)
+    template<typename Func>
+    settled<FuncResult> make(Func& func, std::true_type)
     {
-      try
-      {
-        promise_helper::resolve(this->m_promise, apply(std::move(func), m_args));
-      }
-      catch(...)
-      {
-        promise_helper::reject(this->m_promise, std::current_exception());
-      }
+      apply(func, Input{m_input});
+      return settled<FuncResult>{};
     }
 
-    std::size_t iterable_size() const
-    {
-      return m_funcs.size();
+    void settle(std::size_t index, settled<FuncResult> value)
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      if (m_expired.load(std::memory_order_relaxed))
+        return;
+
+      m_slots[index] = std::move(value);
+      if (0 != --m_pending)
+        return;
+
+      m_expired.store(true, std::memory_order_release);
+      promise_helper::resolve(m_promise);
     }
 
-  private:
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
+    const Input m_input;
+    const Binder m_binder;
+    // Detached functions hold a plain pointer to the limiter
+    const std::shared_ptr<concurrency_limiter> m_limiter;
+    std::vector<settled<FuncResult>> m_slots;
+    std::size_t m_pending;
+    std::atomic<bool> m_expired{false};
+    std::promise<void> m_promise;
+    std::mutex m_mutex;
+};
+
+
+template<typename State, typename Element>
+struct settled_within_call final
+{
+  void operator()()
+  {
+    state->call(index, element);
+  }
+
+  std::shared_ptr<State> state;
+  std::size_t index;
+  Element element;
 };
 
 
-template<template<typename, typename> class Container, typename Func, typename Alloc, typename... Args>
-class make_race_func_task<void, Container, Func, Alloc, Args...> final
-    : public make_race_task_base<make_race_func_task<void, Container, Func, Alloc, Args...>, void>
+/**
+ * Settles with a @ref settled object per function once all of them settled or the deadline
+ * passed, whichever is first. Functions still running at the deadline are marked timed out
+ * and left to finish in the background, the ones that did not start are skipped.
+ * An observer and the chain registry do not see the functions, their allocations are counted to the stage kind.
+ */
+template<typename Input, typename Elements, typename Binder>
+class all_settled_within_task final : public fan_out_task<Input, Elements, Binder>
 {
   public:
-    template<typename... Args_>
-    explicit make_race_func_task(Container<Func, Alloc> funcs, Args_&&... args)
-      : m_funcs{std::move(funcs)}
-      , m_args{std::forward<Args_>(args)...}
+    template<typename... Input_>
+    all_settled_within_task(timer_service::clock::duration timeout, Elements elements, Binder binder, Input_&&... input)
+      : fan_out_task<Input, Elements, Binder>{std::move(elements), std::move(binder), std::forward<Input_>(input)...}
+      , m_timeout{timeout}
     {}
 
-    void async_run(std::vector<std::future<void>>& futures)
+    typename Input::result_type run_stage() final
     {
-      for (auto func : m_funcs)
-        futures.push_back(std::async(std::launch::async, &make_race_func_task::call, this, std::move(func)));
-    }
+      using base = fan_out_task<Input, Elements, Binder>;
+      using state_type = settled_within_state<typename base::element_result, typename base::input_type, Binder>;
 
-    void call(Func func)
-    {
-      try
-      {
-        apply(std::move(func), m_args);
-        promise_helper::resolve(this->m_promise);
-      }
-      catch(...)
+      auto input = this->input();
+      auto deadline = timer_service::clock::now() + m_timeout;
+      auto size = this->m_elements.size();
+      if (0 == size)
+        return typename Input::result_type();
+
+      auto state = std::make_shared<state_type>(std::move(input), this->m_binder, this->options().limiter, size);
+      auto future = state->get_future();
+
+      // The timer does not keep the state alive once the stage returned
+      std::weak_ptr<state_type> weak = state;
+      auto timer = timer_service::instance().schedule_at(deadline, [weak] {
+        auto state = weak.lock();
+        if (state)
+          state->expire();
+      });
+
+      std::size_t index = 0;
+      for (auto element : this->m_elements)
       {
-        promise_helper::reject(this->m_promise, std::current_exception());
+        if (state->expired())
+          break;
+
+        try
+        {
+          // A limiter must not hold the launch past the deadline
+          if (!launch_helper::detach_until(*this, deadline, settled_within_call<state_type, typename base::element_type>{state, index, std::move(element)}))
+            break;
+        }
+        catch(...)
+        {
+          state->reject(index, std::current_exception());
+        }
+
+        ++index;
       }
-    }
 
-    std::size_t iterable_size() const
-    {
-      return m_funcs.size();
+      future_helper::get(future);
+
+      // All functions could settle before the deadline, the wheel should not keep the entry until then
+      timer_service::instance().cancel(timer);
+      return state->template take<typename Input::result_type>();
     }
 
   private:
-    Container<Func, Alloc> m_funcs;
-    std::tuple<Args...> m_args;
+    const timer_service::clock::duration m_timeout;
 };
 
 
@@ -2738,7 +5445,7 @@ class make_resolved_task final : public task<Result>
       : m_val{std::forward<T>(val)}
     {}
 
-    Result run() final
+    Result run_stage() final
     {
       return m_val;
     }
@@ -2752,7 +5459,7 @@ template<>
 class make_resolved_task<void> final : public task<void>
 {
   public:
-    void run() final
+    void run_stage() final
     {}
 };
 
@@ -2766,7 +5473,7 @@ class make_rejected_task final : public task<Result>
       : m_error{std::forward<T>(error)}
     {}
 
-    Result run() final
+    Result run_stage() final
     {
       std::rethrow_exception(std::make_exception_ptr(std::move(m_error)));
     }
@@ -2775,6 +5482,41 @@ class make_rejected_task final : public task<Result>
     Error m_error;
 };
 
+
+class make_delay_task final : public task<void>
+{
+  public:
+    explicit make_delay_task(timer_service::clock::duration delay)
+      : m_delay{delay}
+    {
+      this->m_waits = true;
+    }
+
+    void run_stage() final
+    {
+      if (!wait_scope::find<void>(*this))
+        timer_helper::wait(m_delay);
+    }
+
+    std::unique_ptr<wait_state> make_wait() const final
+    {
+      return std::unique_ptr<wait_state>{new wait_slot<void>{*this}};
+    }
+
+    wait_step advance(wait_state& state) const final
+    {
+      if (state.waited)
+        return wait_step::settled;
+
+      state.waited = true;
+      state.resume_at = timer_service::clock::now() + m_delay;
+      return wait_step::wait;
+    }
+
+  private:
+    const timer_service::clock::duration m_delay;
+};
+
 } // namespace internal
 
 
@@ -2799,10 +5541,11 @@ class promise
      * @param args - Optional arguments.
      */
     template<typename Method, typename Class, typename... Args,
-             typename task = internal::initial_class_task<T, Method, Class, Args...>,
+             typename call = internal::method_call<typename std::decay<Method>::type, Class>,
+             typename task = internal::call_task<internal::args_input<T, Args...>, call>,
              typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
     promise(Method&& method, Class* obj, Args&&... args)
-      : m_task{std::make_shared<task>(std::forward<Method>(method), obj, std::forward<Args>(args)...)}
+      : m_task{internal::task_helper::make<task>(stage_kind::initial, call{std::forward<Method>(method), obj}, std::forward<Args>(args)...)}
     {};
 
 
@@ -2812,9 +5555,9 @@ class promise
      * @param args - Optional arguments.
      */
     template<typename Func, typename... Args,
-             typename task = internal::initial_func_task<T, Func, Args...>>
+             typename task = internal::call_task<internal::args_input<T, Args...>, Func>>
     explicit promise(Func&& func, Args&&... args)
-      : m_task{std::make_shared<task>(std::forward<Func>(func), std::forward<Args>(args)...)}
+      : m_task{internal::task_helper::make<task>(stage_kind::initial, std::forward<Func>(func), std::forward<Args>(args)...)}
     {};
 
 
@@ -2838,8 +5581,9 @@ class promise
     template<typename Method, typename Class, typename Result = typename std::result_of<Method(Class*)>::type>
     promise<Result> then(Method&& method, Class* obj) const
     {
-      using task = internal::then_class_task_void<Result, T, Method, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Method>(method), obj)};
+      using call = internal::method_call<typename std::decay<Method>::type, Class>;
+      using task = internal::call_task<internal::prior_input<Result, T, false>, call>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::then, call{std::forward<Method>(method), obj}, m_task)};
     }
 
 
@@ -2853,8 +5597,9 @@ class promise
              typename Result = typename std::result_of<Method(Class*, Arg)>::type>
     promise<Result> then(Method&& method, Class* obj) const
     {
-      using task = internal::then_class_task<Result, T, Method, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Method>(method), obj)};
+      using call = internal::method_call<typename std::decay<Method>::type, Class>;
+      using task = internal::call_task<internal::prior_input<Result, T, true>, call>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::then, call{std::forward<Method>(method), obj}, m_task)};
     }
 
 
@@ -2866,8 +5611,8 @@ class promise
     template<typename Func, typename Result = typename std::result_of<Func()>::type>
     promise<Result> then(Func&& func) const
     {
-      using task = internal::then_func_task_void<Result, T, Func>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Func>(func))};
+      using task = internal::call_task<internal::prior_input<Result, T, false>, Func>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::then, std::forward<Func>(func), m_task)};
     }
 
 
@@ -2881,8 +5626,8 @@ class promise
              typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
     promise<Result> then(Func&& func) const
     {
-      using task = internal::then_func_task<Result, T, Func>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Func>(func))};
+      using task = internal::call_task<internal::prior_input<Result, T, true>, Func>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::then, std::forward<Func>(func), m_task)};
     }
 
 
@@ -2898,8 +5643,9 @@ class promise
              typename = typename std::enable_if<std::is_same<Result, T>::value>::type>
     promise<Result> fail(Method&& method, Class* obj) const
     {
-      using task = internal::fail_class_task<Result, T, Method, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Method>(method), obj)};
+      using call = internal::method_call<typename std::decay<Method>::type, Class>;
+      using task = internal::fail_task<Result, call, true>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::fail, call{std::forward<Method>(method), obj}, m_task)};
     }
 
 
@@ -2915,8 +5661,9 @@ class promise
              typename = typename std::enable_if<std::is_same<Result, T>::value>::type>
     promise<Result> fail(Method&& method, Class* obj) const
     {
-      using task = internal::fail_class_task_void<Result, T, Method, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Method>(method), obj)};
+      using call = internal::method_call<typename std::decay<Method>::type, Class>;
+      using task = internal::fail_task<Result, call, false>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::fail, call{std::forward<Method>(method), obj}, m_task)};
     }
 
 
@@ -2931,8 +5678,8 @@ class promise
              typename = typename std::enable_if<std::is_same<Result, T>::value>::type>
     promise<Result> fail(Func&& func) const
     {
-      using task = internal::fail_func_task<Result, T, Func>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Func>(func))};
+      using task = internal::fail_task<Result, Func, true>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::fail, std::forward<Func>(func), m_task)};
     }
 
 
@@ -2946,8 +5693,8 @@ class promise
              typename = typename std::enable_if<std::is_same<Result, T>::value>::type>
     promise<Result> fail(Func&& func) const
     {
-      using task = internal::fail_func_task_void<Result, T, Func>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Func>(func))};
+      using task = internal::fail_task<Result, Func, false>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::fail, std::forward<Func>(func), m_task)};
     }
 
 
@@ -2960,8 +5707,9 @@ class promise
     template<typename Method, typename Class, typename Result = typename std::result_of<Method(Class*)>::type>
     promise<Result> finally(Method&& method, Class* obj) const
     {
-      using task = internal::finally_class_task<Result, T, Method, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Method>(method), obj)};
+      using call = internal::method_call<typename std::decay<Method>::type, Class>;
+      using task = internal::finally_task<Result, T, call>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::finally, call{std::forward<Method>(method), obj}, m_task)};
     }
 
 
@@ -2973,8 +5721,55 @@ class promise
     template<typename Func, typename Result = typename std::result_of<Func()>::type>
     promise<Result> finally(Func&& func) const
     {
-      using task = internal::finally_func_task<Result, T, Func>;
-      return promise<Result>{std::make_shared<task>(m_task, std::forward<Func>(func))};
+      using task = internal::finally_task<Result, T, Func>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::finally, std::forward<Func>(func), m_task)};
+    }
+
+
+    /**
+     * @brief Add a delay to be waited if the previous function was resolved.
+     *        The result of the previous function is passed through, a rejection is not delayed.
+     *        Waiting is driven by the shared timer service and does not hold a thread: the chain
+     *        is resumed on its thread pool or a new thread once the delay is over. Only a chain run
+     *        with std::launch::deferred blocks the thread getting its result.
+     * @param duration - Delay duration.
+     * @return Promise object.
+     */
+    template<typename Rep, typename Period>
+    promise<T> delay(std::chrono::duration<Rep, Period> duration) const
+    {
+      using task = internal::delay_task<T>;
+      auto delay = std::chrono::duration_cast<internal::timer_service::clock::duration>(duration);
+      return promise<T>{internal::task_helper::make<task>(stage_kind::delay, m_task, delay)};
+    }
+
+
+    /**
+     * @brief Add a wait for a token of a rate limiter if the previous function was resolved.
+     *        The result of the previous function is passed through, a rejection does not take a token.
+     *        Waiting is driven by the shared timer service and does not hold a thread,
+     *        see @ref delay.
+     * @param limiter - Rate limiter that can be shared with other chains.
+     * @return Promise object.
+     */
+    promise<T> throttle(std::shared_ptr<rate_limiter> limiter) const
+    {
+      using task = internal::throttle_task<T>;
+      return promise<T>{internal::task_helper::make<task>(stage_kind::throttle, m_task, std::move(limiter))};
+    }
+
+
+    /**
+     * @brief Add a retry of the previous part of the chain if it was rejected.
+     *        The same chain is executed again after a backoff delay driven by the shared timer service,
+     *        which does not hold a thread between attempts, see @ref delay.
+     * @param policy - Retry policy.
+     * @return Promise object.
+     */
+    promise<T> retry(retry_policy policy) const
+    {
+      using task = internal::retry_task<T>;
+      return promise<T>{internal::task_helper::make<task>(stage_kind::retry, m_task, std::move(policy))};
     }
 
 
@@ -2992,8 +5787,8 @@ class promise
              typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
     promise<Result> all(Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_class_task<Result, Arg, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::all_task<internal::prior_input<Result, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
@@ -3010,8 +5805,8 @@ class promise
              typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
     promise<Result> all(Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_class_task_void<Result, T, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::all_task<internal::prior_input<Result, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
@@ -3028,8 +5823,8 @@ class promise
              typename = typename std::enable_if<std::is_void<FuncResult>::value>::type>
     promise<void> all(Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_class_task<void, Arg, Container, Method, Alloc, Class>;
-      return promise<void>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::all_task<internal::prior_input<void, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<void>{internal::task_helper::make<task>(stage_kind::all, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
@@ -3045,8 +5840,8 @@ class promise
              typename = typename std::enable_if<std::is_void<FuncResult>::value>::type>
     promise<void> all(Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_class_task_void<void, void, Container, Method, Alloc, Class>;
-      return promise<void>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::all_task<internal::prior_input<void, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<void>{internal::task_helper::make<task>(stage_kind::all, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
@@ -3063,8 +5858,8 @@ class promise
              typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
     promise<Result> all(Container<Func, Alloc> funcs) const
     {
-      using task = internal::all_func_task<Result, Arg, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_task<internal::prior_input<Result, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
@@ -3080,8 +5875,8 @@ class promise
              typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
     promise<Result> all(Container<Func, Alloc> funcs) const
     {
-      using task = internal::all_func_task_void<Result, T, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_task<internal::prior_input<Result, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
@@ -3097,8 +5892,8 @@ class promise
              typename = typename std::enable_if<std::is_void<FuncResult>::value>::type>
     promise<void> all(Container<Func, Alloc> funcs) const
     {
-      using task = internal::all_func_task<void, Arg, Container, Func, Alloc>;
-      return promise<void>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_task<internal::prior_input<void, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<void>{internal::task_helper::make<task>(stage_kind::all, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
@@ -3113,8 +5908,8 @@ class promise
              typename = typename std::enable_if<std::is_void<FuncResult>::value>::type>
     promise<void> all(Container<Func, Alloc> funcs) const
     {
-      using task = internal::all_func_task_void<void, void, Container, Func, Alloc>;
-      return promise<void>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_task<internal::prior_input<void, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<void>{internal::task_helper::make<task>(stage_kind::all, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
@@ -3132,8 +5927,8 @@ class promise
              typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
     promise<Result> all_settled(Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_settled_class_task<Result, Arg, FuncResult, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::all_settled_task<internal::prior_input<Result, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
@@ -3151,8 +5946,8 @@ class promise
              typename = typename std::true_type::type>
     promise<Result> all_settled(Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_settled_class_task_void<Result, T, void, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::all_settled_task<internal::prior_input<Result, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
@@ -3171,242 +5966,516 @@ class promise
              typename = typename std::true_type::type>
     promise<Result> all_settled(Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_settled_class_task<Result, Arg, void, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::all_settled_task<internal::prior_input<Result, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the class methods to be called next.
+     *        Return an iterable of @ref settled objects with either a result or an error.
+     * @param methods - Methods that receives the result of the previous function.
+     * @param obj - Object containing the required methods.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
+             typename FuncResult = typename std::result_of<Method(Class*)>::type,
+             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
+             typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
+    promise<Result> all_settled(Container<Method, Alloc> methods, Class* obj) const
+    {
+      using task = internal::all_settled_task<internal::prior_input<Result, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the functions to be called next.
+     *        Return an iterable of @ref settled objects with either a result or an error.
+     * @param funcs - Functions that receives the result of the previous function.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename Arg = T, typename FuncResult = typename std::result_of<Func(Arg)>::type,
+             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type,
+             typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
+    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+    {
+      using task = internal::all_settled_task<internal::prior_input<Result, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(funcs), internal::func_binder{}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the functions to be called next.
+     *        Return an iterable of @ref settled objects with either a result or an error.
+     * @param funcs - Functions that receives the result of the previous function.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename FuncResult = typename std::result_of<Func()>::type,
+             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
+             typename = typename std::enable_if<std::is_void<FuncResult>::value>::type,
+             typename = typename std::true_type::type>
+    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+    {
+      using task = internal::all_settled_task<internal::prior_input<Result, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(funcs), internal::func_binder{}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the functions to be called next.
+     *        Return an iterable of @ref settled objects with either a result or an error.
+     * @param funcs - Functions that receives the result of the previous function.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename Arg = T, typename FuncResult = typename std::result_of<Func(Arg)>::type,
+             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type,
+             typename = typename std::enable_if<std::is_void<FuncResult>::value>::type,
+             typename = typename std::true_type::type>
+    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+    {
+      using task = internal::all_settled_task<internal::prior_input<Result, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(funcs), internal::func_binder{}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the functions to be called next.
+     *        Return an iterable of @ref settled objects with either a result or an error.
+     * @param funcs - Functions that receives the result of the previous function.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename FuncResult = typename std::result_of<Func()>::type,
+             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
+             typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
+    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+    {
+      using task = internal::all_settled_task<internal::prior_input<Result, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(funcs), internal::func_binder{}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the class methods to be called next.
+     *        Return the first resolved result.
+     * @param methods - Methods that receives the result of the previous function.
+     * @param obj - Object containing the required methods.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
+             typename Arg = T, typename Result = typename std::result_of<Method(Class*, Arg)>::type,
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
+    promise<Result> any(Container<Method, Alloc> methods, Class* obj) const
+    {
+      using task = internal::any_task<internal::prior_input<Result, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::any, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the class methods to be called next.
+     *        Return the first resolved result.
+     * @param methods - Methods that not receives any result of the previous function.
+     * @param obj - Object containing the required methods.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
+             typename Result = typename std::result_of<Method(Class*)>::type>
+    promise<Result> any(Container<Method, Alloc> methods, Class* obj) const
+    {
+      using task = internal::any_task<internal::prior_input<Result, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::any, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the functions to be called next.
+     *        Return the first resolved result.
+     * @param funcs - Functions that receives the result of the previous function.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename Arg = T, typename Result = typename std::result_of<Func(Arg)>::type,
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
+    promise<Result> any(Container<Func, Alloc> funcs) const
+    {
+      using task = internal::any_task<internal::prior_input<Result, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::any, std::move(funcs), internal::func_binder{}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the functions to be called next.
+     *        Return the first resolved result.
+     * @param funcs - Functions that not receives any result of the previous function.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename Result = typename std::result_of<Func()>::type>
+    promise<Result> any(Container<Func, Alloc> funcs) const
+    {
+      using task = internal::any_task<internal::prior_input<Result, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::any, std::move(funcs), internal::func_binder{}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the class methods to be called next.
+     *        Return either the first resolved or rejected result.
+     * @param methods - Methods that receives the result of the previous function.
+     * @param obj - Object containing the required methods.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
+             typename Arg = T, typename Result = typename std::result_of<Method(Class*, Arg)>::type,
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
+    promise<Result> race(Container<Method, Alloc> methods, Class* obj) const
+    {
+      using task = internal::race_task<internal::prior_input<Result, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::race, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the class methods to be called next.
+     *        Return either the first resolved or rejected result.
+     * @param methods - Methods that not receives any result of the previous function.
+     * @param obj - Object containing the required methods.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
+             typename Result = typename std::result_of<Method(Class*)>::type>
+    promise<Result> race(Container<Method, Alloc> methods, Class* obj) const
+    {
+      using task = internal::race_task<internal::prior_input<Result, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::race, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
+    }
+
+
+    /**
+     * @brief Add an iterable of the functions to be called next.
+     *        Return either the first resolved or rejected result.
+     * @param funcs - Functions that receives the result of the previous function.
+     * @return Promise object.
+     */
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename Arg = T, typename Result = typename std::result_of<Func(Arg)>::type,
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
+    promise<Result> race(Container<Func, Alloc> funcs) const
+    {
+      using task = internal::race_task<internal::prior_input<Result, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::race, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
     /**
-     * @brief Add an iterable of the class methods to be called next.
-     *        Return an iterable of @ref settled objects with either a result or an error.
-     * @param methods - Methods that receives the result of the previous function.
-     * @param obj - Object containing the required methods.
+     * @brief Add an iterable of the functions to be called next.
+     *        Return either the first resolved or rejected result.
+     * @param funcs - Functions that not receives any result of the previous function.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
-             typename FuncResult = typename std::result_of<Method(Class*)>::type,
-             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
-             typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
-    promise<Result> all_settled(Container<Method, Alloc> methods, Class* obj) const
+    template<template<typename, typename> class Container, typename Func, typename Alloc,
+             typename Result = typename std::result_of<Func()>::type>
+    promise<Result> race(Container<Func, Alloc> funcs) const
     {
-      using task = internal::all_settled_class_task_void<Result, T, FuncResult, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::race_task<internal::prior_input<Result, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::race, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
     /**
-     * @brief Add an iterable of the functions to be called next.
-     *        Return an iterable of @ref settled objects with either a result or an error.
-     * @param funcs - Functions that receives the result of the previous function.
+     * @brief Add an iterable of the class methods to be called next.
+     *        Return an iterable of @ref settled objects with either a result or an error once all methods
+     *        settled or the timeout passed. Methods still running then are marked as @ref settle_type::timed_out
+     *        and finish in the background.
+     * @param timeout - Maximum duration of the stage.
+     * @param methods - Methods that receives the result of the previous function.
+     * @param obj - Object containing the required methods. It must outlive every method the stage started,
+     *        not only the chain.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Func, typename Alloc,
-             typename Arg = T, typename FuncResult = typename std::result_of<Func(Arg)>::type,
+    template<typename Rep, typename Period,
+             template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
+             typename Arg = T, typename FuncResult = typename std::result_of<Method(Class*, Arg)>::type,
              typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
-             typename = typename std::enable_if<!std::is_void<Arg>::value>::type,
-             typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
-    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
+    promise<Result> all_settled_within(std::chrono::duration<Rep, Period> timeout, Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_settled_func_task<Result, Arg, FuncResult, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_settled_within_task<internal::prior_input<Result, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      auto duration = std::chrono::duration_cast<internal::timer_service::clock::duration>(timeout);
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, duration, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
     /**
-     * @brief Add an iterable of the functions to be called next.
-     *        Return an iterable of @ref settled objects with either a result or an error.
-     * @param funcs - Functions that receives the result of the previous function.
+     * @brief Add an iterable of the class methods to be called next.
+     *        Return an iterable of @ref settled objects with either a result or an error once all methods
+     *        settled or the timeout passed. Methods still running then are marked as @ref settle_type::timed_out
+     *        and finish in the background.
+     * @param timeout - Maximum duration of the stage.
+     * @param methods - Methods that not receives any result of the previous function.
+     * @param obj - Object containing the required methods. It must outlive every method the stage started,
+     *        not only the chain.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Func, typename Alloc,
-             typename FuncResult = typename std::result_of<Func()>::type,
-             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
-             typename = typename std::enable_if<std::is_void<FuncResult>::value>::type,
-             typename = typename std::true_type::type>
-    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+    template<typename Rep, typename Period,
+             template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
+             typename FuncResult = typename std::result_of<Method(Class*)>::type,
+             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>>
+    promise<Result> all_settled_within(std::chrono::duration<Rep, Period> timeout, Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::all_settled_func_task_void<Result, T, void, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_settled_within_task<internal::prior_input<Result, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      auto duration = std::chrono::duration_cast<internal::timer_service::clock::duration>(timeout);
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, duration, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
     /**
      * @brief Add an iterable of the functions to be called next.
-     *        Return an iterable of @ref settled objects with either a result or an error.
+     *        Return an iterable of @ref settled objects with either a result or an error once all functions
+     *        settled or the timeout passed. Functions still running then are marked as @ref settle_type::timed_out
+     *        and finish in the background.
+     * @param timeout - Maximum duration of the stage.
      * @param funcs - Functions that receives the result of the previous function.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Func, typename Alloc,
+    template<typename Rep, typename Period,
+             template<typename, typename> class Container, typename Func, typename Alloc,
              typename Arg = T, typename FuncResult = typename std::result_of<Func(Arg)>::type,
              typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
-             typename = typename std::enable_if<!std::is_void<Arg>::value>::type,
-             typename = typename std::enable_if<std::is_void<FuncResult>::value>::type,
-             typename = typename std::true_type::type>
-    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
+    promise<Result> all_settled_within(std::chrono::duration<Rep, Period> timeout, Container<Func, Alloc> funcs) const
     {
-      using task = internal::all_settled_func_task<Result, Arg, void, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_settled_within_task<internal::prior_input<Result, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      auto duration = std::chrono::duration_cast<internal::timer_service::clock::duration>(timeout);
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, duration, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
     /**
      * @brief Add an iterable of the functions to be called next.
-     *        Return an iterable of @ref settled objects with either a result or an error.
-     * @param funcs - Functions that receives the result of the previous function.
+     *        Return an iterable of @ref settled objects with either a result or an error once all functions
+     *        settled or the timeout passed. Functions still running then are marked as @ref settle_type::timed_out
+     *        and finish in the background.
+     * @param timeout - Maximum duration of the stage.
+     * @param funcs - Functions that not receives any result of the previous function.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Func, typename Alloc,
+    template<typename Rep, typename Period,
+             template<typename, typename> class Container, typename Func, typename Alloc,
              typename FuncResult = typename std::result_of<Func()>::type,
-             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
-             typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
-    promise<Result> all_settled(Container<Func, Alloc> funcs) const
+             typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>>
+    promise<Result> all_settled_within(std::chrono::duration<Rep, Period> timeout, Container<Func, Alloc> funcs) const
     {
-      using task = internal::all_settled_func_task_void<Result, T, FuncResult, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::all_settled_within_task<internal::prior_input<Result, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      auto duration = std::chrono::duration_cast<internal::timer_service::clock::duration>(timeout);
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, duration, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
     /**
      * @brief Add an iterable of the class methods to be called next.
-     *        Return the first resolved result.
+     *        Return the first count resolved results in the order they resolved.
+     *        Reject with an @ref aggregate_error as soon as fewer than count methods can still resolve.
+     *        The stage does not wait for the methods still running when it settles,
+     *        an observer and the chain registry do not see the methods.
+     * @param count - Number of results to wait for.
      * @param methods - Methods that receives the result of the previous function.
-     * @param obj - Object containing the required methods.
+     * @param obj - Object containing the required methods. It must outlive every method the stage started,
+     *        not only the chain.
      * @return Promise object.
      */
     template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
-             typename Arg = T, typename Result = typename std::result_of<Method(Class*, Arg)>::type,
+             typename Arg = T, typename FuncResult = typename std::result_of<Method(Class*, Arg)>::type,
+             typename Result = typename internal::some_result<Container, FuncResult>::type,
              typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
-    promise<Result> any(Container<Method, Alloc> methods, Class* obj) const
+    promise<Result> some(std::size_t count, Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::any_class_task<Result, Arg, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::some_task<internal::prior_input<Result, T, true>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::some, count, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
     /**
      * @brief Add an iterable of the class methods to be called next.
-     *        Return the first resolved result.
-     * @param methods - Methods that not receives any result of the previous function.
-     * @param obj - Object containing the required methods.
+     *        Return the first count resolved results in the order they resolved.
+     *        Reject with an @ref aggregate_error as soon as fewer than count methods can still resolve.
+     *        The stage does not wait for the methods still running when it settles,
+     *        an observer and the chain registry do not see the methods.
+     * @param count - Number of results to wait for.
+     * @param methods - Methods that not receives any the result of the previous function.
+     * @param obj - Object containing the required methods. It must outlive every method the stage started,
+     *        not only the chain.
      * @return Promise object.
      */
     template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
-             typename Result = typename std::result_of<Method(Class*)>::type>
-    promise<Result> any(Container<Method, Alloc> methods, Class* obj) const
+             typename FuncResult = typename std::result_of<Method(Class*)>::type,
+             typename Result = typename internal::some_result<Container, FuncResult>::type>
+    promise<Result> some(std::size_t count, Container<Method, Alloc> methods, Class* obj) const
     {
-      using task = internal::any_class_task_void<Result, T, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      using task = internal::some_task<internal::prior_input<Result, T, false>, Container<Method, Alloc>, internal::method_binder<Class>>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::some, count, std::move(methods), internal::method_binder<Class>{obj}, m_task)};
     }
 
 
     /**
      * @brief Add an iterable of the functions to be called next.
-     *        Return the first resolved result.
+     *        Return the first count resolved results in the order they resolved.
+     *        Reject with an @ref aggregate_error as soon as fewer than count functions can still resolve.
+     *        The stage does not wait for the functions still running when it settles,
+     *        an observer and the chain registry do not see the functions.
+     * @param count - Number of results to wait for.
      * @param funcs - Functions that receives the result of the previous function.
      * @return Promise object.
      */
     template<template<typename, typename> class Container, typename Func, typename Alloc,
-             typename Arg = T, typename Result = typename std::result_of<Func(Arg)>::type,
+             typename Arg = T, typename FuncResult = typename std::result_of<Func(Arg)>::type,
+             typename Result = typename internal::some_result<Container, FuncResult>::type,
              typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
-    promise<Result> any(Container<Func, Alloc> funcs) const
+    promise<Result> some(std::size_t count, Container<Func, Alloc> funcs) const
     {
-      using task = internal::any_func_task<Result, Arg, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::some_task<internal::prior_input<Result, T, true>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::some, count, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
     /**
      * @brief Add an iterable of the functions to be called next.
-     *        Return the first resolved result.
-     * @param funcs - Functions that not receives any result of the previous function.
+     *        Return the first count resolved results in the order they resolved.
+     *        Reject with an @ref aggregate_error as soon as fewer than count functions can still resolve.
+     *        The stage does not wait for the functions still running when it settles,
+     *        an observer and the chain registry do not see the functions.
+     * @param count - Number of results to wait for.
+     * @param funcs - Functions that not receives any the result of the previous function.
      * @return Promise object.
      */
     template<template<typename, typename> class Container, typename Func, typename Alloc,
-             typename Result = typename std::result_of<Func()>::type>
-    promise<Result> any(Container<Func, Alloc> funcs) const
+             typename FuncResult = typename std::result_of<Func()>::type,
+             typename Result = typename internal::some_result<Container, FuncResult>::type>
+    promise<Result> some(std::size_t count, Container<Func, Alloc> funcs) const
     {
-      using task = internal::any_func_task_void<Result, T, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      using task = internal::some_task<internal::prior_input<Result, T, false>, Container<Func, Alloc>, internal::func_binder>;
+      return promise<Result>{internal::task_helper::make<task>(stage_kind::some, count, std::move(funcs), internal::func_binder{}, m_task)};
     }
 
 
     /**
-     * @brief Add an iterable of the class methods to be called next.
-     *        Return either the first resolved or rejected result.
-     * @param methods - Methods that receives the result of the previous function.
-     * @param obj - Object containing the required methods.
+     * @brief Name the last stage of the chain. The name is passed to an @ref observer.
+     *        The last stage is copied, so this promise and its copies keep their names.
+     * @param name - Stage name.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
-             typename Arg = T, typename Result = typename std::result_of<Method(Class*, Arg)>::type,
-             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
-    promise<Result> race(Container<Method, Alloc> methods, Class* obj) const
+    promise<T> name(std::string name) const
     {
-      using task = internal::race_class_task<Result, Arg, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      auto task = internal::task_helper::configurable(m_task);
+      task->name(std::move(name));
+      return promise<T>{std::move(task)};
     }
 
 
     /**
-     * @brief Add an iterable of the class methods to be called next.
-     *        Return either the first resolved or rejected result.
-     * @param methods - Methods that not receives any result of the previous function.
-     * @param obj - Object containing the required methods.
+     * @brief Limit the number of functions run at once by the last fan-out stage of the chain.
+     *        Has no effect if the last stage is not @ref all, @ref all_settled, @ref any, @ref race
+     *        or @ref some or one of the corresponding make functions.
+     *        The last stage is copied, so this promise and its copies are not limited.
+     * @param limiter - Concurrency limiter that can be shared with other stages.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Method, typename Alloc, typename Class,
-             typename Result = typename std::result_of<Method(Class*)>::type>
-    promise<Result> race(Container<Method, Alloc> methods, Class* obj) const
+    promise<T> limit(std::shared_ptr<concurrency_limiter> limiter) const
     {
-      using task = internal::race_class_task_void<Result, T, Container, Method, Alloc, Class>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(methods), obj)};
+      auto task = internal::task_helper::configurable(m_task);
+      task->limit(std::move(limiter));
+      return promise<T>{std::move(task)};
     }
 
 
     /**
-     * @brief Add an iterable of the functions to be called next.
-     *        Return either the first resolved or rejected result.
-     * @param funcs - Functions that receives the result of the previous function.
+     * @brief Run the functions of the last fan-out stage of the chain on a thread pool
+     *        instead of a new thread per function. Has no effect if the last stage is not
+     *        @ref all, @ref all_settled, @ref any, @ref race or @ref some or one of the corresponding make functions.
+     *        The last stage is copied, so this promise and its copies keep their threads.
+     * @param pool - Thread pool that can be shared with other stages. It must outlive the chain.
      * @return Promise object.
      */
-    template<template<typename, typename> class Container, typename Func, typename Alloc,
-             typename Arg = T, typename Result = typename std::result_of<Func(Arg)>::type,
-             typename = typename std::enable_if<!std::is_void<Arg>::value>::type>
-    promise<Result> race(Container<Func, Alloc> funcs) const
+    promise<T> on(thread_pool& pool) const
     {
-      using task = internal::race_func_task<Result, Arg, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+      auto task = internal::task_helper::configurable(m_task);
+      task->on(pool);
+      return promise<T>{std::move(task)};
     }
 
 
     /**
-     * @brief Add an iterable of the functions to be called next.
-     *        Return either the first resolved or rejected result.
-     * @param funcs - Functions that not receives any result of the previous function.
-     * @return Promise object.
+     * @brief Run execution of a chain of the functions. A chain with a @ref delay, @ref throttle
+     *        or @ref retry run asynchronously is driven by the timer service, so unlike a future
+     *        of std::async its future does not wait for the chain when destroyed.
+     * @param policy - Launch policy
+     * @return Future with the result of execution
      */
-    template<template<typename, typename> class Container, typename Func, typename Alloc,
-             typename Result = typename std::result_of<Func()>::type>
-    promise<Result> race(Container<Func, Alloc> funcs) const
+    std::future<T> run(std::launch policy = std::launch::async) const
     {
-      using task = internal::race_func_task_void<Result, T, Container, Func, Alloc>;
-      return promise<Result>{std::make_shared<task>(m_task, std::move(funcs))};
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      internal::allocation_scope allocations{m_task->kind(), internal::allocation_origin::library};
+#endif
+      if (std::launch::async == (policy & std::launch::async))
+      {
+        if (m_task->waits())
+          return internal::chain_driver<T>::run(m_task, nullptr, std::promise<T>{});
+
+        internal::runtime_counters::add(internal::counter::threads_created);
+      }
+
+      return std::async(policy, &promise::run_task, m_task);
     }
 
 
     /**
-     * @brief Run execution of a chain of the functions
-     * @param policy - Launch policy
+     * @brief Run execution of a chain of the functions on a thread pool
+     * @param pool - Thread pool
      * @return Future with the result of execution
      */
-    std::future<T> run(std::launch policy = std::launch::async) const
+    std::future<T> run(thread_pool& pool) const
+    {
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      internal::allocation_scope allocations{m_task->kind(), internal::allocation_origin::library};
+#endif
+      if (m_task->waits())
+        return internal::chain_driver<T>::run(m_task, &pool, std::promise<T>{});
+
+      return pool.submit(&promise::run_task, m_task);
+    }
+
+    /**
+     * @brief Run execution of a chain of the functions on a thread pool, allocating the shared
+     *        state of the future with an allocator. A prebuilt chain of sequential stages run this way
+     *        with an @ref arena_allocator does not allocate once the arena has warmed up.
+     * @param pool - Thread pool
+     * @param alloc - Allocator of the shared state of the future
+     * @return Future with the result of execution
+     */
+    template<typename Alloc>
+    std::future<T> run(thread_pool& pool, const Alloc& alloc) const
     {
-      return std::async(policy, &promise::run_impl, this, m_task);
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+      internal::allocation_scope allocations{m_task->kind(), internal::allocation_origin::library};
+#endif
+      if (m_task->waits())
+        return internal::chain_driver<T>::run(m_task, &pool, std::promise<T>{std::allocator_arg, alloc});
+
+      return pool.submit(std::allocator_arg, alloc, &promise::run_task, m_task);
     }
 
   private:
-    T run_impl(internal::task_ptr<T> task) const
+    static T run_task(internal::task_ptr<T> task)
     {
+      internal::chain_scope chain{*task};
+      internal::wait_scope waits{nullptr};
       return task->run();
     }
 
@@ -3460,8 +6529,8 @@ template<template<typename, typename> class Container, typename Method,
          typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
 static promise<Result> make_promise_all(Container<Method, Alloc> methods, Class* obj, Args&&... args)
 {
-  using task = internal::make_all_class_task<Result, Container, Method, Alloc, Class, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(methods), obj, std::forward<Args>(args)...)};
+  using task = internal::all_task<internal::args_input<Result, Args...>, Container<Method, Alloc>, internal::method_binder<Class>>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::all, std::move(methods), internal::method_binder<Class>{obj}, std::forward<Args>(args)...)};
 }
 
 
@@ -3480,8 +6549,8 @@ template<template<typename, typename> class Container, typename Method,
          typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
 static promise<void> make_promise_all(Container<Method, Alloc> methods, Class* obj, Args&&... args)
 {
-  using task = internal::make_all_class_task<void, Container, Method, Alloc, Class, Args...>;
-  return promise<void>{std::make_shared<task>(std::move(methods), obj, std::forward<Args>(args)...)};
+  using task = internal::all_task<internal::args_input<void, Args...>, Container<Method, Alloc>, internal::method_binder<Class>>;
+  return promise<void>{internal::task_helper::make<task>(stage_kind::all, std::move(methods), internal::method_binder<Class>{obj}, std::forward<Args>(args)...)};
 }
 
 
@@ -3498,8 +6567,8 @@ template<template<typename, typename> class Container, typename Func, typename A
          typename = typename std::enable_if<!std::is_void<FuncResult>::value>::type>
 static promise<Result> make_promise_all(Container<Func, Alloc> funcs, Args&&... args)
 {
-  using task = internal::make_all_func_task<Result, Container, Func, Alloc, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(funcs), std::forward<Args>(args)...)};
+  using task = internal::all_task<internal::args_input<Result, Args...>, Container<Func, Alloc>, internal::func_binder>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::all, std::move(funcs), internal::func_binder{}, std::forward<Args>(args)...)};
 }
 
 
@@ -3515,8 +6584,8 @@ template<template<typename, typename> class Container, typename Func, typename A
          typename = typename std::enable_if<std::is_void<FuncResult>::value>::type>
 static promise<void> make_promise_all(Container<Func, Alloc> funcs, Args&&... args)
 {
-  using task = internal::make_all_func_task<void, Container, Func, Alloc, Args...>;
-  return promise<void>{std::make_shared<task>(std::move(funcs), std::forward<Args>(args)...)};
+  using task = internal::all_task<internal::args_input<void, Args...>, Container<Func, Alloc>, internal::func_binder>;
+  return promise<void>{internal::task_helper::make<task>(stage_kind::all, std::move(funcs), internal::func_binder{}, std::forward<Args>(args)...)};
 }
 
 
@@ -3533,8 +6602,8 @@ template<template<typename, typename> class Container, typename Method, typename
          typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
 static promise<Result> make_promise_all_settled(Container<Method, Alloc> methods, Class* obj, Args&&... args)
 {
-  using task = internal::make_all_settled_class_task<Result, FuncResult, Container, Method, Alloc, Class, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(methods), obj, std::forward<Args>(args)...)};
+  using task = internal::all_settled_task<internal::args_input<Result, Args...>, Container<Method, Alloc>, internal::method_binder<Class>>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(methods), internal::method_binder<Class>{obj}, std::forward<Args>(args)...)};
 }
 
 
@@ -3550,8 +6619,8 @@ template<template<typename, typename> class Container, typename Func, typename A
          typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>>
 static promise<Result> make_promise_all_settled(Container<Func, Alloc> funcs, Args&&... args)
 {
-  using task = internal::make_all_settled_func_task<Result, FuncResult, Container, Func, Alloc, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(funcs), std::forward<Args>(args)...)};
+  using task = internal::all_settled_task<internal::args_input<Result, Args...>, Container<Func, Alloc>, internal::func_binder>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, std::move(funcs), internal::func_binder{}, std::forward<Args>(args)...)};
 }
 
 
@@ -3569,8 +6638,8 @@ template<template<typename, typename> class Container, typename Method,
          typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
 static promise<Result> make_promise_any(Container<Method, Alloc> methods, Class* obj, Args&&... args)
 {
-  using task = internal::make_any_class_task<Result, Container, Method, Alloc, Class, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(methods), obj, std::forward<Args>(args)...)};
+  using task = internal::any_task<internal::args_input<Result, Args...>, Container<Method, Alloc>, internal::method_binder<Class>>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::any, std::move(methods), internal::method_binder<Class>{obj}, std::forward<Args>(args)...)};
 }
 
 
@@ -3585,8 +6654,8 @@ template<template<typename, typename> class Container, typename Func, typename A
          typename Result = typename std::result_of<Func(Args...)>::type>
 static promise<Result> make_promise_any(Container<Func, Alloc> funcs, Args&&... args)
 {
-  using task = internal::make_any_func_task<Result, Container, Func, Alloc, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(funcs), std::forward<Args>(args)...)};
+  using task = internal::any_task<internal::args_input<Result, Args...>, Container<Func, Alloc>, internal::func_binder>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::any, std::move(funcs), internal::func_binder{}, std::forward<Args>(args)...)};
 }
 
 
@@ -3604,8 +6673,8 @@ template<template<typename, typename> class Container, typename Method,
          typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
 static promise<Result> make_promise_race(Container<Method, Alloc> methods, Class* obj, Args&&... args)
 {
-  using task = internal::make_race_class_task<Result, Container, Method, Alloc, Class, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(methods), obj, std::forward<Args>(args)...)};
+  using task = internal::race_task<internal::args_input<Result, Args...>, Container<Method, Alloc>, internal::method_binder<Class>>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::race, std::move(methods), internal::method_binder<Class>{obj}, std::forward<Args>(args)...)};
 }
 
 
@@ -3620,8 +6689,95 @@ template<template<typename, typename> class Container, typename Func, typename A
          typename Result = typename std::result_of<Func(Args...)>::type>
 static promise<Result> make_promise_race(Container<Func, Alloc> funcs, Args&&... args)
 {
-  using task = internal::make_race_func_task<Result, Container, Func, Alloc, Args...>;
-  return promise<Result>{std::make_shared<task>(std::move(funcs), std::forward<Args>(args)...)};
+  using task = internal::race_task<internal::args_input<Result, Args...>, Container<Func, Alloc>, internal::func_binder>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::race, std::move(funcs), internal::func_binder{}, std::forward<Args>(args)...)};
+}
+
+
+/**
+ * @brief Make a promise with an iterable of the class methods to be called.
+ *        Return an iterable of @ref settled objects with either a result or an error once all methods
+ *        settled or the timeout passed. Methods still running then are marked as @ref settle_type::timed_out.
+ * @param timeout - Maximum duration of the stage.
+ * @param methods - Methods.
+ * @param obj - Object containing the required methods. It must outlive every method the stage started,
+ *        not only the chain.
+ * @param args - Optional arguments.
+ * @return Promise object.
+ */
+template<typename Rep, typename Period, template<typename, typename> class Container, typename Method,
+         typename Alloc, typename Class, typename... Args,
+         typename FuncResult = typename std::result_of<Method(Class*, Args...)>::type,
+         typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>,
+         typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
+static promise<Result> make_promise_all_settled_within(std::chrono::duration<Rep, Period> timeout, Container<Method, Alloc> methods, Class* obj, Args&&... args)
+{
+  using task = internal::all_settled_within_task<internal::args_input<Result, Args...>, Container<Method, Alloc>, internal::method_binder<Class>>;
+  auto duration = std::chrono::duration_cast<internal::timer_service::clock::duration>(timeout);
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, duration, std::move(methods), internal::method_binder<Class>{obj}, std::forward<Args>(args)...)};
+}
+
+
+/**
+ * @brief Make a promise with an iterable of the functions to be called.
+ *        Return an iterable of @ref settled objects with either a result or an error once all functions
+ *        settled or the timeout passed. Functions still running then are marked as @ref settle_type::timed_out.
+ * @param timeout - Maximum duration of the stage.
+ * @param funcs - Functions.
+ * @param args - Optional arguments.
+ * @return Promise object.
+ */
+template<typename Rep, typename Period, template<typename, typename> class Container, typename Func,
+         typename Alloc, typename... Args,
+         typename FuncResult = typename std::result_of<Func(Args...)>::type,
+         typename Result = Container<settled<FuncResult>, std::allocator<settled<FuncResult>>>>
+static promise<Result> make_promise_all_settled_within(std::chrono::duration<Rep, Period> timeout, Container<Func, Alloc> funcs, Args&&... args)
+{
+  using task = internal::all_settled_within_task<internal::args_input<Result, Args...>, Container<Func, Alloc>, internal::func_binder>;
+  auto duration = std::chrono::duration_cast<internal::timer_service::clock::duration>(timeout);
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::all_settled, duration, std::move(funcs), internal::func_binder{}, std::forward<Args>(args)...)};
+}
+
+
+/**
+ * @brief Make a promise with an iterable of the class methods to be called.
+ *        Return the first count resolved results in the order they resolved.
+ *        Reject with an @ref aggregate_error as soon as fewer than count methods can still resolve.
+ * @param count - Number of results to wait for.
+ * @param methods - Methods.
+ * @param obj - Object containing the required methods. It must outlive every method the stage started,
+ *        not only the chain.
+ * @param args - Optional arguments.
+ * @return Promise object.
+ */
+template<template<typename, typename> class Container, typename Method,
+         typename Alloc, typename Class, typename... Args,
+         typename FuncResult = typename std::result_of<Method(Class*, Args...)>::type,
+         typename Result = typename internal::some_result<Container, FuncResult>::type,
+         typename = typename std::enable_if<internal::is_invocable<Method, Class, Args...>::value>::type>
+static promise<Result> make_promise_some(std::size_t count, Container<Method, Alloc> methods, Class* obj, Args&&... args)
+{
+  using task = internal::some_task<internal::args_input<Result, Args...>, Container<Method, Alloc>, internal::method_binder<Class>>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::some, count, std::move(methods), internal::method_binder<Class>{obj}, std::forward<Args>(args)...)};
+}
+
+
+/**
+ * @brief Make a promise with an iterable of the functions to be called.
+ *        Return the first count resolved results in the order they resolved.
+ *        Reject with an @ref aggregate_error as soon as fewer than count functions can still resolve.
+ * @param count - Number of results to wait for.
+ * @param funcs - Functions.
+ * @param args - Optional arguments.
+ * @return Promise object.
+ */
+template<template<typename, typename> class Container, typename Func, typename Alloc, typename... Args,
+         typename FuncResult = typename std::result_of<Func(Args...)>::type,
+         typename Result = typename internal::some_result<Container, FuncResult>::type>
+static promise<Result> make_promise_some(std::size_t count, Container<Func, Alloc> funcs, Args&&... args)
+{
+  using task = internal::some_task<internal::args_input<Result, Args...>, Container<Func, Alloc>, internal::func_binder>;
+  return promise<Result>{internal::task_helper::make<task>(stage_kind::some, count, std::move(funcs), internal::func_binder{}, std::forward<Args>(args)...)};
 }
 
 
@@ -3634,7 +6790,7 @@ template<typename T>
 static promise<T> make_resolved_promise(T&& value)
 {
   using task = internal::make_resolved_task<T>;
-  return promise<T>{std::make_shared<task>(std::forward<T>(value))};
+  return promise<T>{internal::task_helper::make<task>(stage_kind::initial, std::forward<T>(value))};
 }
 
 
@@ -3645,7 +6801,7 @@ static promise<T> make_resolved_promise(T&& value)
 static promise<void> make_resolved_promise()
 {
   using task = internal::make_resolved_task<void>;
-  return promise<void>{std::make_shared<task>()};
+  return promise<void>{internal::task_helper::make<task>(stage_kind::initial)};
 }
 
 
@@ -3658,7 +6814,7 @@ template<typename T, typename Error>
 static promise<T> make_rejected_promise(Error&& error)
 {
   using task = internal::make_rejected_task<T, Error>;
-  return promise<T>{std::make_shared<task>(std::forward<Error>(error))};
+  return promise<T>{internal::task_helper::make<task>(stage_kind::initial, std::forward<Error>(error))};
 }
 
 
@@ -3671,9 +6827,211 @@ template<typename Error>
 static promise<void> make_rejected_promise(Error&& error)
 {
   using task = internal::make_rejected_task<void, Error>;
-  return promise<void>{std::make_shared<task>(std::forward<Error>(error))};
+  return promise<void>{internal::task_helper::make<task>(stage_kind::initial, std::forward<Error>(error))};
+}
+
+
+/**
+ * @brief Make a promise that is resolved after a delay.
+ *        Waiting is driven by the shared timer service and does not hold a thread,
+ *        see @ref async::promise::delay.
+ * @param duration - Delay duration.
+ * @return Promise object.
+ */
+template<typename Rep, typename Period>
+static promise<void> delay(std::chrono::duration<Rep, Period> duration)
+{
+  using task = internal::make_delay_task;
+  auto delay = std::chrono::duration_cast<internal::timer_service::clock::duration>(duration);
+  return promise<void>{internal::task_helper::make<task>(stage_kind::delay, delay)};
+}
+
+
+/**
+ * @brief Install an observer of all chains. Has no effect unless ASYNC_PROMISE_INSTRUMENTATION is defined.
+ * @param observer - Observer or nullptr to remove the installed one. It must stay valid while chains are running.
+ */
+inline void set_observer(observer* observer)
+{
+  internal::observer_helper::instance().store(observer, std::memory_order_release);
+}
+
+
+/**
+ * @brief Set options of the threads started for fan-out functions that do not run on a @ref thread_pool.
+ *        Such functions run on std::async by default, which gives each thread the default stack size and no name.
+ * @param options - Thread options or nullptr to use std::async again. They must stay valid while chains are running.
+ */
+inline void set_thread_options(const thread_options* options)
+{
+  internal::thread_helper::options().store(options, std::memory_order_release);
+}
+
+
+/**
+ * @brief Get process-wide runtime statistics. All values are zero unless ASYNC_PROMISE_INSTRUMENTATION is defined.
+ * @return Runtime statistics.
+ */
+inline runtime_stats get_runtime_stats()
+{
+  using internal::counter;
+  using internal::runtime_counters;
+
+  runtime_stats stats{};
+  stats.threads_created = runtime_counters::get(counter::threads_created);
+  stats.tasks_run = runtime_counters::get(counter::tasks_run);
+  stats.elements_launched = runtime_counters::get(counter::elements_launched);
+  stats.waits = runtime_counters::get(counter::waits);
+  stats.wait_time = std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(runtime_counters::get(counter::wait_time))};
+  stats.errors_swallowed = runtime_counters::get(counter::errors_swallowed);
+  auto finished = runtime_counters::get(counter::chains_finished);
+  auto started = runtime_counters::get(counter::chains_started);
+  stats.chains_in_flight = started > finished ? started - finished : 0;
+  return stats;
+}
+
+
+/**
+ * @brief Enable or disable the registry of running chains that @ref async::get_chains reads.
+ *        Chains are registered when they start, so enabling the registry does not pick up
+ *        chains that are already running. Has no effect unless ASYNC_PROMISE_INSTRUMENTATION is defined.
+ * @param enabled - True to register chains.
+ */
+inline void set_chain_registry(bool enabled)
+{
+  internal::chain_registry::instance().enable(enabled);
+}
+
+
+/**
+ * @brief Get the chains that are running right now, see @ref async::set_chain_registry.
+ * @return Running chains from the oldest to the newest.
+ */
+inline std::vector<chain_info> get_chains()
+{
+  return internal::chain_registry::instance().snapshot();
+}
+
+
+/**
+ * @brief Print the chains that are running right now from the oldest to the newest, one per line
+ *        with the innermost running stage in brackets, see @ref async::set_chain_registry.
+ * @param stream - Output stream.
+ */
+inline void dump_chains(std::ostream& stream)
+{
+  for (const auto& chain : get_chains())
+  {
+    stream << "chain " << chain.id << " thread " << chain.thread
+           << " age " << std::chrono::duration_cast<std::chrono::milliseconds>(chain.age).count() << "ms"
+           << " outstanding " << chain.outstanding << ':';
+    for (std::size_t i = 0; i < chain.stages.size(); ++i)
+    {
+      stream << (0 == i ? " " : " -> ");
+      if (i == chain.current)
+        stream << '[' << chain.stages[i] << ']';
+      else
+        stream << chain.stages[i];
+    }
+
+    stream << '\n';
+  }
+}
+
+
+/**
+ * @brief Enable or disable counting of heap allocations per stage kind and per registered chain,
+ *        see @ref async::get_allocation_stats. The library only attributes allocations, they are
+ *        reported by @ref async::record_allocation, which async_promise_allocations.hpp calls from
+ *        replaced global allocation functions. Has no effect unless ASYNC_PROMISE_INSTRUMENTATION is defined.
+ * @param enabled - True to count allocations.
+ */
+inline void set_allocation_tracking(bool enabled)
+{
+  internal::allocation_counters::enable(enabled);
+}
+
+
+/**
+ * @brief Count a heap allocation made by the calling thread to the stage it runs, if allocation tracking is enabled.
+ *        Must not allocate, as it is called from global allocation functions.
+ * @param bytes - Allocation size.
+ */
+inline void record_allocation(std::size_t bytes) noexcept
+{
+#ifdef ASYNC_PROMISE_INSTRUMENTATION
+  internal::allocation_counters::record(bytes);
+#else
+  static_cast<void>(bytes);
+#endif
+}
+
+
+/**
+ * @brief Get the heap allocations counted since allocation tracking was first enabled, see @ref async::set_allocation_tracking.
+ * @return Allocations of the stage kinds that allocated, in the order of @ref stage_kind.
+ */
+inline std::vector<stage_allocations> get_allocation_stats()
+{
+  using internal::allocation_counters;
+  using internal::allocation_origin;
+
+  std::vector<stage_allocations> result;
+  for (std::size_t i = 0; i < allocation_counters::kind_count; ++i)
+  {
+    stage_allocations item{};
+    item.kind = static_cast<stage_kind>(i);
+    item.library = allocation_counters::get(item.kind, allocation_origin::library);
+    item.user = allocation_counters::get(item.kind, allocation_origin::user);
+    if (0 != item.library.allocations || 0 != item.user.allocations)
+      result.push_back(item);
+  }
+
+  return result;
 }
 
+
+#if defined(ASYNC_PROMISE_COMPILED) && !defined(ASYNC_PROMISE_SOURCE)
+namespace internal
+{
+
+extern template class task<void>;
+extern template class task<int>;
+extern template class task<std::string>;
+extern template class task<std::vector<int>>;
+extern template class task<std::vector<std::string>>;
+
+// Stages that do not depend on the functions of a chain. The void resolved stage is an explicit
+// specialization complete in the header
+extern template class delay_task<void>;
+extern template class delay_task<int>;
+extern template class delay_task<std::string>;
+extern template class delay_task<std::vector<int>>;
+extern template class delay_task<std::vector<std::string>>;
+extern template class throttle_task<void>;
+extern template class throttle_task<int>;
+extern template class throttle_task<std::string>;
+extern template class throttle_task<std::vector<int>>;
+extern template class throttle_task<std::vector<std::string>>;
+extern template class retry_task<void>;
+extern template class retry_task<int>;
+extern template class retry_task<std::string>;
+extern template class retry_task<std::vector<int>>;
+extern template class retry_task<std::vector<std::string>>;
+extern template class make_resolved_task<int>;
+extern template class make_resolved_task<std::string>;
+extern template class make_resolved_task<std::vector<int>>;
+extern template class make_resolved_task<std::vector<std::string>>;
+
+} // namespace internal
+
+extern template class promise<void>;
+extern template class promise<int>;
+extern template class promise<std::string>;
+extern template class promise<std::vector<int>>;
+extern template class promise<std::vector<std::string>>;
+#endif
+
 } // namespace async
 
 #endif // ASYNC_PROMISE_H
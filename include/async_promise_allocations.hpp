@@ -0,0 +1,121 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+#ifndef ASYNC_PROMISE_ALLOCATIONS_H
+#define ASYNC_PROMISE_ALLOCATIONS_H
+
+#include "async_promise.hpp"
+
+#include <cstdlib>
+#include <new>
+
+
+/*
+ * Replacements of the global allocation functions that report every allocation to
+ * async::record_allocation, see async::set_allocation_tracking. Include this header
+ * in exactly one translation unit of a program. Over-aligned allocations are not counted.
+ */
+
+namespace async
+{
+
+namespace internal
+{
+
+struct allocation_helper
+{
+  // Failed attempts are not counted, nothing was allocated
+  static void* allocate(std::size_t size) noexcept
+  {
+    auto ptr = std::malloc(0 == size ? 1 : size);
+    if (ptr)
+      record_allocation(size);
+    return ptr;
+  }
+
+  static void* allocate_or_throw(std::size_t size)
+  {
+    for (;;)
+    {
+      auto ptr = allocate(size);
+      if (ptr)
+        return ptr;
+
+      auto handler = std::get_new_handler();
+      if (!handler)
+        throw std::bad_alloc{};
+
+      handler();
+    }
+  }
+};
+
+} // namespace internal
+
+} // namespace async
+
+
+void* operator new(std::size_t size)
+{
+  return async::internal::allocation_helper::allocate_or_throw(size);
+}
+
+
+void* operator new[](std::size_t size)
+{
+  return async::internal::allocation_helper::allocate_or_throw(size);
+}
+
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return async::internal::allocation_helper::allocate(size);
+}
+
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return async::internal::allocation_helper::allocate(size);
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
+
+#endif // ASYNC_PROMISE_ALLOCATIONS_H
@@ -0,0 +1,741 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+#ifndef ASYNC_PROMISE_METRICS_H
+#define ASYNC_PROMISE_METRICS_H
+
+#include "async_promise.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <locale>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace async
+{
+
+namespace internal
+{
+
+struct histogram_buckets
+{
+  static constexpr unsigned sub_bucket_bits = 5;
+  static constexpr std::uint64_t sub_bucket_count = std::uint64_t{1} << sub_bucket_bits;
+  static constexpr std::uint64_t sub_bucket_half = sub_bucket_count / 2;
+  static constexpr unsigned max_magnitude = 36;
+  static constexpr std::size_t count = sub_bucket_count + (max_magnitude - sub_bucket_bits) * sub_bucket_half;
+
+  static std::size_t index(std::uint64_t value) noexcept
+  {
+    if (value < sub_bucket_count)
+      return static_cast<std::size_t>(value);
+
+    auto magnitude = msb(value);
+    if (magnitude >= max_magnitude)
+      return count - 1;
+
+    auto shift = magnitude - (sub_bucket_bits - 1);
+    return static_cast<std::size_t>(sub_bucket_count + (magnitude - sub_bucket_bits) * sub_bucket_half
+                                    + (value >> shift) - sub_bucket_half);
+  }
+
+  static std::uint64_t midpoint(std::size_t index) noexcept
+  {
+    if (index < sub_bucket_count)
+      return index;
+
+    auto offset = index - sub_bucket_count;
+    auto magnitude = static_cast<unsigned>(sub_bucket_bits + offset / sub_bucket_half);
+    auto shift = magnitude - (sub_bucket_bits - 1);
+    auto lower = (sub_bucket_half + offset % sub_bucket_half) << shift;
+    return lower + (std::uint64_t{1} << (shift - 1));
+  }
+
+  static unsigned msb(std::uint64_t value) noexcept
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+    unsigned result = 0;
+    while (value >>= 1)
+      ++result;
+    return result;
+#endif
+  }
+};
+
+} // namespace internal
+
+
+/**
+ * @brief Merged state of a @ref latency_histogram.
+ */
+class histogram_snapshot final
+{
+  public:
+    histogram_snapshot()
+      : m_buckets(internal::histogram_buckets::count, 0)
+    {}
+
+    /**
+     * @brief Get the number of recorded values.
+     * @return Number of recorded values.
+     */
+    std::uint64_t count() const noexcept
+    {
+      return m_count;
+    }
+
+    /**
+     * @brief Get the largest recorded value.
+     * @return Largest recorded value.
+     */
+    std::chrono::nanoseconds max() const noexcept
+    {
+      return std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(m_max)};
+    }
+
+    /**
+     * @brief Get the sum of recorded values.
+     * @return Sum of recorded values.
+     */
+    std::chrono::nanoseconds sum() const noexcept
+    {
+      return std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(m_sum)};
+    }
+
+    /**
+     * @brief Get the mean of recorded values.
+     * @return Mean of recorded values.
+     */
+    std::chrono::nanoseconds mean() const noexcept
+    {
+      return std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(0 == m_count ? 0 : m_sum / m_count)};
+    }
+
+    /**
+     * @brief Get a percentile of recorded values with an error of about 3%.
+     * @param percent - Percentile, for example 50 or 99.9.
+     * @return Value below or equal to which the given percent of recorded values fall.
+     */
+    std::chrono::nanoseconds percentile(double percent) const noexcept
+    {
+      if (0 == m_count)
+        return std::chrono::nanoseconds::zero();
+
+      auto rank = static_cast<std::uint64_t>(std::ceil(std::min(std::max(percent, 0.0), 100.0) / 100.0 * m_count));
+      rank = std::max<std::uint64_t>(rank, 1);
+      std::uint64_t seen = 0;
+      for (std::size_t i = 0; i < m_buckets.size(); ++i)
+      {
+        seen += m_buckets[i];
+        if (seen >= rank)
+          return std::min(std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(
+                            internal::histogram_buckets::midpoint(i))}, max());
+      }
+
+      return max();
+    }
+
+    /**
+     * @brief Add values of another snapshot.
+     * @param other - Snapshot to add.
+     */
+    void merge(const histogram_snapshot& other)
+    {
+      for (std::size_t i = 0; i < m_buckets.size(); ++i)
+        m_buckets[i] += other.m_buckets[i];
+
+      m_count += other.m_count;
+      m_sum += other.m_sum;
+      m_max = std::max(m_max, other.m_max);
+    }
+
+  private:
+    friend class latency_histogram;
+
+    std::vector<std::uint64_t> m_buckets;
+    std::uint64_t m_count = 0;
+    std::uint64_t m_sum = 0;
+    std::uint64_t m_max = 0;
+};
+
+
+/**
+ * @brief Lock-free histogram of latencies with logarithmic buckets, each power of two is split into
+ *        16 linear buckets. Values are recorded into one of several shards picked per thread,
+ *        so concurrent recording does not contend on one counter, and the shards are merged on read.
+ */
+class latency_histogram final
+{
+  public:
+    static constexpr std::size_t shard_count = 8;
+
+    latency_histogram()
+    {
+      for (auto& shard : m_shards)
+      {
+        for (auto& bucket : shard.buckets)
+          bucket.store(0, std::memory_order_relaxed);
+
+        shard.count.store(0, std::memory_order_relaxed);
+        shard.sum.store(0, std::memory_order_relaxed);
+        shard.max.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    /**
+     * @brief Record a value.
+     * @param value - Value to record, negative values are recorded as zero.
+     */
+    void record(std::chrono::nanoseconds value) noexcept
+    {
+      auto ns = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(value.count(), 0));
+      auto& shard = m_shards[shard_index()];
+      shard.buckets[internal::histogram_buckets::index(ns)].fetch_add(1, std::memory_order_relaxed);
+      shard.count.fetch_add(1, std::memory_order_relaxed);
+      shard.sum.fetch_add(ns, std::memory_order_relaxed);
+      auto max = shard.max.load(std::memory_order_relaxed);
+      while (max < ns && !shard.max.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief Merge the shards.
+     * @return Snapshot of recorded values.
+     */
+    histogram_snapshot snapshot() const
+    {
+      histogram_snapshot result;
+      for (const auto& shard : m_shards)
+      {
+        for (std::size_t i = 0; i < internal::histogram_buckets::count; ++i)
+          result.m_buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+
+        result.m_count += shard.count.load(std::memory_order_relaxed);
+        result.m_sum += shard.sum.load(std::memory_order_relaxed);
+        result.m_max = std::max(result.m_max, shard.max.load(std::memory_order_relaxed));
+      }
+
+      return result;
+    }
+
+  private:
+    struct shard
+    {
+      std::atomic<std::uint64_t> buckets[internal::histogram_buckets::count];
+      std::atomic<std::uint64_t> count;
+      std::atomic<std::uint64_t> sum;
+      std::atomic<std::uint64_t> max;
+      char padding[internal::cache_line_size];
+    };
+
+    static std::size_t shard_index() noexcept
+    {
+      static std::atomic<std::size_t> next{0};
+      static thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+      return index;
+    }
+
+    shard m_shards[shard_count];
+};
+
+
+/**
+ * @brief Latency statistics of the stages with the same name.
+ */
+struct stage_latency final
+{
+  std::string name;             //!< Stage name, or the stage kind name if the stage is not named.
+  histogram_snapshot stage;     //!< Duration of the stage itself.
+  histogram_snapshot wait;      //!< Time functions of a fan-out stage waited to run after the spawn.
+  histogram_snapshot function;  //!< Duration of functions of a fan-out stage.
+};
+
+
+/**
+ * @brief Observer that records latency histograms per stage name, see @ref async::set_observer.
+ *        Stages are looked up in a lock-free hash table, so recording takes no lock. Stages without
+ *        a name are recorded under the name of their kind.
+ */
+class metrics final : public observer
+{
+  public:
+    /**
+     * @brief Constructor.
+     * @param max_stages - Maximum number of distinct stage names, further names are recorded as "other".
+     */
+    explicit metrics(std::size_t max_stages = 256)
+      : m_mask{round_up(max_stages) - 1}
+      , m_table{new std::atomic<entry*>[m_mask + 1]}
+      , m_other{"other"}
+    {
+      for (std::size_t i = 0; i <= m_mask; ++i)
+        m_table[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    metrics(const metrics&) = delete;
+    metrics& operator=(const metrics&) = delete;
+
+    ~metrics()
+    {
+      for (std::size_t i = 0; i <= m_mask; ++i)
+        delete m_table[i].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Record the duration of a stage.
+     * @param event - Stage event.
+     */
+    void on_stage_end(const stage_event& event) final
+    {
+      find(event).stage.record(event.duration);
+    }
+
+    /**
+     * @brief Record the wait and the duration of a function of a fan-out stage.
+     * @param event - Stage event.
+     */
+    void on_settle(const stage_event& event) final
+    {
+      auto& stats = find(event);
+      stats.wait.record(event.wait);
+      stats.function.record(event.duration);
+    }
+
+    /**
+     * @brief Get the statistics of all recorded stages.
+     * @return Statistics sorted by stage name.
+     */
+    std::vector<stage_latency> snapshot() const;
+
+  private:
+    struct entry
+    {
+      explicit entry(std::string name)
+        : name{std::move(name)}
+      {}
+
+      const std::string name;
+      latency_histogram stage;
+      latency_histogram wait;
+      latency_histogram function;
+    };
+
+    entry& find(const stage_event& event);
+
+    static std::size_t fnv1a(const char* str) noexcept
+    {
+      std::uint64_t hash = 14695981039346656037ull;
+      for (; *str; ++str)
+        hash = (hash ^ static_cast<unsigned char>(*str)) * 1099511628211ull;
+      return static_cast<std::size_t>(hash);
+    }
+
+    static std::size_t round_up(std::size_t size) noexcept
+    {
+      std::size_t result = 1;
+      while (result < size)
+        result <<= 1;
+      return result;
+    }
+
+    const std::size_t m_mask;
+    const std::unique_ptr<std::atomic<entry*>[]> m_table;
+    entry m_other;
+};
+
+
+#ifdef ASYNC_PROMISE_DEFINITIONS
+
+ASYNC_PROMISE_DECL std::vector<stage_latency> metrics::snapshot() const
+{
+  std::vector<stage_latency> result;
+  auto add = [&result] (const entry& stats)
+  {
+    stage_latency item;
+    item.name = stats.name;
+    item.stage = stats.stage.snapshot();
+    item.wait = stats.wait.snapshot();
+    item.function = stats.function.snapshot();
+    if (0 != item.stage.count() || 0 != item.function.count())
+      result.push_back(std::move(item));
+  };
+
+  for (std::size_t i = 0; i <= m_mask; ++i)
+  {
+    auto stats = m_table[i].load(std::memory_order_acquire);
+    if (stats)
+      add(*stats);
+  }
+
+  add(m_other);
+  std::sort(result.begin(), result.end(), [] (const stage_latency& a, const stage_latency& b)
+  {
+    return a.name < b.name;
+  });
+
+  return result;
+}
+
+
+ASYNC_PROMISE_DECL metrics::entry& metrics::find(const stage_event& event)
+{
+  auto name = *event.name ? event.name : stage_kind_name(event.kind);
+  auto hash = fnv1a(name);
+  for (std::size_t i = 0; i <= m_mask; ++i)
+  {
+    auto& slot = m_table[(hash + i) & m_mask];
+    auto stats = slot.load(std::memory_order_acquire);
+    if (!stats)
+    {
+      std::unique_ptr<entry> created{new entry{name}};
+      if (slot.compare_exchange_strong(stats, created.get(), std::memory_order_acq_rel))
+        return *created.release();
+    }
+
+    if (stats->name == name)
+      return *stats;
+  }
+
+  return m_other;
+}
+
+#endif
+
+
+/**
+ * @brief Exports the runtime statistics, the state of thread pools and the stage latencies
+ *        in the Prometheus text format or as JSON, for example to serve them on a scrape
+ *        endpoint or to write them to a file picked up by an agent.
+ */
+class metrics_exporter final
+{
+  public:
+    /**
+     * @brief Constructor.
+     * @param stages - Stage latencies to export, or nullptr to export only the runtime statistics and thread pools.
+     */
+    explicit metrics_exporter(const metrics* stages = nullptr)
+      : m_stages{stages}
+    {}
+
+    /**
+     * @brief Add a thread pool to export. The thread pool must outlive the exporter.
+     * @param name - Thread pool name used as the label value.
+     * @param pool - Thread pool.
+     * @return Reference to this exporter.
+     */
+    metrics_exporter& add(std::string name, const thread_pool& pool)
+    {
+      m_pools.emplace_back(std::move(name), &pool);
+      return *this;
+    }
+
+    /**
+     * @brief Write the metrics in the Prometheus text exposition format.
+     * @param stream - Output stream.
+     */
+    void write_prometheus(std::ostream& stream) const;
+
+    /**
+     * @brief Get the metrics in the Prometheus text exposition format.
+     * @return Metrics text.
+     */
+    std::string prometheus() const;
+
+    /**
+     * @brief Write the metrics as a JSON object with "runtime", "pools" and "stages" members.
+     *        Durations are in nanoseconds.
+     * @param stream - Output stream.
+     */
+    void write_json(std::ostream& stream) const;
+
+    /**
+     * @brief Get the metrics as JSON.
+     * @return Metrics JSON.
+     */
+    std::string json() const;
+
+  private:
+    struct quantile
+    {
+      const char* label;
+      const char* field;
+      double percent;
+    };
+
+    static constexpr std::size_t quantile_count = 4;
+
+    static const quantile* quantiles() noexcept
+    {
+      static const quantile result[quantile_count] = {{"0.5", "p50_ns", 50}, {"0.9", "p90_ns", 90},
+                                                                  {"0.99", "p99_ns", 99}, {"0.999", "p999_ns", 99.9}};
+      return result;
+    }
+
+    static void prepare(std::ostringstream& stream)
+    {
+      stream.imbue(std::locale::classic());
+      stream.precision(9);
+    }
+
+    static double seconds(std::chrono::nanoseconds value) noexcept
+    {
+      return std::chrono::duration<double>(value).count();
+    }
+
+    static void write_family(std::ostream& stream, const char* name, const char* type, const char* help)
+    {
+      stream << "# HELP async_promise_" << name << ' ' << help << '\n'
+             << "# TYPE async_promise_" << name << ' ' << type << '\n';
+    }
+
+    template<typename Value>
+    void write_pool_family(std::ostream& stream, const char* name, const char* help, Value&& value) const
+    {
+      write_family(stream, name, "gauge", help);
+      for (const auto& pool : m_pools)
+      {
+        stream << "async_promise_" << name << "{pool=\"";
+        write_label(stream, pool.first);
+        stream << "\"} " << value(*pool.second) << '\n';
+      }
+    }
+
+    static void write_summary_family(std::ostream& stream, const std::vector<stage_latency>& stages,
+                                     const char* name, const char* help, histogram_snapshot stage_latency::*member);
+
+    static void write_json_histogram(std::ostream& stream, const histogram_snapshot& histogram);
+
+    static void write_label(std::ostream& stream, const std::string& str);
+
+    static void write_json_string(std::ostream& stream, const std::string& str);
+
+    const metrics* m_stages;
+    std::vector<std::pair<std::string, const thread_pool*>> m_pools;
+};
+
+
+#ifdef ASYNC_PROMISE_DEFINITIONS
+
+ASYNC_PROMISE_DECL void metrics_exporter::write_prometheus(std::ostream& stream) const
+{
+  std::ostringstream out;
+  prepare(out);
+  auto stats = get_runtime_stats();
+  write_family(out, "threads_created_total", "counter", "Threads started by std::async and by thread pools.");
+  out << "async_promise_threads_created_total " << stats.threads_created << '\n';
+  write_family(out, "tasks_run_total", "counter", "Stages run.");
+  out << "async_promise_tasks_run_total " << stats.tasks_run << '\n';
+  write_family(out, "elements_launched_total", "counter", "Functions started by fan-out stages.");
+  out << "async_promise_elements_launched_total " << stats.elements_launched << '\n';
+  write_family(out, "waits_total", "counter", "Blocking waits of stages on a future or a timer.");
+  out << "async_promise_waits_total " << stats.waits << '\n';
+  write_family(out, "wait_seconds_total", "counter", "Total duration of the blocking waits.");
+  out << "async_promise_wait_seconds_total " << seconds(stats.wait_time) << '\n';
+  write_family(out, "errors_swallowed_total", "counter", "Errors swallowed when settling an already settled promise.");
+  out << "async_promise_errors_swallowed_total " << stats.errors_swallowed << '\n';
+  write_family(out, "chains_in_flight", "gauge", "Chains running right now.");
+  out << "async_promise_chains_in_flight " << stats.chains_in_flight << '\n';
+
+  if (!m_pools.empty())
+  {
+    write_pool_family(out, "pool_threads", "Worker threads of the thread pool.", [] (const thread_pool& pool)
+    {
+      return static_cast<double>(pool.size());
+    });
+    write_pool_family(out, "pool_active_threads", "Worker threads that are not sleeping.", [] (const thread_pool& pool)
+    {
+      return static_cast<double>(pool.active());
+    });
+    write_pool_family(out, "pool_utilization", "Ratio of active worker threads.", [] (const thread_pool& pool)
+    {
+      return 0 == pool.size() ? 0.0 : static_cast<double>(pool.active()) / pool.size();
+    });
+    write_pool_family(out, "pool_queue_depth", "Functions waiting in the queue.", [] (const thread_pool& pool)
+    {
+      return static_cast<double>(pool.queue_size());
+    });
+    write_pool_family(out, "pool_queue_capacity", "Maximum number of functions in the queue.", [] (const thread_pool& pool)
+    {
+      return static_cast<double>(pool.queue_capacity());
+    });
+  }
+
+  if (m_stages)
+  {
+    auto stages = m_stages->snapshot();
+    write_summary_family(out, stages, "stage_duration_seconds", "Duration of stages.", &stage_latency::stage);
+    write_summary_family(out, stages, "function_wait_seconds", "Time functions of fan-out stages waited to run.", &stage_latency::wait);
+    write_summary_family(out, stages, "function_duration_seconds", "Duration of functions of fan-out stages.", &stage_latency::function);
+  }
+
+  stream << out.str();
+}
+
+
+ASYNC_PROMISE_DECL std::string metrics_exporter::prometheus() const
+{
+  std::ostringstream stream;
+  write_prometheus(stream);
+  return stream.str();
+}
+
+
+ASYNC_PROMISE_DECL void metrics_exporter::write_json(std::ostream& stream) const
+{
+  std::ostringstream out;
+  prepare(out);
+  auto stats = get_runtime_stats();
+  out << "{\"runtime\":{\"threads_created\":" << stats.threads_created
+      << ",\"tasks_run\":" << stats.tasks_run
+      << ",\"elements_launched\":" << stats.elements_launched
+      << ",\"waits\":" << stats.waits
+      << ",\"wait_time_ns\":" << stats.wait_time.count()
+      << ",\"errors_swallowed\":" << stats.errors_swallowed
+      << ",\"chains_in_flight\":" << stats.chains_in_flight << "},\"pools\":[";
+
+  for (std::size_t i = 0; i < m_pools.size(); ++i)
+  {
+    const auto& pool = *m_pools[i].second;
+    out << (0 == i ? "" : ",") << "{\"name\":\"";
+    write_json_string(out, m_pools[i].first);
+    out << "\",\"threads\":" << pool.size()
+        << ",\"active_threads\":" << pool.active()
+        << ",\"queue_depth\":" << pool.queue_size()
+        << ",\"queue_capacity\":" << pool.queue_capacity() << '}';
+  }
+
+  out << "],\"stages\":[";
+  if (m_stages)
+  {
+    auto stages = m_stages->snapshot();
+    for (std::size_t i = 0; i < stages.size(); ++i)
+    {
+      out << (0 == i ? "" : ",") << "{\"name\":\"";
+      write_json_string(out, stages[i].name);
+      out << "\",\"stage\":";
+      write_json_histogram(out, stages[i].stage);
+      out << ",\"wait\":";
+      write_json_histogram(out, stages[i].wait);
+      out << ",\"function\":";
+      write_json_histogram(out, stages[i].function);
+      out << '}';
+    }
+  }
+
+  out << "]}";
+  stream << out.str();
+}
+
+
+ASYNC_PROMISE_DECL std::string metrics_exporter::json() const
+{
+  std::ostringstream stream;
+  write_json(stream);
+  return stream.str();
+}
+
+
+ASYNC_PROMISE_DECL void metrics_exporter::write_summary_family(std::ostream& stream, const std::vector<stage_latency>& stages,
+                                                               const char* name, const char* help, histogram_snapshot stage_latency::*member)
+{
+  write_family(stream, name, "summary", help);
+  for (const auto& stage : stages)
+  {
+    const auto& histogram = stage.*member;
+    if (0 == histogram.count())
+      continue;
+
+    for (std::size_t i = 0; i < quantile_count; ++i)
+    {
+      stream << "async_promise_" << name << "{stage=\"";
+      write_label(stream, stage.name);
+      stream << "\",quantile=\"" << quantiles()[i].label << "\"} "
+             << seconds(histogram.percentile(quantiles()[i].percent)) << '\n';
+    }
+
+    stream << "async_promise_" << name << "_sum{stage=\"";
+    write_label(stream, stage.name);
+    stream << "\"} " << seconds(histogram.sum()) << '\n';
+    stream << "async_promise_" << name << "_count{stage=\"";
+    write_label(stream, stage.name);
+    stream << "\"} " << histogram.count() << '\n';
+  }
+}
+
+
+ASYNC_PROMISE_DECL void metrics_exporter::write_json_histogram(std::ostream& stream, const histogram_snapshot& histogram)
+{
+  stream << "{\"count\":" << histogram.count()
+         << ",\"sum_ns\":" << histogram.sum().count()
+         << ",\"mean_ns\":" << histogram.mean().count()
+         << ",\"max_ns\":" << histogram.max().count();
+  for (std::size_t i = 0; i < quantile_count; ++i)
+    stream << ",\"" << quantiles()[i].field << "\":" << histogram.percentile(quantiles()[i].percent).count();
+
+  stream << '}';
+}
+
+
+ASYNC_PROMISE_DECL void metrics_exporter::write_label(std::ostream& stream, const std::string& str)
+{
+  for (auto c : str)
+  {
+    if ('"' == c || '\\' == c)
+      stream << '\\' << c;
+    else if ('\n' == c)
+      stream << "\\n";
+    else
+      stream << c;
+  }
+}
+
+
+ASYNC_PROMISE_DECL void metrics_exporter::write_json_string(std::ostream& stream, const std::string& str)
+{
+  static constexpr char digits[] = "0123456789abcdef";
+  for (auto c : str)
+  {
+    auto code = static_cast<unsigned char>(c);
+    if ('"' == c || '\\' == c)
+      stream << '\\' << c;
+    else if (code < 0x20)
+      stream << "\\u00" << digits[code >> 4] << digits[code & 0xf];
+    else
+      stream << c;
+  }
+}
+
+#endif
+
+} // namespace async
+
+#endif // ASYNC_PROMISE_METRICS_H
@@ -0,0 +1,440 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+#ifndef ASYNC_PROMISE_TRACER_H
+#define ASYNC_PROMISE_TRACER_H
+
+#include "async_promise.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+
+namespace async
+{
+
+/**
+ * @brief Kind of a segment of a critical path.
+ */
+enum class path_segment_kind
+{
+  stage,    //!< Stage, for a fan-out stage only the part up to the spawn of the function on the path.
+  wait,     //!< Time the function on the path waited to run after its spawn.
+  function, //!< Function of a fan-out stage that finished last.
+  join,     //!< Part of a fan-out stage after its last function finished.
+  gap,      //!< Time between the end of a stage and the start of the next one.
+};
+
+
+/**
+ * @brief Segment of a critical path.
+ */
+struct path_segment final
+{
+  std::string name;                  //!< Stage name, or the stage kind name if the stage is not named.
+  path_segment_kind kind;            //!< Segment kind.
+  std::uint64_t element;             //!< Identity of the function for wait and function segments, zero for others.
+  std::chrono::nanoseconds duration; //!< Segment duration.
+};
+
+
+/**
+ * @brief Critical path of a chain run: the sequence of stages and functions that determined its latency.
+ */
+struct critical_path final
+{
+  std::uint64_t chain;                 //!< Number of the chain run, see @ref stage_event::chain.
+  std::chrono::nanoseconds duration;   //!< Time from the start of the first stage to the end of the last one.
+  std::vector<path_segment> segments;  //!< Segments in execution order, their durations add up to the path duration.
+};
+
+
+/**
+ * @brief Share of a segment in the critical paths of many chain runs.
+ */
+struct path_share final
+{
+  std::string name;                  //!< Stage name, or the stage kind name if the stage is not named.
+  path_segment_kind kind;            //!< Segment kind.
+  std::uint64_t count;               //!< Number of runs with the segment on the critical path.
+  std::chrono::nanoseconds duration; //!< Total duration of the segment in all runs.
+  double share;                      //!< Part of the total duration of all critical paths, from 0 to 1.
+};
+
+
+/**
+ * @brief Observer that records the execution of chains as Chrome trace events, see @ref async::set_observer.
+ *        The trace can be opened in chrome://tracing or https://ui.perfetto.dev. Every stage and every function
+ *        of a fan-out stage is a slice on the track of its thread, a function is linked to the stage that
+ *        spawned it by a flow arrow and the arguments of a slice hold the identities of the stage and its parent.
+ */
+class tracer final : public observer
+{
+  public:
+    using clock = stage_event::clock;
+
+    /**
+     * @brief Constructor. Timestamps of the trace are relative to the construction time.
+     */
+    tracer()
+      : m_origin{clock::now()}
+    {}
+
+    tracer(const tracer&) = delete;
+    tracer& operator=(const tracer&) = delete;
+
+    /**
+     * @brief Record a stage.
+     * @param event - Stage event.
+     */
+    void on_stage_end(const stage_event& event) final
+    {
+      record(event, "stage", 0);
+    }
+
+    /**
+     * @brief Record a spawn of a function.
+     * @param event - Stage event.
+     */
+    void on_spawn(const stage_event& event) final
+    {
+      record(event, "spawn", 's');
+    }
+
+    /**
+     * @brief Record a function call.
+     * @param event - Stage event.
+     */
+    void on_settle(const stage_event& event) final
+    {
+      record(event, "function", 'f');
+    }
+
+    /**
+     * @brief Write the recorded events as Chrome trace-event JSON.
+     * @param stream - Output stream.
+     */
+    void write(std::ostream& stream) const
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      auto flags = stream.flags();
+      auto precision = stream.precision();
+      stream << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+
+      auto first = true;
+      for (const auto& entry : m_entries)
+      {
+        stream << (first ? "\n" : ",\n");
+        first = false;
+        write_slice(stream, entry);
+        if (0 == entry.flow)
+          continue;
+
+        stream << ",\n{\"name\":\"spawn\",\"cat\":\"flow\",\"ph\":\"" << entry.flow << "\""
+               << ('f' == entry.flow ? ",\"bp\":\"e\"" : "") << ",\"id\":" << entry.element
+               << ",\"ts\":" << micros(entry.start) << ",\"pid\":1,\"tid\":" << entry.thread << "}";
+      }
+
+      stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+      stream.flags(flags);
+      stream.precision(precision);
+    }
+
+    /**
+     * @brief Write the recorded events as Chrome trace-event JSON to a file.
+     * @param path - File path.
+     */
+    void save(const std::string& path) const
+    {
+      std::ofstream file{path};
+      if (!file)
+        throw std::runtime_error{"Can't open trace file " + path};
+
+      write(file);
+      if (!file)
+        throw std::runtime_error{"Can't write trace file " + path};
+    }
+
+    /**
+     * @brief Remove the recorded events.
+     */
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      m_entries.clear();
+    }
+
+    /**
+     * @brief Get the number of recorded events.
+     * @return Number of recorded events.
+     */
+    std::size_t size() const
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      return m_entries.size();
+    }
+
+    /**
+     * @brief Compute the critical path of every recorded chain run. A fan-out stage ends when its last
+     *        function finishes, so that function, the time it waited to run and the parts of the stage
+     *        before its spawn and after its end are on the path instead of the whole stage.
+     * @return Critical paths ordered by the chain number.
+     */
+    std::vector<critical_path> critical_paths() const
+    {
+      std::map<std::uint64_t, std::vector<const entry*>> stages;
+      std::map<std::tuple<std::uint64_t, const void*>, const entry*> last_functions;
+
+      std::lock_guard<std::mutex> lock{m_mutex};
+      for (const auto& item : m_entries)
+      {
+        if ('f' == item.flow)
+        {
+          auto& last = last_functions[std::make_tuple(item.chain, item.parent)];
+          if (!last || last->start + last->duration < item.start + item.duration)
+            last = &item;
+        }
+        else if (0 == item.flow)
+        {
+          stages[item.chain].push_back(&item);
+        }
+      }
+
+      std::vector<critical_path> result;
+      for (auto& chain : stages)
+      {
+        auto& items = chain.second;
+        std::stable_sort(items.begin(), items.end(), [] (const entry* a, const entry* b)
+        {
+          return a->start < b->start;
+        });
+
+        critical_path path;
+        path.chain = chain.first;
+        path.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          items.back()->start + items.back()->duration - items.front()->start);
+
+        auto position = items.front()->start;
+        for (auto stage : items)
+        {
+          add_segment(path, *stage, path_segment_kind::gap, 0, position, stage->start);
+          auto end = stage->start + stage->duration;
+          auto function = last_functions.find(std::make_tuple(chain.first, stage->stage));
+          if (last_functions.end() != function)
+          {
+            const auto& item = *function->second;
+            add_segment(path, *stage, path_segment_kind::stage, 0, position, item.start - item.wait);
+            add_segment(path, *stage, path_segment_kind::wait, item.element, position, item.start);
+            add_segment(path, *stage, path_segment_kind::function, item.element, position, item.start + item.duration);
+            add_segment(path, *stage, path_segment_kind::join, 0, position, end);
+          }
+          else
+          {
+            add_segment(path, *stage, path_segment_kind::stage, 0, position, end);
+          }
+        }
+
+        result.push_back(std::move(path));
+      }
+
+      return result;
+    }
+
+    /**
+     * @brief Aggregate the critical paths of all recorded chain runs by stage name and segment kind.
+     * @return Segments sorted by their total duration, the largest first.
+     */
+    std::vector<path_share> critical_path_summary() const
+    {
+      std::map<std::tuple<std::string, path_segment_kind>, path_share> shares;
+      std::chrono::nanoseconds total{0};
+      for (const auto& path : critical_paths())
+      {
+        for (const auto& segment : path.segments)
+        {
+          auto& share = shares[std::make_tuple(segment.name, segment.kind)];
+          share.name = segment.name;
+          share.kind = segment.kind;
+          share.count += 1;
+          share.duration += segment.duration;
+          total += segment.duration;
+        }
+      }
+
+      std::vector<path_share> result;
+      for (auto& share : shares)
+      {
+        share.second.share = 0 == total.count() ? 0.0 : static_cast<double>(share.second.duration.count()) / total.count();
+        result.push_back(std::move(share.second));
+      }
+
+      std::stable_sort(result.begin(), result.end(), [] (const path_share& a, const path_share& b)
+      {
+        return a.duration > b.duration;
+      });
+
+      return result;
+    }
+
+    /**
+     * @brief Write the aggregated critical path as a table, one segment per line.
+     * @param stream - Output stream.
+     */
+    void write_critical_path(std::ostream& stream) const
+    {
+      auto flags = stream.flags();
+      auto precision = stream.precision();
+      stream << std::fixed;
+      for (const auto& share : critical_path_summary())
+      {
+        stream << std::setprecision(1) << std::setw(6) << share.share * 100 << "% "
+               << std::setprecision(3) << std::setw(12) << std::chrono::duration<double, std::milli>{share.duration}.count()
+               << "ms " << std::setw(8) << share.count << "x  " << segment_kind_name(share.kind) << ' ' << share.name << '\n';
+      }
+
+      stream.flags(flags);
+      stream.precision(precision);
+    }
+
+  private:
+    struct entry
+    {
+      std::string name;
+      const char* category;
+      char flow;
+      clock::duration start;
+      clock::duration duration;
+      clock::duration wait;
+      std::size_t thread;
+      const void* stage;
+      const void* parent;
+      std::uint64_t chain;
+      std::uint64_t element;
+      settle_type outcome;
+    };
+
+    void record(const stage_event& event, const char* category, char flow)
+    {
+      entry item;
+      item.name = *event.name ? event.name : stage_kind_name(event.kind);
+      item.category = category;
+      item.flow = flow;
+      item.start = event.start - m_origin;
+      item.duration = event.duration;
+      item.wait = event.wait;
+      item.stage = event.stage;
+      item.parent = event.parent;
+      item.chain = event.chain;
+      item.element = event.element;
+      item.outcome = event.outcome;
+
+      std::lock_guard<std::mutex> lock{m_mutex};
+      item.thread = m_threads.emplace(event.thread, m_threads.size() + 1).first->second;
+      m_entries.push_back(std::move(item));
+    }
+
+    static void add_segment(critical_path& path, const entry& stage, path_segment_kind kind, std::uint64_t element,
+                            clock::duration& position, clock::duration end)
+    {
+      if (end <= position)
+        return;
+
+      path_segment segment;
+      segment.name = stage.name;
+      segment.kind = kind;
+      segment.element = element;
+      segment.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - position);
+      path.segments.push_back(std::move(segment));
+      position = end;
+    }
+
+    static const char* segment_kind_name(path_segment_kind kind)
+    {
+      switch (kind)
+      {
+        case path_segment_kind::stage:
+          return "stage";
+        case path_segment_kind::wait:
+          return "wait";
+        case path_segment_kind::function:
+          return "function";
+        case path_segment_kind::join:
+          return "join";
+        case path_segment_kind::gap:
+          return "gap";
+      }
+
+      return "segment";
+    }
+
+    static double micros(clock::duration duration)
+    {
+      return std::chrono::duration<double, std::micro>{duration}.count();
+    }
+
+    static void write_slice(std::ostream& stream, const entry& item)
+    {
+      stream << "{\"name\":\"";
+      write_escaped(stream, item.name);
+      stream << "\",\"cat\":\"" << item.category << "\",\"ph\":\"X\",\"ts\":" << micros(item.start)
+             << ",\"dur\":" << micros(item.duration) << ",\"pid\":1,\"tid\":" << item.thread
+             << ",\"args\":{\"stage\":\"" << item.stage << "\",\"parent\":\"" << item.parent
+             << "\",\"chain\":" << item.chain;
+      if (0 != item.element)
+        stream << ",\"element\":" << item.element;
+
+      stream << ",\"outcome\":\"" << (settle_type::resolved == item.outcome ? "resolved" : "rejected") << "\"}}";
+    }
+
+    static void write_escaped(std::ostream& stream, const std::string& str)
+    {
+      static constexpr char digits[] = "0123456789abcdef";
+      for (auto c : str)
+      {
+        auto code = static_cast<unsigned char>(c);
+        if ('"' == c || '\\' == c)
+          stream << '\\' << c;
+        else if (code < 0x20)
+          stream << "\\u00" << digits[code >> 4] << digits[code & 0xf];
+        else
+          stream << c;
+      }
+    }
+
+    const clock::time_point m_origin;
+    std::vector<entry> m_entries;
+    std::unordered_map<std::thread::id, std::size_t> m_threads;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace async
+
+#endif // ASYNC_PROMISE_TRACER_H
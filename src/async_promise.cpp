@@ -0,0 +1,71 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+#define ASYNC_PROMISE_SOURCE
+
+// stl
+#include <string>
+#include <vector>
+
+// async_promise
+#include <async_promise.hpp>
+#include <async_promise_metrics.hpp>
+
+
+namespace async
+{
+
+namespace internal
+{
+
+template class task<void>;
+template class task<int>;
+template class task<std::string>;
+template class task<std::vector<int>>;
+template class task<std::vector<std::string>>;
+
+// Stages that do not depend on the functions of a chain. The void resolved stage is an explicit
+// specialization complete in the header
+template class delay_task<void>;
+template class delay_task<int>;
+template class delay_task<std::string>;
+template class delay_task<std::vector<int>>;
+template class delay_task<std::vector<std::string>>;
+template class throttle_task<void>;
+template class throttle_task<int>;
+template class throttle_task<std::string>;
+template class throttle_task<std::vector<int>>;
+template class throttle_task<std::vector<std::string>>;
+template class retry_task<void>;
+template class retry_task<int>;
+template class retry_task<std::string>;
+template class retry_task<std::vector<int>>;
+template class retry_task<std::vector<std::string>>;
+template class make_resolved_task<int>;
+template class make_resolved_task<std::string>;
+template class make_resolved_task<std::vector<int>>;
+template class make_resolved_task<std::vector<std::string>>;
+
+} // namespace internal
+
+template class promise<void>;
+template class promise<int>;
+template class promise<std::string>;
+template class promise<std::vector<int>>;
+template class promise<std::vector<std::string>>;
+
+} // namespace async
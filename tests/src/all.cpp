@@ -15,10 +15,40 @@
 **
 ******************************************************************************/
 
+
+// stl
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 // local
 #include "common.h"
 
 
+namespace
+{
+
+// Takes the string over, so a function that shared the input with another one would see it moved out
+int take_length(std::string&& str)
+{
+  auto taken = std::move(str);
+  return static_cast<int>(taken.size());
+}
+
+
+struct taker final
+{
+  int take_length(std::string&& str)
+  {
+    return ::take_length(std::move(str));
+  }
+};
+
+} // namespace
+
+
 TEST_CASE("All with class method void void", "[all]")
 {
   test_struct obj;
@@ -308,3 +338,60 @@ TEST_CASE("All with function error string string", "[all]")
   REQUIRE_THROWS_MATCHES(res = future.get(), std::runtime_error, Catch::Matchers::Message(str2));
   REQUIRE(res.empty());
 }
+
+
+TEST_CASE("All with many small results on a thread pool", "[all]")
+{
+  std::vector<std::function<int(int)>> funcs;
+  for (int i = 0; i < 256; ++i)
+    funcs.emplace_back([i] (int x) { return x + i; });
+
+  async::thread_pool pool{4};
+  auto future = async::make_resolved_promise(1).all(funcs).on(pool).run();
+
+  std::vector<int> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res.size() == funcs.size());
+  for (std::size_t i = 0; i < res.size(); ++i)
+    REQUIRE(static_cast<int>(i) + 1 == res[i]);
+}
+
+
+TEST_CASE("All runs the first function on the calling thread", "[all]")
+{
+  auto caller = std::make_shared<std::thread::id>();
+  std::vector<std::function<std::thread::id()>> funcs(2, [] () { return std::this_thread::get_id(); });
+
+  auto future = async::make_promise([caller] () { *caller = std::this_thread::get_id(); }).all(funcs).run();
+
+  std::vector<std::thread::id> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res.size() == funcs.size());
+  REQUIRE(res.front() == *caller);
+  REQUIRE(res.back() != *caller);
+}
+
+
+TEST_CASE("All with function taking the input by rvalue reference", "[all]")
+{
+  std::vector<int(*)(std::string&&)> funcs{take_length, take_length, take_length};
+
+  auto future = async::make_resolved_promise(std::string{str1}).all(funcs).run();
+
+  std::vector<int> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == std::vector<int>(funcs.size(), static_cast<int>(std::string{str1}.size())));
+}
+
+
+TEST_CASE("All with class method taking the input by rvalue reference", "[all]")
+{
+  taker obj;
+  std::vector<int(taker::*)(std::string&&)> methods{&taker::take_length, &taker::take_length};
+
+  auto future = async::make_resolved_promise(std::string{str1}).all(methods, &obj).run();
+
+  std::vector<int> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == std::vector<int>(methods.size(), static_cast<int>(std::string{str1}.size())));
+}
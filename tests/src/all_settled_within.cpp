@@ -0,0 +1,185 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+// stl
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+static constexpr auto timeout = std::chrono::milliseconds(delay_length * 10);
+
+
+TEST_CASE("All settled within with class method void void", "[all_settled_within]")
+{
+  test_struct obj;
+  // Declared after the object, so the methods still running when the stage timed out finish before it is destroyed
+  async::thread_pool pool{2};
+
+  std::vector<void(test_struct::*)() const> methods
+  {
+    &test_struct::void_void,
+    &test_struct::error_void_void,
+  };
+
+  auto future = async::make_resolved_promise().all_settled_within(timeout, methods, &obj).on(pool).run();
+
+  std::vector<async::settled<void>> res;
+  REQUIRE_NOTHROW(res = future.get());
+
+  REQUIRE(res.size() == methods.size());
+  REQUIRE(res.front().type == async::settle_type::resolved);
+  REQUIRE(res.back().type == async::settle_type::rejected);
+  REQUIRE_THROWS_MATCHES(std::rethrow_exception(res.back().error), std::runtime_error, Catch::Matchers::Message(str2));
+}
+
+
+TEST_CASE("All settled within with class method string string", "[all_settled_within]")
+{
+  test_struct obj;
+  async::thread_pool pool{2};
+
+  std::vector<std::string(test_struct::*)(std::string) const> methods
+  {
+    &test_struct::string_string1,
+    &test_struct::string_string2,
+  };
+
+  auto future = async::make_resolved_promise(str1).all_settled_within(timeout, methods, &obj).on(pool).run();
+
+  std::vector<async::settled<std::string>> res;
+  REQUIRE_NOTHROW(res = future.get());
+
+  REQUIRE(res.size() == methods.size());
+  REQUIRE(res.front().type == async::settle_type::resolved);
+  REQUIRE(res.front().result == str1);
+  REQUIRE(res.back().type == async::settle_type::resolved);
+  REQUIRE(res.back().result == str2);
+}
+
+
+TEST_CASE("All settled within with func void string", "[all_settled_within]")
+{
+  std::vector<void(*)(std::string)> funcs
+  {
+    error_void_string,
+    void_string,
+  };
+
+  auto future = async::make_resolved_promise(str1).all_settled_within(timeout, funcs).run();
+
+  std::vector<async::settled<void>> res;
+  REQUIRE_NOTHROW(res = future.get());
+
+  REQUIRE(res.size() == funcs.size());
+  REQUIRE(res.front().type == async::settle_type::rejected);
+  REQUIRE(res.back().type == async::settle_type::resolved);
+}
+
+
+TEST_CASE("All settled within with func string void ignore arg", "[all_settled_within]")
+{
+  std::vector<std::string(*)()> funcs
+  {
+    string_void1,
+    error_string_void,
+  };
+
+  auto future = async::make_resolved_promise(str1).all_settled_within(timeout, funcs).run();
+
+  std::vector<async::settled<std::string>> res;
+  REQUIRE_NOTHROW(res = future.get());
+
+  REQUIRE(res.size() == funcs.size());
+  REQUIRE(res.front().type == async::settle_type::resolved);
+  REQUIRE(res.front().result == str1);
+  REQUIRE(res.back().type == async::settle_type::rejected);
+  REQUIRE_THROWS_MATCHES(std::rethrow_exception(res.back().error), std::runtime_error, Catch::Matchers::Message(str2));
+}
+
+
+TEST_CASE("All settled within marks stragglers timed out", "[all_settled_within]")
+{
+  std::promise<void> release;
+  auto released = release.get_future().share();
+
+  std::vector<std::function<std::string()>> funcs
+  {
+    string_void1,
+    [released] () { released.wait(); return std::string{str2}; },
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_resolved_promise().all_settled_within(std::chrono::milliseconds(delay_length), funcs).run();
+
+  std::vector<async::settled<std::string>> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(std::chrono::steady_clock::now() - start < timeout);
+  release.set_value();
+
+  REQUIRE(res.size() == funcs.size());
+  REQUIRE(res.front().type == async::settle_type::resolved);
+  REQUIRE(res.front().result == str1);
+  REQUIRE(res.back().type == async::settle_type::timed_out);
+  REQUIRE_THROWS_AS(std::rethrow_exception(res.back().error), async::timeout_error);
+}
+
+
+TEST_CASE("All settled within skips functions not started before deadline", "[all_settled_within]")
+{
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  auto calls = std::make_shared<std::atomic<int>>(0);
+
+  std::vector<std::function<void()>> funcs(3, [released, calls] () { ++*calls; released.wait(); });
+
+  auto limiter = std::make_shared<async::concurrency_limiter>(1, 1, 1);
+  auto future = async::make_resolved_promise()
+                .all_settled_within(std::chrono::milliseconds(delay_length), funcs)
+                .limit(limiter)
+                .run();
+
+  std::vector<async::settled<void>> res;
+  REQUIRE_NOTHROW(res = future.get());
+  release.set_value();
+
+  REQUIRE(res.size() == funcs.size());
+  for (const auto& item : res)
+    REQUIRE(item.type == async::settle_type::timed_out);
+
+  REQUIRE(1 == *calls);
+}
+
+
+TEST_CASE("All settled within with empty iterable", "[all_settled_within]")
+{
+  std::vector<std::string(*)()> funcs;
+
+  auto future = async::make_resolved_promise().all_settled_within(timeout, funcs).run();
+
+  std::vector<async::settled<std::string>> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res.empty());
+}
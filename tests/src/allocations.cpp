@@ -0,0 +1,157 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+// async_promise
+#include <async_promise_allocations.hpp>
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+class tracking_scope final
+{
+  public:
+    tracking_scope()
+    {
+      async::set_allocation_tracking(true);
+    }
+
+    ~tracking_scope()
+    {
+      async::set_allocation_tracking(false);
+    }
+};
+
+
+async::stage_allocations find(async::stage_kind kind)
+{
+  for (const auto& item : async::get_allocation_stats())
+  {
+    if (kind == item.kind)
+      return item;
+  }
+
+  return async::stage_allocations{kind, {}, {}};
+}
+
+
+std::vector<char> allocate(std::size_t size)
+{
+  return std::vector<char>(size);
+}
+
+} // namespace
+
+
+TEST_CASE("Allocation tracking is disabled by default", "[allocations]")
+{
+  auto before = find(async::stage_kind::then);
+  auto future = async::make_promise([] () { return allocate(1024).size(); })
+      .then([] (std::size_t size) { return allocate(size).size(); })
+      .run();
+
+  REQUIRE(1024 == future.get());
+  auto after = find(async::stage_kind::then);
+  REQUIRE(before.user.bytes == after.user.bytes);
+  REQUIRE(before.library.bytes == after.library.bytes);
+}
+
+
+TEST_CASE("Allocations of stage functions", "[allocations]")
+{
+  tracking_scope tracking;
+  auto initial = find(async::stage_kind::initial);
+  auto then = find(async::stage_kind::then);
+
+  auto future = async::make_promise([] () { return allocate(1000).size(); })
+      .then([] (std::size_t size) { return allocate(size * 10).size(); })
+      .run();
+
+  REQUIRE(10000 == future.get());
+  REQUIRE(initial.library.allocations < find(async::stage_kind::initial).library.allocations);
+  REQUIRE(initial.user.bytes + 1000 <= find(async::stage_kind::initial).user.bytes);
+  REQUIRE(then.library.allocations < find(async::stage_kind::then).library.allocations);
+  REQUIRE(then.user.bytes + 10000 <= find(async::stage_kind::then).user.bytes);
+}
+
+
+TEST_CASE("Allocations of fan-out stages", "[allocations]")
+{
+  tracking_scope tracking;
+  auto before = find(async::stage_kind::all);
+
+  std::vector<std::size_t(*)(int)> funcs{[] (int) { return allocate(3000).size(); },
+                                         [] (int) { return allocate(3000).size(); }};
+  auto future = async::make_promise([] () { return 0; }).all(funcs).run();
+
+  REQUIRE(2 == future.get().size());
+  auto after = find(async::stage_kind::all);
+  REQUIRE(before.user.bytes + 6000 <= after.user.bytes);
+  REQUIRE(before.library.allocations < after.library.allocations);
+}
+
+
+TEST_CASE("Allocations of detached functions", "[allocations]")
+{
+  tracking_scope tracking;
+  auto before = find(async::stage_kind::some);
+
+  std::vector<std::size_t(*)(int)> funcs{[] (int) { return allocate(4000).size(); },
+                                         [] (int) { return allocate(4000).size(); }};
+  auto future = async::make_promise([] () { return 0; }).some(2, funcs).run();
+
+  REQUIRE(2 == future.get().size());
+  REQUIRE(before.user.bytes + 8000 <= find(async::stage_kind::some).user.bytes);
+}
+
+
+TEST_CASE("Allocations of registered chains", "[allocations]")
+{
+  tracking_scope tracking;
+  async::set_chain_registry(true);
+
+  std::promise<void> gate;
+  auto shared = gate.get_future().share();
+  auto future = async::make_promise([shared] () { auto buffer = allocate(5000); shared.wait(); return buffer.size(); }).run();
+
+  std::vector<async::chain_info> chains;
+  for (auto i = 0; i < 5000 && (chains.empty() || chains.front().allocated_bytes < 5000); ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    chains = async::get_chains();
+  }
+
+  async::set_chain_registry(false);
+  REQUIRE(1 == chains.size());
+  REQUIRE(0 < chains.front().allocations);
+  REQUIRE(5000 <= chains.front().allocated_bytes);
+
+  gate.set_value();
+  REQUIRE(5000 == future.get());
+}
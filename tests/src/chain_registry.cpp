@@ -0,0 +1,172 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <chrono>
+#include <functional>
+#include <future>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// async_promise
+#include <async_promise.hpp>
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+class registry_scope final
+{
+  public:
+    registry_scope()
+    {
+      async::set_chain_registry(true);
+    }
+
+    ~registry_scope()
+    {
+      async::set_chain_registry(false);
+    }
+};
+
+
+template<typename Predicate>
+bool wait_for(Predicate predicate)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  while (!predicate())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+
+  return true;
+}
+
+
+std::vector<std::function<int(int)>> blocking_funcs(std::shared_future<void> gate, std::size_t count)
+{
+  std::vector<std::function<int(int)>> funcs;
+  for (std::size_t i = 0; i < count; ++i)
+    funcs.push_back([gate] (int value) { gate.wait(); return value; });
+  return funcs;
+}
+
+} // namespace
+
+
+TEST_CASE("Chain registry is disabled by default", "[chain registry]")
+{
+  std::promise<void> gate;
+  auto future = async::make_promise([] (std::shared_future<void> gate) { gate.wait(); }, gate.get_future().share()).run();
+
+  REQUIRE(async::get_chains().empty());
+  gate.set_value();
+  future.get();
+}
+
+
+TEST_CASE("Chain registry tracks stages and outstanding functions", "[chain registry]")
+{
+  registry_scope registry;
+  std::promise<void> gate;
+  auto future = async::make_promise([] () { return 1; }).name("load")
+      .all(blocking_funcs(gate.get_future().share(), 2)).name("fan")
+      .then([] (std::vector<int> values) { return values.size(); }).name("save")
+      .run();
+
+  REQUIRE(wait_for([] () { auto chains = async::get_chains(); return 1 == chains.size() && 2 == chains.front().outstanding; }));
+  auto chains = async::get_chains();
+  REQUIRE(std::vector<std::string>{"load", "fan", "save"} == chains.front().stages);
+  REQUIRE(1 == chains.front().current);
+  REQUIRE(std::this_thread::get_id() != chains.front().thread);
+  REQUIRE(0 < chains.front().id);
+
+  std::ostringstream stream;
+  async::dump_chains(stream);
+  REQUIRE(std::string::npos != stream.str().find("outstanding 2: load -> [fan] -> save\n"));
+
+  gate.set_value();
+  REQUIRE(2 == future.get());
+  REQUIRE(async::get_chains().empty());
+}
+
+
+TEST_CASE("Chain registry names unnamed stages by kind", "[chain registry]")
+{
+  registry_scope registry;
+  std::promise<void> gate;
+  auto shared = gate.get_future().share();
+  auto future = async::make_promise([] () { return 1; })
+      .then([shared] (int value) { shared.wait(); return value; })
+      .run();
+
+  REQUIRE(wait_for([] () { auto chains = async::get_chains(); return 1 == chains.size() && 1 == chains.front().current; }));
+  auto chains = async::get_chains();
+  REQUIRE(std::vector<std::string>{"initial", "then"} == chains.front().stages);
+  REQUIRE(0 == chains.front().outstanding);
+
+  gate.set_value();
+  REQUIRE(1 == future.get());
+}
+
+
+TEST_CASE("Chain registry counts race losers as outstanding", "[chain registry]")
+{
+  registry_scope registry;
+  std::promise<void> gate;
+  auto funcs = blocking_funcs(gate.get_future().share(), 1);
+  funcs.push_back([] (int value) { return value; });
+  auto future = async::make_promise([] () { return 1; }).race(funcs).name("race").run();
+
+  REQUIRE(wait_for([] () { auto chains = async::get_chains(); return 1 == chains.size() && 1 == chains.front().outstanding; }));
+  REQUIRE("race" == async::get_chains().front().stages.at(async::get_chains().front().current));
+
+  gate.set_value();
+  REQUIRE(1 == future.get());
+}
+
+
+TEST_CASE("Chain registry sorts chains by age", "[chain registry]")
+{
+  registry_scope registry;
+  std::promise<void> gate;
+  auto shared = gate.get_future().share();
+  auto first = async::make_promise([] (std::shared_future<void> gate) { gate.wait(); }, shared).run();
+  REQUIRE(wait_for([] () { return 1 == async::get_chains().size(); }));
+  std::this_thread::sleep_for(std::chrono::milliseconds{2});
+  auto second = async::make_promise([] (std::shared_future<void> gate) { gate.wait(); }, shared).run();
+  REQUIRE(wait_for([] () { return 2 == async::get_chains().size(); }));
+
+  auto chains = async::get_chains();
+  REQUIRE(chains[0].id < chains[1].id);
+  REQUIRE(chains[0].age > chains[1].age);
+
+  gate.set_value();
+  first.get();
+  second.get();
+}
@@ -0,0 +1,137 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+// stl
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+TEST_CASE("Delay void", "[delay]")
+{
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::delay(std::chrono::milliseconds(delay_length)).run();
+
+  REQUIRE_NOTHROW(future.get());
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(delay_length));
+}
+
+
+TEST_CASE("Delay after resolved void", "[delay]")
+{
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_resolved_promise().delay(std::chrono::milliseconds(delay_length)).run();
+
+  REQUIRE_NOTHROW(future.get());
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(delay_length));
+}
+
+
+TEST_CASE("Delay after resolved string", "[delay]")
+{
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_resolved_promise(str1).delay(std::chrono::milliseconds(delay_length)).run();
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(delay_length));
+}
+
+
+TEST_CASE("Delay after rejected string", "[delay]")
+{
+  auto future = async::make_rejected_promise<std::string>(std::runtime_error{str2})
+                .delay(std::chrono::milliseconds(delay_length)).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+}
+
+
+TEST_CASE("Delay many chains", "[delay]")
+{
+  std::vector<std::future<std::string>> futures;
+  for (auto i = 0; i < delay_length; ++i)
+    futures.push_back(async::delay(std::chrono::milliseconds(i)).then(string_void1).run());
+
+  for (auto& future : futures)
+    REQUIRE(future.get() == str1);
+}
+
+
+TEST_CASE("Delay deferred", "[delay]")
+{
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_resolved_promise(str1).delay(std::chrono::milliseconds(delay_length))
+                .then(string_string1).run(std::launch::deferred);
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(delay_length));
+}
+
+
+TEST_CASE("Delay releases the pool worker", "[delay]")
+{
+  async::thread_pool pool{1};
+  auto future = async::make_resolved_promise(str1).delay(std::chrono::milliseconds(delay_length))
+                .then(string_string1).run(pool);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(delay_length / 2));
+  REQUIRE(0 == pool.active());
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+}
+
+
+TEST_CASE("Delay many chains on a pool", "[delay]")
+{
+  async::thread_pool pool{1};
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::future<std::string>> futures;
+  for (auto i = 0; i < 100; ++i)
+    futures.push_back(async::delay(std::chrono::milliseconds(delay_length)).then(string_void1).run(pool));
+
+  for (auto& future : futures)
+    REQUIRE(future.get() == str1);
+
+  REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10 * delay_length));
+}
+
+
+TEST_CASE("Delays between stages", "[delay]")
+{
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_resolved_promise(str1).delay(std::chrono::milliseconds(delay_length / 2))
+                .then(error_string_string).delay(std::chrono::milliseconds(delay_length / 2))
+                .fail(string_exception).delay(std::chrono::milliseconds(delay_length / 2)).run();
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str2);
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(delay_length));
+}
@@ -0,0 +1,209 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+class concurrency_probe final
+{
+  public:
+    std::string call()
+    {
+      auto running = ++m_running;
+      auto max = m_max.load();
+      while (max < running && !m_max.compare_exchange_weak(max, running));
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay_length / 10));
+      --m_running;
+      return str1;
+    }
+
+    int max() const
+    {
+      return m_max;
+    }
+
+  private:
+    std::atomic<int> m_running{0};
+    std::atomic<int> m_max{0};
+};
+
+
+std::vector<std::function<std::string()>> make_funcs(concurrency_probe& probe, std::size_t count)
+{
+  return std::vector<std::function<std::string()>>(count, std::bind(&concurrency_probe::call, &probe));
+}
+
+} // namespace
+
+
+TEST_CASE("Limit all", "[limit]")
+{
+  concurrency_probe probe;
+  auto limiter = std::make_shared<async::concurrency_limiter>(2, 1, 2);
+  auto future = async::make_resolved_promise().all(make_funcs(probe, 8)).limit(limiter).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(8 == res.size());
+  REQUIRE(std::all_of(res.begin(), res.end(), [] (const std::string& str) { return str == str1; }));
+  REQUIRE(2 >= probe.max());
+  REQUIRE(0 == limiter->in_flight());
+}
+
+
+TEST_CASE("Limit make all", "[limit]")
+{
+  concurrency_probe probe;
+  auto limiter = std::make_shared<async::concurrency_limiter>(3, 1, 3);
+  auto future = async::make_promise_all(make_funcs(probe, 9)).limit(limiter).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(9 == res.size());
+  REQUIRE(3 >= probe.max());
+}
+
+
+TEST_CASE("Limit race", "[limit]")
+{
+  concurrency_probe probe;
+  auto limiter = std::make_shared<async::concurrency_limiter>(1, 1, 1);
+  auto future = async::make_resolved_promise().race(make_funcs(probe, 4)).limit(limiter).run();
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(1 == probe.max());
+}
+
+
+TEST_CASE("Limit leaves the original promise unlimited", "[limit]")
+{
+  concurrency_probe probe;
+  auto limiter = std::make_shared<async::concurrency_limiter>(1, 1, 1);
+  auto unlimited = async::make_resolved_promise().all(make_funcs(probe, 4));
+  auto limited = unlimited.limit(limiter);
+
+  REQUIRE(4 == limited.run().get().size());
+  REQUIRE(1 == probe.max());
+
+  REQUIRE(4 == unlimited.run().get().size());
+  REQUIRE(1 < probe.max());
+}
+
+
+TEST_CASE("Limit all rejected", "[limit]")
+{
+  auto limiter = std::make_shared<async::concurrency_limiter>(2, 1, 2);
+  std::vector<void(*)()> funcs
+  {
+    void_void,
+    error_void_void,
+    void_void,
+  };
+
+  auto future = async::make_resolved_promise().all(funcs).limit(limiter).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+}
+
+
+TEST_CASE("Limiter backs off on rejections", "[limit]")
+{
+  async::concurrency_limiter limiter{10, 2, 20};
+
+  for (auto i = 0; i < 10; ++i)
+  {
+    limiter.acquire();
+    limiter.release(std::chrono::milliseconds(1), false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  REQUIRE(limiter.limit() < 10);
+  REQUIRE(limiter.limit() >= 2);
+}
+
+
+TEST_CASE("Limiter backs off on latency growth", "[limit]")
+{
+  async::concurrency_limiter limiter{10, 1, 20};
+
+  limiter.acquire();
+  limiter.release(std::chrono::milliseconds(1), true);
+  limiter.acquire();
+  limiter.release(std::chrono::milliseconds(10), true);
+
+  REQUIRE(limiter.limit() < 10);
+}
+
+
+TEST_CASE("Limiter grows while saturated", "[limit]")
+{
+  async::concurrency_limiter limiter{2, 1, 20};
+
+  for (auto i = 0; i < 20; ++i)
+  {
+    limiter.acquire();
+    limiter.acquire();
+    limiter.release(std::chrono::milliseconds(1), true);
+    limiter.release(std::chrono::milliseconds(1), true);
+  }
+
+  REQUIRE(limiter.limit() > 2);
+  REQUIRE(0 == limiter.in_flight());
+}
+
+
+TEST_CASE("Limiter try acquire", "[limit]")
+{
+  async::concurrency_limiter limiter{1, 1, 1};
+
+  REQUIRE(limiter.try_acquire_for(std::chrono::seconds::zero()));
+  REQUIRE_FALSE(limiter.try_acquire_for(std::chrono::milliseconds(1)));
+  limiter.release(std::chrono::milliseconds(1), true);
+  REQUIRE(limiter.try_acquire_for(std::chrono::seconds::zero()));
+  limiter.release(std::chrono::milliseconds(1), true);
+}
+
+
+TEST_CASE("Limit a chain run on its own thread pool", "[limit]")
+{
+  async::thread_pool pool{1};
+  auto limiter = std::make_shared<async::concurrency_limiter>(1, 1, 1);
+  std::vector<int(*)(int)> funcs(4, [] (int value) { return value; });
+
+  auto future = async::make_promise([] () { return 1; }).all(funcs).limit(limiter).on(pool).run(pool);
+
+  REQUIRE(std::future_status::ready == future.wait_for(std::chrono::seconds(5)));
+  REQUIRE(std::vector<int>(4, 1) == future.get());
+}
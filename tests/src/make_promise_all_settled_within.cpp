@@ -0,0 +1,89 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+// stl
+#include <chrono>
+#include <string>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+TEST_CASE("Make all settled within with class method string string", "[make promise all_settled_within]")
+{
+  test_struct obj;
+  // Declared after the object, so the methods still running when the stage timed out finish before it is destroyed
+  async::thread_pool pool{2};
+
+  std::vector<std::string(test_struct::*)(std::string) const> methods
+  {
+    &test_struct::string_string1,
+    &test_struct::error_string_string,
+  };
+
+  auto future = async::make_promise_all_settled_within(std::chrono::milliseconds(delay_length * 10), methods, &obj, str1).on(pool).run();
+
+  std::vector<async::settled<std::string>> res;
+  REQUIRE_NOTHROW(res = future.get());
+
+  REQUIRE(res.size() == methods.size());
+  REQUIRE(res.front().type == async::settle_type::resolved);
+  REQUIRE(res.front().result == str1);
+  REQUIRE(res.back().type == async::settle_type::rejected);
+  REQUIRE_THROWS_MATCHES(std::rethrow_exception(res.back().error), std::runtime_error, Catch::Matchers::Message(str2));
+}
+
+
+TEST_CASE("Make all settled within with func void void", "[make promise all_settled_within]")
+{
+  std::vector<void(*)()> funcs
+  {
+    void_void,
+    error_void_void,
+  };
+
+  auto future = async::make_promise_all_settled_within(std::chrono::milliseconds(delay_length * 10), funcs).run();
+
+  std::vector<async::settled<void>> res;
+  REQUIRE_NOTHROW(res = future.get());
+
+  REQUIRE(res.size() == funcs.size());
+  REQUIRE(res.front().type == async::settle_type::resolved);
+  REQUIRE(res.back().type == async::settle_type::rejected);
+}
+
+
+TEST_CASE("Make all settled within with func timed out", "[make promise all_settled_within]")
+{
+  std::vector<std::string(*)(std::string)> funcs
+  {
+    string_string1,
+    string_string_delayed,
+  };
+
+  auto future = async::make_promise_all_settled_within(std::chrono::milliseconds(delay_length / 2), funcs, str1).run();
+
+  std::vector<async::settled<std::string>> res;
+  REQUIRE_NOTHROW(res = future.get());
+
+  REQUIRE(res.size() == funcs.size());
+  REQUIRE(res.front().type == async::settle_type::resolved);
+  REQUIRE(res.front().result == str1);
+  REQUIRE(res.back().type == async::settle_type::timed_out);
+}
@@ -0,0 +1,111 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+// stl
+#include <string>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+TEST_CASE("Make some with class method void void", "[make promise some]")
+{
+  test_struct obj;
+  // Declared after the object, so the methods still running when the stage settled finish before it is destroyed
+  async::thread_pool pool{2};
+
+  std::vector<void(test_struct::*)() const> methods
+  {
+    &test_struct::void_void,
+    &test_struct::error_void_void,
+    &test_struct::void_void,
+  };
+
+  auto future = async::make_promise_some(2, methods, &obj).on(pool).run();
+
+  REQUIRE_NOTHROW(future.get());
+}
+
+
+TEST_CASE("Make some with class method string string", "[make promise some]")
+{
+  test_struct obj;
+  async::thread_pool pool{2};
+
+  std::vector<std::string(test_struct::*)(std::string) const> methods
+  {
+    &test_struct::error_string_string,
+    &test_struct::string_string1,
+    &test_struct::string_string1,
+  };
+
+  auto future = async::make_promise_some(2, methods, &obj, str1).on(pool).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE_THAT(res, Catch::Matchers::Equals(std::vector<std::string>{str1, str1}));
+}
+
+
+TEST_CASE("Make some with class method error string string", "[make promise some]")
+{
+  test_struct obj;
+  async::thread_pool pool{2};
+
+  std::vector<std::string(test_struct::*)(std::string) const> methods
+  {
+    &test_struct::error_string_string,
+    &test_struct::string_string1,
+  };
+
+  auto future = async::make_promise_some(2, methods, &obj, str1).on(pool).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), async::aggregate_error, Catch::Matchers::Message(aggregate_error_message));
+}
+
+
+TEST_CASE("Make some with func string void", "[make promise some]")
+{
+  std::vector<std::string(*)()> funcs
+  {
+    string_void2,
+    error_string_void,
+    string_void2,
+  };
+
+  auto future = async::make_promise_some(2, funcs).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE_THAT(res, Catch::Matchers::Equals(std::vector<std::string>{str2, str2}));
+}
+
+
+TEST_CASE("Make some with func error void string", "[make promise some]")
+{
+  std::vector<void(*)(std::string)> funcs
+  {
+    error_void_string,
+    error_void_string,
+    void_string,
+  };
+
+  auto future = async::make_promise_some(2, funcs, str1).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), async::aggregate_error, Catch::Matchers::Message(aggregate_error_message));
+}
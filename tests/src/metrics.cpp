@@ -0,0 +1,163 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+// stl
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// async_promise
+#include <async_promise_metrics.hpp>
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+class metrics_scope final
+{
+  public:
+    explicit metrics_scope(async::metrics& metrics)
+    {
+      async::set_observer(&metrics);
+    }
+
+    ~metrics_scope()
+    {
+      async::set_observer(nullptr);
+    }
+};
+
+
+bool near(std::chrono::nanoseconds value, std::chrono::nanoseconds expected)
+{
+  return std::abs(static_cast<double>(value.count() - expected.count())) <= 0.04 * expected.count();
+}
+
+} // namespace
+
+
+TEST_CASE("Histogram percentiles", "[metrics]")
+{
+  async::latency_histogram histogram;
+  for (auto i = 1; i <= 10000; ++i)
+    histogram.record(std::chrono::microseconds(i));
+
+  auto snapshot = histogram.snapshot();
+  REQUIRE(10000 == snapshot.count());
+  REQUIRE(std::chrono::microseconds(10000) == snapshot.max());
+  REQUIRE(near(snapshot.mean(), std::chrono::nanoseconds(5000500)));
+  REQUIRE(near(snapshot.percentile(50), std::chrono::microseconds(5000)));
+  REQUIRE(near(snapshot.percentile(90), std::chrono::microseconds(9000)));
+  REQUIRE(near(snapshot.percentile(99), std::chrono::microseconds(9900)));
+  REQUIRE(near(snapshot.percentile(99.9), std::chrono::microseconds(9990)));
+  REQUIRE(snapshot.max() == snapshot.percentile(100));
+}
+
+
+TEST_CASE("Histogram small and empty values", "[metrics]")
+{
+  async::latency_histogram histogram;
+  REQUIRE(0 == histogram.snapshot().count());
+  REQUIRE(std::chrono::nanoseconds::zero() == histogram.snapshot().percentile(50));
+
+  histogram.record(std::chrono::nanoseconds(7));
+  histogram.record(std::chrono::nanoseconds(-1));
+  auto snapshot = histogram.snapshot();
+  REQUIRE(2 == snapshot.count());
+  REQUIRE(std::chrono::nanoseconds(0) == snapshot.percentile(50));
+  REQUIRE(std::chrono::nanoseconds(7) == snapshot.percentile(100));
+}
+
+
+TEST_CASE("Histogram concurrent recording and merge", "[metrics]")
+{
+  async::latency_histogram histogram;
+  std::vector<std::thread> threads;
+  for (auto i = 0; i < 4; ++i)
+  {
+    threads.emplace_back([&histogram]
+    {
+      for (auto j = 0; j < 1000; ++j)
+        histogram.record(std::chrono::milliseconds(1));
+    });
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+
+  auto snapshot = histogram.snapshot();
+  REQUIRE(4000 == snapshot.count());
+  snapshot.merge(histogram.snapshot());
+  REQUIRE(8000 == snapshot.count());
+  REQUIRE(near(snapshot.percentile(50), std::chrono::milliseconds(1)));
+}
+
+
+TEST_CASE("Metrics per named stage", "[metrics]")
+{
+  async::metrics metrics;
+  {
+    metrics_scope scope{metrics};
+    std::vector<std::string(*)(std::string)> funcs
+    {
+      string_string1,
+      string_string2,
+    };
+
+    for (auto i = 0; i < 5; ++i)
+    {
+      async::make_promise(string_void1).name("load")
+          .then(string_string_delayed).name("parse")
+          .all(funcs)
+          .run().get();
+    }
+  }
+
+  auto stages = metrics.snapshot();
+  REQUIRE(3 == stages.size());
+  REQUIRE("all" == stages[0].name);
+  REQUIRE("load" == stages[1].name);
+  REQUIRE("parse" == stages[2].name);
+  REQUIRE(5 == stages[0].stage.count());
+  REQUIRE(10 == stages[0].function.count());
+  REQUIRE(10 == stages[0].wait.count());
+  REQUIRE(5 == stages[2].stage.count());
+  REQUIRE(0 == stages[2].function.count());
+  REQUIRE(stages[2].stage.max() >= std::chrono::milliseconds(delay_length));
+  REQUIRE(stages[1].stage.percentile(99) < std::chrono::milliseconds(delay_length));
+}
+
+
+TEST_CASE("Metrics other stages", "[metrics]")
+{
+  async::metrics metrics{1};
+  {
+    metrics_scope scope{metrics};
+    async::make_promise(string_void1).name("first").then(string_string1).name("second").run().get();
+  }
+
+  auto stages = metrics.snapshot();
+  REQUIRE(2 == stages.size());
+  REQUIRE("first" == stages[0].name);
+  REQUIRE("other" == stages[1].name);
+}
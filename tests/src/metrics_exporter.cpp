@@ -0,0 +1,138 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <sstream>
+#include <string>
+
+// async_promise
+#include <async_promise_metrics.hpp>
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+class metrics_scope final
+{
+  public:
+    explicit metrics_scope(async::metrics& metrics)
+    {
+      async::set_observer(&metrics);
+    }
+
+    ~metrics_scope()
+    {
+      async::set_observer(nullptr);
+    }
+};
+
+
+bool contains(const std::string& str, const std::string& part)
+{
+  return std::string::npos != str.find(part);
+}
+
+} // namespace
+
+
+TEST_CASE("Export runtime statistics in Prometheus format", "[metrics exporter]")
+{
+  async::metrics_exporter exporter;
+  auto text = exporter.prometheus();
+  REQUIRE(contains(text, "# TYPE async_promise_threads_created_total counter\nasync_promise_threads_created_total "));
+  REQUIRE(contains(text, "# TYPE async_promise_tasks_run_total counter\n"));
+  REQUIRE(contains(text, "# TYPE async_promise_elements_launched_total counter\n"));
+  REQUIRE(contains(text, "# TYPE async_promise_waits_total counter\n"));
+  REQUIRE(contains(text, "# TYPE async_promise_wait_seconds_total counter\n"));
+  REQUIRE(contains(text, "# TYPE async_promise_errors_swallowed_total counter\n"));
+  REQUIRE(contains(text, "# TYPE async_promise_chains_in_flight gauge\n"));
+  REQUIRE_FALSE(contains(text, "async_promise_pool_"));
+  REQUIRE_FALSE(contains(text, "async_promise_stage_"));
+  REQUIRE('\n' == text.back());
+}
+
+
+TEST_CASE("Export thread pools in Prometheus format", "[metrics exporter]")
+{
+  async::thread_pool pool{2, 64};
+  async::metrics_exporter exporter;
+  exporter.add("io \"main\"", pool);
+
+  auto text = exporter.prometheus();
+  REQUIRE(contains(text, "# TYPE async_promise_pool_threads gauge\nasync_promise_pool_threads{pool=\"io \\\"main\\\"\"} 2\n"));
+  REQUIRE(contains(text, "async_promise_pool_queue_capacity{pool=\"io \\\"main\\\"\"} 64\n"));
+  REQUIRE(contains(text, "async_promise_pool_active_threads{pool="));
+  REQUIRE(contains(text, "async_promise_pool_utilization{pool="));
+  REQUIRE(contains(text, "async_promise_pool_queue_depth{pool="));
+}
+
+
+TEST_CASE("Export stage latencies in Prometheus format", "[metrics exporter]")
+{
+  async::metrics metrics;
+  {
+    metrics_scope scope{metrics};
+    async::make_promise([] () { return 1; }).name("load")
+        .all(std::vector<int(*)(int)>{[] (int value) { return value; }, [] (int value) { return value; }}).name("fan")
+        .run().get();
+  }
+
+  async::metrics_exporter exporter{&metrics};
+  auto text = exporter.prometheus();
+  REQUIRE(contains(text, "# TYPE async_promise_stage_duration_seconds summary\n"));
+  REQUIRE(contains(text, "async_promise_stage_duration_seconds{stage=\"load\",quantile=\"0.5\"} "));
+  REQUIRE(contains(text, "async_promise_stage_duration_seconds{stage=\"load\",quantile=\"0.999\"} "));
+  REQUIRE(contains(text, "async_promise_stage_duration_seconds_sum{stage=\"load\"} "));
+  REQUIRE(contains(text, "async_promise_stage_duration_seconds_count{stage=\"load\"} 1\n"));
+  REQUIRE(contains(text, "async_promise_function_wait_seconds_count{stage=\"fan\"} 2\n"));
+  REQUIRE(contains(text, "async_promise_function_duration_seconds_count{stage=\"fan\"} 2\n"));
+  REQUIRE_FALSE(contains(text, "async_promise_function_duration_seconds_count{stage=\"load\"}"));
+}
+
+
+TEST_CASE("Export metrics as JSON", "[metrics exporter]")
+{
+  async::metrics metrics;
+  {
+    metrics_scope scope{metrics};
+    async::make_promise([] () { return 1; }).name("load").run().get();
+  }
+
+  async::thread_pool pool{1, 16};
+  async::metrics_exporter exporter{&metrics};
+  exporter.add("cpu\n", pool);
+
+  std::ostringstream stream;
+  exporter.write_json(stream);
+  auto json = stream.str();
+  REQUIRE(0 == json.find("{\"runtime\":{\"threads_created\":"));
+  REQUIRE(contains(json, ",\"chains_in_flight\":"));
+  REQUIRE(contains(json, "\"pools\":[{\"name\":\"cpu\\u000a\",\"threads\":1,\"active_threads\":"));
+  REQUIRE(contains(json, ",\"queue_capacity\":16}]"));
+  REQUIRE(contains(json, "\"stages\":[{\"name\":\"load\",\"stage\":{\"count\":1,\"sum_ns\":"));
+  REQUIRE(contains(json, ",\"p50_ns\":"));
+  REQUIRE(contains(json, ",\"p999_ns\":"));
+  REQUIRE(contains(json, "\"function\":{\"count\":0,"));
+  REQUIRE('}' == json.back());
+  REQUIRE(0 == exporter.json().find("{\"runtime\":"));
+}
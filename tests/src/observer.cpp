@@ -0,0 +1,165 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+// stl
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+class recording_observer final : public async::observer
+{
+  public:
+    recording_observer()
+    {
+      async::set_observer(this);
+    }
+
+    ~recording_observer()
+    {
+      async::set_observer(nullptr);
+    }
+
+    void on_stage_start(const async::stage_event& event) final
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      starts.push_back(event);
+    }
+
+    void on_stage_end(const async::stage_event& event) final
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      ends.push_back(event);
+    }
+
+    void on_spawn(const async::stage_event& event) final
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      spawns.push_back(event);
+    }
+
+    void on_settle(const async::stage_event& event) final
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      settles.push_back(event);
+    }
+
+    std::vector<async::stage_event> starts;
+    std::vector<async::stage_event> ends;
+    std::vector<async::stage_event> spawns;
+    std::vector<async::stage_event> settles;
+
+  private:
+    std::mutex m_mutex;
+};
+
+} // namespace
+
+
+TEST_CASE("Observer stage events", "[observer]")
+{
+  recording_observer observer;
+  auto future = async::make_promise(string_void1).then(string_string1).run();
+
+  REQUIRE(future.get() == str1);
+  REQUIRE(2 == observer.starts.size());
+  REQUIRE(2 == observer.ends.size());
+  REQUIRE(async::stage_kind::initial == observer.starts[0].kind);
+  REQUIRE(async::stage_kind::then == observer.starts[1].kind);
+  REQUIRE(observer.starts[0].stage == observer.ends[0].stage);
+  REQUIRE(observer.starts[1].stage == observer.ends[1].stage);
+  REQUIRE(observer.ends[0].stage != observer.ends[1].stage);
+  REQUIRE(async::settle_type::resolved == observer.ends[0].outcome);
+  REQUIRE(async::settle_type::resolved == observer.ends[1].outcome);
+}
+
+
+TEST_CASE("Observer stage duration excludes prior stages", "[observer]")
+{
+  recording_observer observer;
+  auto future = async::make_promise(string_void_delayed).then(string_string1).run();
+
+  REQUIRE(future.get() == str1);
+  REQUIRE(2 == observer.ends.size());
+  REQUIRE(observer.ends[0].duration >= std::chrono::milliseconds(delay_length));
+  REQUIRE(observer.ends[1].duration < std::chrono::milliseconds(delay_length));
+  REQUIRE(observer.ends[1].start >= observer.ends[0].start + observer.ends[0].duration);
+}
+
+
+TEST_CASE("Observer rejected stages", "[observer]")
+{
+  recording_observer observer;
+  auto future = async::make_promise(error_string_void).then(string_string1).fail(string_exception).run();
+
+  REQUIRE(future.get() == str2);
+  REQUIRE(3 == observer.ends.size());
+  REQUIRE(async::settle_type::rejected == observer.ends[0].outcome);
+  REQUIRE(async::settle_type::rejected == observer.ends[1].outcome);
+  REQUIRE(async::stage_kind::fail == observer.ends[2].kind);
+  REQUIRE(async::settle_type::resolved == observer.ends[2].outcome);
+}
+
+
+TEST_CASE("Observer fan-out elements", "[observer]")
+{
+  recording_observer observer;
+  std::vector<std::string(*)(std::string)> funcs
+  {
+    string_string1,
+    error_string_string,
+    string_string2,
+  };
+
+  auto future = async::make_promise(string_void1).all_settled(funcs).run();
+
+  REQUIRE(3 == future.get().size());
+  REQUIRE(3 == observer.spawns.size());
+  REQUIRE(3 == observer.settles.size());
+  REQUIRE(async::stage_kind::all_settled == observer.ends.back().kind);
+  REQUIRE(std::all_of(observer.settles.begin(), observer.settles.end(), [&observer] (const async::stage_event& event)
+  {
+    return event.stage == observer.ends.back().stage;
+  }));
+  REQUIRE(1 == std::count_if(observer.settles.begin(), observer.settles.end(), [] (const async::stage_event& event)
+  {
+    return async::settle_type::rejected == event.outcome;
+  }));
+}
+
+
+TEST_CASE("Observer removed", "[observer]")
+{
+  std::vector<async::stage_event> ends;
+  {
+    recording_observer observer;
+    async::set_observer(nullptr);
+    async::make_promise(string_void1).then(string_string1).run().get();
+    ends = observer.ends;
+  }
+
+  REQUIRE(ends.empty());
+}
@@ -15,6 +15,13 @@
 **
 ******************************************************************************/
 
+
+// stl
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
 // local
 #include "common.h"
 
@@ -436,3 +443,16 @@ TEST_CASE("Race with func error lose string string", "[race]")
   REQUIRE_NOTHROW(res = future.get());
   REQUIRE(res == str1);
 }
+
+
+TEST_CASE("Race with a single function runs it on the calling thread", "[race]")
+{
+  auto caller = std::make_shared<std::thread::id>();
+  std::vector<std::function<std::thread::id()>> funcs(1, [] () { return std::this_thread::get_id(); });
+
+  auto future = async::make_promise([caller] () { *caller = std::this_thread::get_id(); }).race(funcs).run();
+
+  std::thread::id res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == *caller);
+}
@@ -0,0 +1,197 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+// stl
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+// local
+#include "common.h"
+
+
+static async::retry_policy make_policy(std::size_t max_attempts)
+{
+  async::retry_policy policy;
+  policy.max_attempts = max_attempts;
+  policy.initial_delay = std::chrono::milliseconds(1);
+  return policy;
+}
+
+
+TEST_CASE("Retry resolved", "[retry]")
+{
+  std::atomic<int> calls{0};
+  auto future = async::make_promise([&calls] { ++calls; return std::string{str1}; })
+                .retry(make_policy(3)).run();
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(1 == calls);
+}
+
+
+TEST_CASE("Retry resolved after rejections", "[retry]")
+{
+  std::atomic<int> calls{0};
+  auto func = [&calls]
+  {
+    if (++calls < 3)
+      throw std::runtime_error{str2};
+    return std::string{str1};
+  };
+
+  auto future = async::make_promise(func).retry(make_policy(3)).run();
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(3 == calls);
+}
+
+
+TEST_CASE("Retry rejected", "[retry]")
+{
+  std::atomic<int> calls{0};
+  auto future = async::make_promise([&calls] { ++calls; error_void_void(); })
+                .retry(make_policy(3)).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+  REQUIRE(3 == calls);
+}
+
+
+TEST_CASE("Retry rejected not matching predicate", "[retry]")
+{
+  std::atomic<int> calls{0};
+  auto policy = make_policy(3);
+  policy.retry_on = [] (const std::exception_ptr&) { return false; };
+
+  auto future = async::make_promise([&calls] { ++calls; error_void_void(); })
+                .retry(policy).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+  REQUIRE(1 == calls);
+}
+
+
+TEST_CASE("Retry rejected with backoff", "[retry]")
+{
+  auto policy = make_policy(3);
+  policy.initial_delay = std::chrono::milliseconds(delay_length / 2);
+  policy.jitter = 0.0;
+
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_promise(error_void_void).retry(policy).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(delay_length + delay_length / 2));
+}
+
+
+TEST_CASE("Retry race", "[retry]")
+{
+  std::atomic<int> calls{0};
+  std::vector<std::string(*)()> funcs
+  {
+    string_void1,
+    string_void_delayed,
+  };
+
+  auto future = async::make_promise_race(funcs)
+                .then([&calls] (std::string str)
+                {
+                  if (++calls < 2)
+                    throw std::runtime_error{str2};
+                  return str;
+                })
+                .retry(make_policy(2)).run();
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(2 == calls);
+}
+
+
+TEST_CASE("Retry releases the pool worker between attempts", "[retry]")
+{
+  auto policy = make_policy(2);
+  policy.initial_delay = std::chrono::milliseconds(delay_length);
+  policy.jitter = 0.0;
+
+  async::thread_pool pool{1};
+  std::atomic<int> calls{0};
+  auto future = async::make_promise([&calls] { if (++calls < 2) error_void_void(); return std::string{str1}; })
+                .retry(policy).run(pool);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(delay_length / 2));
+  REQUIRE(0 == pool.active());
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(2 == calls);
+}
+
+
+TEST_CASE("Retry runs a delay again", "[retry]")
+{
+  std::atomic<int> calls{0};
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_promise([&calls] { ++calls; return std::string{str1}; })
+                .delay(std::chrono::milliseconds(delay_length / 2))
+                .then([] (std::string str) { error_void_void(); return str; })
+                .retry(make_policy(3)).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+  REQUIRE(3 == calls);
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(3 * delay_length / 2));
+}
+
+
+TEST_CASE("Retry deferred", "[retry]")
+{
+  std::atomic<int> calls{0};
+  auto func = [&calls]
+  {
+    if (++calls < 3)
+      throw std::runtime_error{str2};
+    return std::string{str1};
+  };
+
+  auto future = async::make_promise(func).retry(make_policy(3)).run(std::launch::deferred);
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+  REQUIRE(3 == calls);
+}
+
+
+TEST_CASE("Retry nested", "[retry]")
+{
+  std::atomic<int> calls{0};
+  auto future = async::make_promise([&calls] { ++calls; error_void_void(); })
+                .retry(make_policy(2)).then(void_void).retry(make_policy(3)).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+  REQUIRE(6 == calls);
+}
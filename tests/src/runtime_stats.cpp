@@ -0,0 +1,107 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+// stl
+#include <chrono>
+#include <string>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+TEST_CASE("Runtime stats of a chain", "[runtime stats]")
+{
+  std::vector<std::string(*)(std::string)> funcs
+  {
+    string_string1,
+    string_string_delayed,
+    string_string2,
+  };
+
+  auto before = async::get_runtime_stats();
+  auto future = async::make_promise(string_void1).all(funcs).run();
+  REQUIRE(3 == future.get().size());
+  auto after = async::get_runtime_stats();
+
+  REQUIRE(2 == after.tasks_run - before.tasks_run);
+  REQUIRE(3 == after.elements_launched - before.elements_launched);
+  // The chain thread and two of the functions, the chain thread runs the first function itself
+  REQUIRE(3 == after.threads_created - before.threads_created);
+  REQUIRE(1 <= after.waits - before.waits);
+  REQUIRE(after.wait_time - before.wait_time >= std::chrono::milliseconds(delay_length / 2));
+  REQUIRE(0 == after.chains_in_flight);
+}
+
+
+TEST_CASE("Runtime stats of an all join", "[runtime stats]")
+{
+  // The calling thread runs the first function, it must finish before the others to wait for them
+  std::vector<std::string(*)(std::string)> funcs(16, string_string_delayed);
+  funcs.front() = string_string1;
+
+  auto before = async::get_runtime_stats();
+  auto future = async::make_resolved_promise(str1).all(funcs).run();
+  REQUIRE(funcs.size() == future.get().size());
+  auto after = async::get_runtime_stats();
+
+  // The stage is woken once by the last function instead of once per function
+  REQUIRE(1 == after.waits - before.waits);
+}
+
+
+TEST_CASE("Runtime stats of chains in flight", "[runtime stats]")
+{
+  auto future = async::make_promise(string_void_delayed).run();
+  while (0 == async::get_runtime_stats().chains_in_flight);
+
+  REQUIRE(1 == async::get_runtime_stats().chains_in_flight);
+  REQUIRE(future.get() == str1);
+  REQUIRE(0 == async::get_runtime_stats().chains_in_flight);
+}
+
+
+TEST_CASE("Runtime stats of swallowed errors", "[runtime stats]")
+{
+  std::vector<std::string(*)()> funcs
+  {
+    string_void1,
+    string_void2,
+  };
+
+  auto before = async::get_runtime_stats();
+  auto future = async::make_promise_race(funcs).run();
+  future.get();
+  auto after = async::get_runtime_stats();
+
+  REQUIRE(1 == after.errors_swallowed - before.errors_swallowed);
+}
+
+
+TEST_CASE("Runtime stats of a thread pool", "[runtime stats]")
+{
+  auto before = async::get_runtime_stats();
+  async::thread_pool pool{3};
+  std::vector<void(*)()> funcs(4, void_void);
+  async::make_resolved_promise().all(funcs).on(pool).run(pool).get();
+  auto after = async::get_runtime_stats();
+
+  REQUIRE(3 == after.threads_created - before.threads_created);
+  REQUIRE(4 == after.elements_launched - before.elements_launched);
+}
@@ -0,0 +1,243 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+// stl
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+TEST_CASE("Some with class method void void", "[some]")
+{
+  test_struct obj;
+  // Declared after the object, so the methods still running when the stage settled finish before it is destroyed
+  async::thread_pool pool{2};
+
+  std::vector<void(test_struct::*)() const> methods
+  {
+    &test_struct::void_void,
+    &test_struct::error_void_void,
+    &test_struct::void_void,
+  };
+
+  auto future = async::make_resolved_promise().some(2, methods, &obj).on(pool).run();
+
+  REQUIRE_NOTHROW(future.get());
+}
+
+
+TEST_CASE("Some with class method error void void", "[some]")
+{
+  test_struct obj;
+  async::thread_pool pool{2};
+
+  std::vector<void(test_struct::*)() const> methods
+  {
+    &test_struct::error_void_void,
+    &test_struct::error_void_void,
+    &test_struct::void_void,
+  };
+
+  auto future = async::make_resolved_promise().some(2, methods, &obj).on(pool).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), async::aggregate_error, Catch::Matchers::Message(aggregate_error_message));
+}
+
+
+TEST_CASE("Some with class method string void", "[some]")
+{
+  test_struct obj;
+  async::thread_pool pool{2};
+
+  std::vector<std::string(test_struct::*)() const> methods
+  {
+    &test_struct::string_void1,
+    &test_struct::error_string_void,
+    &test_struct::string_void1,
+  };
+
+  auto future = async::make_resolved_promise().some(2, methods, &obj).on(pool).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE_THAT(res, Catch::Matchers::Equals(std::vector<std::string>{str1, str1}));
+}
+
+
+TEST_CASE("Some with class method string string", "[some]")
+{
+  test_struct obj;
+  async::thread_pool pool{2};
+
+  std::vector<std::string(test_struct::*)(std::string) const> methods
+  {
+    &test_struct::string_string1,
+    &test_struct::string_string1,
+    &test_struct::error_string_string,
+  };
+
+  auto future = async::make_resolved_promise(str1).some(2, methods, &obj).on(pool).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE_THAT(res, Catch::Matchers::Equals(std::vector<std::string>{str1, str1}));
+}
+
+
+TEST_CASE("Some with func void string", "[some]")
+{
+  std::vector<void(*)(std::string)> funcs
+  {
+    void_string,
+    error_void_string,
+    void_string,
+  };
+
+  auto future = async::make_resolved_promise(str1).some(2, funcs).run();
+
+  REQUIRE_NOTHROW(future.get());
+}
+
+
+TEST_CASE("Some with func string void ignore arg", "[some]")
+{
+  std::vector<std::string(*)()> funcs
+  {
+    string_void2,
+    string_void2,
+  };
+
+  auto future = async::make_resolved_promise(str1).some(2, funcs).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE_THAT(res, Catch::Matchers::Equals(std::vector<std::string>{str2, str2}));
+}
+
+
+TEST_CASE("Some with func error string string", "[some]")
+{
+  std::vector<std::string(*)(std::string)> funcs
+  {
+    error_string_string,
+    string_string1,
+    error_string_string,
+  };
+
+  auto future = async::make_resolved_promise(str1).some(2, funcs).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), async::aggregate_error, Catch::Matchers::Message(aggregate_error_message));
+}
+
+
+TEST_CASE("Some with count greater than size", "[some]")
+{
+  std::vector<std::string(*)()> funcs
+  {
+    string_void1,
+  };
+
+  auto future = async::make_resolved_promise().some(2, funcs).run();
+
+  REQUIRE_THROWS_AS(future.get(), async::aggregate_error);
+}
+
+
+TEST_CASE("Some with zero count", "[some]")
+{
+  std::vector<std::string(*)()> funcs
+  {
+    error_string_void,
+  };
+
+  auto future = async::make_resolved_promise().some(0, funcs).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res.empty());
+}
+
+
+TEST_CASE("Some does not wait for stragglers", "[some]")
+{
+  std::promise<void> release;
+  auto released = release.get_future().share();
+
+  std::vector<std::function<std::string()>> funcs
+  {
+    string_void1,
+    [released] () { released.wait(); return std::string{str2}; },
+    string_void1,
+  };
+
+  auto future = async::make_resolved_promise().some(2, funcs).run();
+
+  REQUIRE(std::future_status::ready == future.wait_for(std::chrono::milliseconds(delay_length * 10)));
+  REQUIRE_THAT(future.get(), Catch::Matchers::Equals(std::vector<std::string>{str1, str1}));
+  release.set_value();
+}
+
+
+TEST_CASE("Some skips functions not started when settled", "[some]")
+{
+  auto calls = std::make_shared<std::atomic<int>>(0);
+  std::vector<std::function<std::string()>> funcs(4, [calls] () { ++*calls; return std::string{str1}; });
+
+  auto limiter = std::make_shared<async::concurrency_limiter>(1, 1, 1);
+  auto future = async::make_resolved_promise().some(1, funcs).limit(limiter).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE_THAT(res, Catch::Matchers::Equals(std::vector<std::string>{str1}));
+  REQUIRE(1 == *calls);
+}
+
+
+TEST_CASE("Some with zero count passes prior rejection", "[some]")
+{
+  std::vector<std::string(*)()> funcs
+  {
+    string_void1,
+  };
+
+  auto future = async::make_promise(error_void_void).some(0, funcs).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+}
+
+
+TEST_CASE("Some with func taking the input by rvalue reference", "[some]")
+{
+  std::vector<std::size_t(*)(std::string&&)> funcs
+  {
+    [] (std::string&& str) { return std::string{std::move(str)}.size(); },
+    [] (std::string&& str) { return std::string{std::move(str)}.size(); },
+  };
+
+  auto future = async::make_resolved_promise(std::string{str1}).some(2, funcs).run();
+
+  std::vector<std::size_t> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == std::vector<std::size_t>(2, std::string{str1}.size()));
+}
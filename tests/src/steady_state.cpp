@@ -0,0 +1,163 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+
+// stl
+#include <cstdint>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+// async_promise
+#include <async_promise.hpp>
+
+// local
+#include "common.h"
+
+
+/*
+ * Allocations are counted by the global allocation functions replaced in allocations.cpp
+ */
+
+namespace
+{
+
+class tracking_scope final
+{
+  public:
+    tracking_scope()
+    {
+      async::set_allocation_tracking(true);
+    }
+
+    ~tracking_scope()
+    {
+      async::set_allocation_tracking(false);
+    }
+};
+
+
+std::uint64_t allocations()
+{
+  std::uint64_t result = 0;
+  for (const auto& item : async::get_allocation_stats())
+    result += item.library.allocations + item.user.allocations;
+  return result;
+}
+
+
+int increment(int value)
+{
+  return value + 1;
+}
+
+} // namespace
+
+
+TEST_CASE("Arena recycles blocks", "[steady_state]")
+{
+  async::arena memory{64, 1};
+  REQUIRE(64 == memory.block_size());
+
+  auto first = memory.allocate(32);
+  memory.deallocate(first, 32);
+  auto second = memory.allocate(64);
+  REQUIRE(first == second);
+
+  auto large = memory.allocate(128);
+  REQUIRE(nullptr != large);
+  REQUIRE(second != large);
+  memory.deallocate(large, 128);
+  memory.deallocate(second, 64);
+}
+
+
+TEST_CASE("Run with an allocator", "[steady_state]")
+{
+  async::arena memory;
+  async::arena_allocator<int> alloc{memory};
+  async::thread_pool pool{2};
+
+  auto resolved = async::make_resolved_promise(1).then(increment).run(pool, alloc);
+  REQUIRE(2 == resolved.get());
+
+  auto rejected = async::make_resolved_promise(1).then([] (int) -> int { throw std::runtime_error{"error"}; }).run(pool, alloc);
+  REQUIRE_THROWS_AS(rejected.get(), std::runtime_error);
+
+  auto void_result = async::make_resolved_promise(1).then([] (int) {}).run(pool, alloc);
+  REQUIRE_NOTHROW(void_result.get());
+}
+
+
+TEST_CASE("Run with an allocator on a full thread pool", "[steady_state]")
+{
+  async::arena memory;
+  async::thread_pool pool{1, 2, async::overflow_policy::reject};
+
+  std::promise<void> gate;
+  auto shared = gate.get_future().share();
+  auto blocked = async::make_promise([shared] () { shared.wait(); }).run(pool);
+
+  auto chain = async::make_resolved_promise(1).then(increment);
+  std::vector<std::future<int>> futures;
+  for (auto i = 0; i < 8; ++i)
+    futures.push_back(chain.run(pool, async::arena_allocator<int>{memory}));
+
+  gate.set_value();
+  blocked.get();
+
+  auto resolved = 0;
+  auto rejected = 0;
+  for (auto& future : futures)
+  {
+    try
+    {
+      if (2 == future.get())
+        ++resolved;
+    }
+    catch(const async::overload_error&)
+    {
+      ++rejected;
+    }
+  }
+
+  REQUIRE(8 == resolved + rejected);
+  REQUIRE(0 < rejected);
+}
+
+
+TEST_CASE("Prebuilt chain runs without allocations in steady state", "[steady_state]")
+{
+  // A worker may release the shared state of a future after the next run started,
+  // so a few blocks are reserved for the futures alive at once
+  async::arena memory{256, 16};
+  async::arena_allocator<int> alloc{memory};
+  async::thread_pool pool{2};
+  auto chain = async::make_resolved_promise(0).then(increment).then(increment).then(increment);
+
+  for (auto i = 0; i < 100; ++i)
+    REQUIRE(3 == chain.run(pool, alloc).get());
+
+  tracking_scope tracking;
+  auto before = allocations();
+  for (auto i = 0; i < 1000; ++i)
+    REQUIRE(3 == chain.run(pool, alloc).get());
+
+  REQUIRE(before == allocations());
+}
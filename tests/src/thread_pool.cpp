@@ -0,0 +1,330 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+std::string thread_name()
+{
+#ifdef __linux__
+  char name[16] = {};
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+  return name;
+#else
+  return {};
+#endif
+}
+
+
+std::size_t stack_size()
+{
+#ifdef __linux__
+  pthread_attr_t attr;
+  std::size_t size = 0;
+  pthread_getattr_np(pthread_self(), &attr);
+  pthread_attr_getstacksize(&attr, &size);
+  pthread_attr_destroy(&attr);
+  return size;
+#else
+  return 0;
+#endif
+}
+
+} // namespace
+
+
+TEST_CASE("Thread pool submit", "[thread pool]")
+{
+  async::thread_pool pool{2};
+  auto future = pool.submit([] (int a, int b) { return a + b; }, 2, 2);
+  REQUIRE(4 == future.get());
+  REQUIRE(2 == pool.size());
+}
+
+
+TEST_CASE("Thread pool submit error", "[thread pool]")
+{
+  async::thread_pool pool{1};
+  auto future = pool.submit(error_void_void);
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+}
+
+
+TEST_CASE("Thread pool runs queued functions on destruction", "[thread pool]")
+{
+  std::atomic<int> count{0};
+  {
+    async::thread_pool pool{2, 256};
+    for (auto i = 0; i < 100; ++i)
+      pool.submit([&count] { ++count; });
+  }
+
+  REQUIRE(100 == count);
+}
+
+
+TEST_CASE("Thread pool overflow reject", "[thread pool]")
+{
+  async::thread_pool pool{1, 2, async::overflow_policy::reject};
+  std::promise<void> gate;
+  auto gate_future = gate.get_future().share();
+  auto blocker = pool.submit([gate_future] { gate_future.wait(); });
+  while (0 != pool.queue_size())
+    std::this_thread::yield();
+
+  auto queued1 = pool.submit(string_void1);
+  auto queued2 = pool.submit(string_void1);
+  auto rejected = pool.submit(string_void1);
+  REQUIRE_THROWS_AS(rejected.get(), async::overload_error);
+
+  gate.set_value();
+  REQUIRE(str1 == queued1.get());
+  REQUIRE(str1 == queued2.get());
+}
+
+
+TEST_CASE("Thread pool overflow run inline", "[thread pool]")
+{
+  async::thread_pool pool{1, 2, async::overflow_policy::run_inline};
+  std::promise<void> gate;
+  auto gate_future = gate.get_future().share();
+  auto blocker = pool.submit([gate_future] { gate_future.wait(); });
+  while (0 != pool.queue_size())
+    std::this_thread::yield();
+
+  pool.submit(string_void1);
+  pool.submit(string_void1);
+  auto id = pool.submit([] { return std::this_thread::get_id(); });
+  REQUIRE(std::this_thread::get_id() == id.get());
+  gate.set_value();
+}
+
+
+TEST_CASE("Thread pool overflow block", "[thread pool]")
+{
+  std::atomic<int> count{0};
+  async::thread_pool pool{2, 2, async::overflow_policy::block};
+  std::vector<std::future<void>> futures;
+  for (auto i = 0; i < 100; ++i)
+    futures.push_back(pool.submit([&count] { ++count; }));
+
+  for (auto& future : futures)
+    future.get();
+
+  REQUIRE(100 == count);
+}
+
+
+TEST_CASE("Thread pool bounds the nesting of queued functions", "[thread pool]")
+{
+  constexpr auto count = 64;
+  std::atomic<int> depth{0};
+  std::atomic<int> max_depth{0};
+  std::atomic<int> done{0};
+  {
+    async::thread_pool pool{1, 128};
+    std::promise<void> gate;
+    auto gate_future = gate.get_future().share();
+    pool.submit([gate_future] { gate_future.wait(); });
+    for (auto i = 0; i < count; ++i)
+    {
+      // Each function runs the next one queued, as a waiting function does
+      pool.submit([&]
+      {
+        auto current = ++depth;
+        auto max = max_depth.load();
+        while (max < current && !max_depth.compare_exchange_weak(max, current));
+
+        pool.run_one();
+        --depth;
+        ++done;
+      });
+    }
+
+    gate.set_value();
+  }
+
+  REQUIRE(count == done);
+  REQUIRE(max_depth < count);
+}
+
+
+TEST_CASE("Thread pool all", "[thread pool]")
+{
+  async::thread_pool pool{2};
+  std::vector<std::string(*)(std::string)> funcs
+  {
+    string_string1,
+    string_string1,
+    string_string1,
+  };
+
+  auto future = async::make_promise(string_void1).all(funcs).on(pool).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(3 == res.size());
+}
+
+
+TEST_CASE("Thread pool any", "[thread pool]")
+{
+  async::thread_pool pool{2};
+  std::vector<std::string(*)(std::string)> funcs
+  {
+    error_string_string,
+    string_string1,
+  };
+
+  auto future = async::make_promise(string_void1).any(funcs).on(pool).run();
+
+  REQUIRE(str1 == future.get());
+}
+
+
+TEST_CASE("Thread pool nested fan-outs", "[thread pool]")
+{
+  async::thread_pool pool{1, 4};
+  std::vector<std::function<int()>> inner(4, [] { return 1; });
+  std::vector<std::function<int()>> outer(4, [&pool, inner]
+  {
+    auto res = async::make_promise_all(inner).on(pool).run(std::launch::deferred).get();
+    return static_cast<int>(res.size());
+  });
+
+  auto future = async::make_promise_all(outer).on(pool).run(pool);
+
+  std::vector<int> res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(4 == res.size());
+  REQUIRE(4 == res.front());
+}
+
+
+TEST_CASE("Thread pool with limiter", "[thread pool]")
+{
+  async::thread_pool pool{4};
+  auto limiter = std::make_shared<async::concurrency_limiter>(2, 1, 2);
+  std::vector<void(*)()> funcs(8, void_void);
+
+  auto future = async::make_resolved_promise().all(funcs).limit(limiter).on(pool).run();
+
+  REQUIRE_NOTHROW(future.get());
+  REQUIRE(0 == limiter->in_flight());
+}
+
+
+TEST_CASE("Thread pool thread options", "[thread pool]")
+{
+  std::mutex mutex;
+  std::set<std::size_t> indexes;
+  async::thread_options options;
+  options.name = "test-pool";
+  options.stack_size = 256 * 1024;
+  options.setup = [&mutex, &indexes] (std::size_t index)
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    indexes.insert(index);
+  };
+
+  {
+    async::thread_pool pool{3, 16, async::overflow_policy::block, options};
+    auto future = pool.submit([] { return std::make_pair(thread_name(), stack_size()); });
+    auto res = future.get();
+#ifdef __linux__
+    REQUIRE(0 == res.first.find("test-pool-"));
+    REQUIRE(options.stack_size == res.second);
+#endif
+  }
+
+  REQUIRE(std::set<std::size_t>{0, 1, 2} == indexes);
+}
+
+
+TEST_CASE("Thread pool default thread name", "[thread pool]")
+{
+  async::thread_pool pool{1};
+  auto name = pool.submit(thread_name).get();
+#ifdef __linux__
+  REQUIRE("ap-worker-0" == name);
+#endif
+}
+
+
+TEST_CASE("Thread pool leaves the original promise on its own threads", "[thread pool]")
+{
+  std::vector<std::function<bool()>> funcs(3, [] () { return nullptr != async::thread_pool::current(); });
+
+  async::thread_pool pool{2};
+  auto promise = async::make_promise_all(funcs);
+  auto pooled = promise.on(pool);
+
+  // The first function runs on the calling thread
+  auto res = promise.run().get();
+  REQUIRE(std::none_of(res.begin() + 1, res.end(), [] (bool on_pool) { return on_pool; }));
+
+  res = pooled.run().get();
+  REQUIRE(std::all_of(res.begin() + 1, res.end(), [] (bool on_pool) { return on_pool; }));
+}
+
+
+TEST_CASE("Thread options of fan-out threads", "[thread pool]")
+{
+  std::atomic<int> setups{0};
+  async::thread_options options;
+  options.name = "test-fanout";
+  options.stack_size = 128 * 1024;
+  options.setup = [&setups] (std::size_t) { ++setups; };
+  async::set_thread_options(&options);
+
+  std::vector<std::function<std::string()>> funcs(3, thread_name);
+  auto future = async::make_promise_all(funcs).run();
+
+  std::vector<std::string> res;
+  REQUIRE_NOTHROW(res = future.get());
+  async::set_thread_options(nullptr);
+
+  // The chain thread runs the first function itself
+  REQUIRE(3 == res.size());
+  REQUIRE(2 == setups);
+#ifdef __linux__
+  for (std::size_t i = 1; i < res.size(); ++i)
+    REQUIRE(0 == res[i].find("test-fanout-"));
+#endif
+}
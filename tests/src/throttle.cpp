@@ -0,0 +1,141 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+// stl
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// local
+#include "common.h"
+
+
+TEST_CASE("Throttle void", "[throttle]")
+{
+  auto limiter = std::make_shared<async::rate_limiter>(1000.0 / delay_length * 2);
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::future<void>> futures;
+  for (auto i = 0; i < 5; ++i)
+    futures.push_back(async::make_resolved_promise().throttle(limiter).run());
+
+  for (auto& future : futures)
+    REQUIRE_NOTHROW(future.get());
+
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(2 * delay_length));
+}
+
+
+TEST_CASE("Throttle releases the pool worker", "[throttle]")
+{
+  auto limiter = std::make_shared<async::rate_limiter>(1000.0 / delay_length);
+  REQUIRE(limiter->try_acquire());
+
+  async::thread_pool pool{1};
+  auto future = async::make_resolved_promise().throttle(limiter).run(pool);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(delay_length / 2));
+  REQUIRE(0 == pool.active());
+  REQUIRE_NOTHROW(future.get());
+}
+
+
+TEST_CASE("Throttle deferred", "[throttle]")
+{
+  auto limiter = std::make_shared<async::rate_limiter>(1000.0 / delay_length);
+  REQUIRE(limiter->try_acquire());
+
+  auto start = std::chrono::steady_clock::now();
+  auto future = async::make_resolved_promise().throttle(limiter).run(std::launch::deferred);
+
+  REQUIRE_NOTHROW(future.get());
+  REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(delay_length / 2));
+}
+
+
+TEST_CASE("Throttle string", "[throttle]")
+{
+  auto limiter = std::make_shared<async::rate_limiter>(1000.0 / delay_length);
+  auto future = async::make_resolved_promise(str1).throttle(limiter).then(string_string1).run();
+
+  std::string res;
+  REQUIRE_NOTHROW(res = future.get());
+  REQUIRE(res == str1);
+}
+
+
+TEST_CASE("Throttle rejected string", "[throttle]")
+{
+  auto limiter = std::make_shared<async::rate_limiter>(1000.0 / delay_length);
+  auto future = async::make_rejected_promise<std::string>(std::runtime_error{str2}).throttle(limiter).run();
+
+  REQUIRE_THROWS_MATCHES(future.get(), std::runtime_error, Catch::Matchers::Message(str2));
+  REQUIRE(limiter->try_acquire());
+}
+
+
+TEST_CASE("Rate limiter burst", "[throttle]")
+{
+  async::rate_limiter limiter{1000.0 / delay_length, 3};
+
+  REQUIRE(limiter.try_acquire());
+  REQUIRE(limiter.try_acquire());
+  REQUIRE(limiter.try_acquire());
+  REQUIRE_FALSE(limiter.try_acquire());
+}
+
+
+TEST_CASE("Rate limiter reserve", "[throttle]")
+{
+  async::rate_limiter limiter{1000.0 / delay_length};
+
+  auto now = async::rate_limiter::clock::now();
+  REQUIRE(limiter.reserve() <= now + std::chrono::milliseconds(delay_length / 10));
+  REQUIRE(limiter.reserve() >= now + std::chrono::milliseconds(delay_length));
+  REQUIRE(limiter.reserve() >= now + std::chrono::milliseconds(2 * delay_length));
+  REQUIRE_FALSE(limiter.try_acquire());
+}
+
+
+TEST_CASE("Rate limiter invalid rate", "[throttle]")
+{
+  REQUIRE_THROWS_AS(async::rate_limiter{0.0}, std::invalid_argument);
+  REQUIRE_THROWS_AS(async::rate_limiter{-1.0}, std::invalid_argument);
+  REQUIRE_THROWS_AS(async::rate_limiter{std::numeric_limits<double>::infinity()}, std::invalid_argument);
+  REQUIRE_THROWS_AS(async::rate_limiter{std::numeric_limits<double>::quiet_NaN()}, std::invalid_argument);
+}
+
+
+TEST_CASE("Rate limiter tiny rate", "[throttle]")
+{
+  async::rate_limiter limiter{std::numeric_limits<double>::denorm_min(), SIZE_MAX};
+
+  auto now = async::rate_limiter::clock::now();
+  REQUIRE(limiter.reserve() <= now + std::chrono::milliseconds(delay_length / 10));
+  REQUIRE(limiter.reserve() <= now + std::chrono::milliseconds(delay_length / 10));
+
+  async::rate_limiter slow{std::numeric_limits<double>::denorm_min()};
+  REQUIRE(slow.try_acquire());
+  REQUIRE(slow.reserve() > now + std::chrono::hours(24 * 365));
+  REQUIRE(slow.reserve() > now + std::chrono::hours(24 * 365));
+  REQUIRE_FALSE(slow.try_acquire());
+}
@@ -0,0 +1,244 @@
+/******************************************************************************
+**
+** Copyright (C) 2023 Ivan Pinezhaninov <ivan.pinezhaninov@gmail.com>
+**
+** This file is part of the async_promise project - which can be found at
+** https://github.com/IvanPinezhaninov/async_promise/.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+** DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+** OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+** THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+******************************************************************************/
+
+
+
+// stl
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// async_promise
+#include <async_promise_tracer.hpp>
+
+// local
+#include "common.h"
+
+
+namespace
+{
+
+class tracer_scope final
+{
+  public:
+    explicit tracer_scope(async::tracer& tracer)
+    {
+      async::set_observer(&tracer);
+    }
+
+    ~tracer_scope()
+    {
+      async::set_observer(nullptr);
+    }
+};
+
+
+std::function<int(int)> sleeping(int milliseconds)
+{
+  return [milliseconds] (int value)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds{milliseconds});
+    return value;
+  };
+}
+
+
+async::promise<int> fan_out_chain()
+{
+  return async::make_promise([] () { return 1; }).name("load")
+         .all(std::vector<std::function<int(int)>>{sleeping(1), sleeping(40), sleeping(5)}).name("fan")
+         .then([] (std::vector<int> values) { return static_cast<int>(values.size()); }).name("save");
+}
+
+
+std::size_t count(const std::string& str, const std::string& substr)
+{
+  std::size_t result = 0;
+  for (auto pos = str.find(substr); pos != std::string::npos; pos = str.find(substr, pos + substr.size()))
+    ++result;
+  return result;
+}
+
+} // namespace
+
+
+TEST_CASE("Tracer named stages", "[tracer]")
+{
+  async::tracer tracer;
+  {
+    tracer_scope scope{tracer};
+    auto future = async::make_promise(string_void1).name("load")
+                  .then(string_string1).name("parse \"json\"")
+                  .run();
+    REQUIRE(future.get() == str1);
+  }
+
+  std::ostringstream stream;
+  tracer.write(stream);
+  auto json = stream.str();
+
+  REQUIRE(2 == tracer.size());
+  REQUIRE(0 == json.find("{\"traceEvents\":["));
+  REQUIRE(std::string::npos != json.find("\"name\":\"load\""));
+  REQUIRE(std::string::npos != json.find("\"name\":\"parse \\\"json\\\"\""));
+  REQUIRE(2 == count(json, "\"ph\":\"X\""));
+}
+
+
+TEST_CASE("Tracer names a copy of the stage", "[tracer]")
+{
+  auto unnamed = async::make_promise(string_void1);
+  auto named = unnamed.name("load");
+
+  async::tracer tracer;
+  {
+    tracer_scope scope{tracer};
+    REQUIRE(unnamed.run().get() == str1);
+    REQUIRE(named.run().get() == str1);
+  }
+
+  std::ostringstream stream;
+  tracer.write(stream);
+  auto json = stream.str();
+
+  REQUIRE(1 == count(json, "\"name\":\"load\""));
+  REQUIRE(1 == count(json, "\"name\":\"initial\""));
+}
+
+
+TEST_CASE("Tracer fan-out functions", "[tracer]")
+{
+  async::tracer tracer;
+  {
+    tracer_scope scope{tracer};
+    std::vector<std::string(*)(std::string)> funcs
+    {
+      string_string1,
+      error_string_string,
+    };
+
+    auto future = async::make_promise(string_void1).race(funcs).run();
+    future.wait();
+  }
+
+  std::ostringstream stream;
+  tracer.write(stream);
+  auto json = stream.str();
+
+  REQUIRE(6 == tracer.size());
+  REQUIRE(2 == count(json, "\"cat\":\"spawn\""));
+  REQUIRE(2 == count(json, "\"cat\":\"function\""));
+  REQUIRE(2 == count(json, "\"ph\":\"s\""));
+  REQUIRE(2 == count(json, "\"ph\":\"f\""));
+  REQUIRE(1 == count(json, "\"name\":\"initial\""));
+  REQUIRE(5 == count(json, "\"name\":\"race\""));
+}
+
+
+TEST_CASE("Tracer save", "[tracer]")
+{
+  async::tracer tracer;
+  {
+    tracer_scope scope{tracer};
+    async::make_promise(string_void1).run().get();
+  }
+
+  auto path = std::string{"async_promise_tracer_test.json"};
+  REQUIRE_NOTHROW(tracer.save(path));
+
+  std::ifstream file{path};
+  std::string json{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+  file.close();
+  std::remove(path.c_str());
+
+  REQUIRE(0 == json.find("{\"traceEvents\":["));
+  REQUIRE(1 == count(json, "\"ph\":\"X\""));
+
+  tracer.clear();
+  REQUIRE(0 == tracer.size());
+}
+
+
+TEST_CASE("Tracer critical path of a run", "[tracer]")
+{
+  async::tracer tracer;
+  {
+    tracer_scope scope{tracer};
+    REQUIRE(3 == fan_out_chain().run().get());
+  }
+
+  auto paths = tracer.critical_paths();
+  REQUIRE(1 == paths.size());
+  REQUIRE(0 != paths.front().chain);
+
+  std::chrono::nanoseconds total{0};
+  const async::path_segment* slowest = nullptr;
+  for (const auto& segment : paths.front().segments)
+  {
+    total += segment.duration;
+    if (!slowest || slowest->duration < segment.duration)
+      slowest = &segment;
+  }
+
+  REQUIRE(paths.front().duration == total);
+  REQUIRE(paths.front().duration >= std::chrono::milliseconds{40});
+  REQUIRE("fan" == slowest->name);
+  REQUIRE(async::path_segment_kind::function == slowest->kind);
+  REQUIRE(0 != slowest->element);
+  REQUIRE(slowest->duration >= std::chrono::milliseconds{40});
+  REQUIRE("load" == paths.front().segments.front().name);
+  REQUIRE("save" == paths.front().segments.back().name);
+}
+
+
+TEST_CASE("Tracer critical path of many runs", "[tracer]")
+{
+  async::tracer tracer;
+  {
+    tracer_scope scope{tracer};
+    auto chain = fan_out_chain();
+    REQUIRE(3 == chain.run().get());
+    REQUIRE(3 == chain.run().get());
+  }
+
+  auto paths = tracer.critical_paths();
+  REQUIRE(2 == paths.size());
+  REQUIRE(paths[0].chain < paths[1].chain);
+
+  auto summary = tracer.critical_path_summary();
+  REQUIRE_FALSE(summary.empty());
+  REQUIRE("fan" == summary.front().name);
+  REQUIRE(async::path_segment_kind::function == summary.front().kind);
+  REQUIRE(2 == summary.front().count);
+  REQUIRE(0.5 < summary.front().share);
+
+  auto shares = 0.0;
+  for (const auto& share : summary)
+    shares += share.share;
+  REQUIRE(std::abs(shares - 1.0) < 1e-9);
+
+  std::ostringstream stream;
+  tracer.write_critical_path(stream);
+  REQUIRE(0 == stream.str().find_first_of(' '));
+  REQUIRE(std::string::npos != stream.str().find("ms        2x  function fan\n"));
+}